@@ -0,0 +1,21 @@
+/**
+ * @file blkcrc.h
+ *
+ * CRC of VMS BACKUP saveset blocks.
+ */
+
+#ifndef _BLKCRC_H_
+#define _BLKCRC_H_
+
+/* What bc_block() makes of a block */
+#define BC_OK		(0)	/*!< CRC matches */
+#define BC_NONE		(1)	/*!< block has no CRC (saved with /NOCRC) */
+#define BC_BAD		(2)	/*!< CRC doesn't match */
+
+extern void bc_init( void );
+extern unsigned int bc_crc32( unsigned int crc, const unsigned char *buf, size_t len );
+extern int bc_verify( const unsigned char *blk, int bsize, int crcoff );
+extern int bc_block( const unsigned char *blk, int bsize, int crcoff );
+extern void bc_stats( void );
+
+#endif	/* _BLKCRC_H_ */
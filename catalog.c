@@ -0,0 +1,802 @@
+/**
+ * @file catalog.c
+ */
+
+/**
+ * Catalog of the savesets and files in an image (--catalog).
+ *
+ * While an image is read (-t or -x) what's decoded of it is kept: the
+ * labels and summary record of each saveset and what process_file()
+ * gets out of each file record, along with the block its data starts
+ * and ends in, and where each block is in the image. At the end it's
+ * written to the catalog file. A later -t of the same image is answered
+ * from the catalog without reading the image, and a -x of a few files
+ * reads just their blocks.
+ *
+ * Where the blocks are is kept as runs: blocks with consecutive numbers
+ * (or with gaps that were skipped by --quick) that are the same
+ * distance apart in the image. An image without missing or duplicated
+ * blocks is one run per saveset.
+ *
+ * The image is taken to be the same if its size, its modification time
+ * and a CRC of CAT_SAMPLES pieces spread over it are.
+ *
+ * The catalog is made to be mapped and used where it is. Everything in
+ * it is little endian and at a fixed offset:
+ *
+ *	header		CAT_HDR_SIZE bytes
+ *	savesets	CAT_SET_SIZE bytes each
+ *	files		CAT_FILE_SIZE bytes each
+ *	runs		CAT_RUN_SIZE bytes each
+ *	strings		file names and summary records
+ */
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<time.h>
+#if HAVE_MMAP
+#include	<sys/mman.h>
+#endif
+
+#include	"blkcrc.h"
+#include	"saveset.h"
+#include	"catalog.h"
+
+#if MSYS2 || MINGW
+#define CAT_OPEN_FLAGS	(O_RDONLY|O_BINARY)
+#else
+#define CAT_OPEN_FLAGS	(O_RDONLY)
+#endif
+
+#define CAT_MAGIC	"VMSBCAT"	/*!< first 8 bytes of a catalog (with the null) */
+#define CAT_VERSION	(2)		/*!< layout of the catalog */
+#define CAT_SAMPLES	(16)		/*!< pieces of the image that are CRC'd */
+#define CAT_SAMPLE_SIZE	(4096)		/*!< size of each */
+
+/* Header */
+#define CAT_HDR_SIZE	(64)
+#define CAT_H_MAGIC	(0)	/*!< CAT_MAGIC */
+#define CAT_H_VERSION	(8)	/*!< CAT_VERSION */
+#define CAT_H_NSETS	(12)	/*!< number of savesets */
+#define CAT_H_NFILES	(16)	/*!< number of files */
+#define CAT_H_STRSIZE	(20)	/*!< bytes of strings */
+#define CAT_H_SIZE	(24)	/*!< size of image (8 bytes) */
+#define CAT_H_MTIME	(32)	/*!< its modification time (8 bytes) */
+#define CAT_H_HASH	(40)	/*!< CRC of the samples of it */
+#define CAT_H_FORMAT	(44)	/*!< its framing (TIO_FMT_xxx) */
+#define CAT_H_FLAGS	(48)	/*!< CAT_F_xxx */
+#define CAT_H_NRUNS	(52)	/*!< number of runs of blocks */
+
+#define CAT_F_PACKED	(0x01)	/*!< image is compressed, offsets are into what it decompresses to */
+
+/* Saveset */
+#define CAT_SET_SIZE	(4*CAT_LABEL_SIZE + 32)
+#define CAT_S_VOL1	(0)
+#define CAT_S_HDR1	(CAT_LABEL_SIZE)
+#define CAT_S_HDR2	(2*CAT_LABEL_SIZE)
+#define CAT_S_EOF1	(3*CAT_LABEL_SIZE)
+#define CAT_S_SUMMOFF	(4*CAT_LABEL_SIZE)	/*!< offset of summary record in strings */
+#define CAT_S_SUMMLEN	(4*CAT_LABEL_SIZE + 4)	/*!< its size (0 if none) */
+#define CAT_S_FIRST	(4*CAT_LABEL_SIZE + 8)	/*!< index of first file */
+#define CAT_S_NFILES	(4*CAT_LABEL_SIZE + 12)	/*!< number of files */
+#define CAT_S_ERRORS	(4*CAT_LABEL_SIZE + 16)	/*!< errors found */
+#define CAT_S_ENDED	(4*CAT_LABEL_SIZE + 20)	/*!< end of saveset was reached */
+#define CAT_S_FIRSTRUN	(4*CAT_LABEL_SIZE + 24)	/*!< index of first run of blocks */
+#define CAT_S_NRUNS	(4*CAT_LABEL_SIZE + 28)	/*!< number of runs */
+
+/* File */
+#define CAT_FILE_SIZE	(80)
+#define CAT_F_NAMEOFF	(0)	/*!< offset of name in strings */
+#define CAT_F_NAMELEN	(4)	/*!< its length (2 bytes) */
+#define CAT_F_RECFMT	(6)	/*!< 1 byte each ... */
+#define CAT_F_RECATT	(7)
+#define CAT_F_VFCSIZE	(8)
+#define CAT_F_DIR	(9)
+#define CAT_F_RECSIZE	(10)	/*!< 2 bytes each ... */
+#define CAT_F_LNCH	(12)
+#define CAT_F_USR	(14)
+#define CAT_F_GRP	(16)
+#define CAT_F_SIZE	(20)	/*!< 4 bytes each ... */
+#define CAT_F_NBLK	(24)
+#define CAT_F_FRECBLK	(28)
+#define CAT_F_DATABLK	(32)
+#define CAT_F_LASTBLK	(36)
+#define CAT_F_DATAOFF	(40)	/*!< 8 bytes each, all ones if not known ... */
+#define CAT_F_CTIME	(48)
+#define CAT_F_MTIME	(56)
+#define CAT_F_ATIME	(64)
+#define CAT_F_BTIME	(72)
+
+/* Run of blocks */
+#define CAT_RUN_SIZE	(24)
+#define CAT_R_FIRST	(0)	/*!< number of first block */
+#define CAT_R_COUNT	(4)	/*!< number of blocks (including any skipped ones between) */
+#define CAT_R_STRIDE	(8)	/*!< bytes from one to the next (0 if just the one) */
+#define CAT_R_OFF	(16)	/*!< image offset of first block (8 bytes) */
+
+/** A buffer that grows. */
+struct cat_buf
+{
+	unsigned char *mem;	/*!< pointer to bytes */
+	size_t len;		/*!< number in use */
+	size_t size;		/*!< number allocated */
+};
+
+static struct cat_buf cat_sets;		/*!< saveset entries being collected */
+static struct cat_buf cat_files;	/*!< file entries being collected */
+static struct cat_buf cat_strs;		/*!< strings being collected */
+static struct cat_buf cat_runs;		/*!< runs of blocks being collected */
+static int cat_active;		/*!< collecting */
+static char cat_vol1[CAT_LABEL_SIZE];	/*!< VOL1 not yet given to a saveset */
+static char cat_hdr1[CAT_LABEL_SIZE];	/*!< HDR1 not yet given to a saveset */
+static int cat_havedata;	/*!< current file has had its data start noted */
+static unsigned char cat_ident[CAT_HDR_SIZE];	/*!< header, with the image's identity */
+
+static unsigned char *cat_base;	/*!< loaded catalog */
+static size_t cat_size;		/*!< its size */
+static int cat_mapped;		/*!< it's mapped, not malloc'd */
+static unsigned long cat_nset;	/*!< number of savesets in it */
+static unsigned long cat_nfile;	/*!< number of files in it */
+static unsigned long cat_nrun;	/*!< number of runs of blocks in it */
+static const unsigned char *cat_setp;	/*!< its saveset entries */
+static const unsigned char *cat_filep;	/*!< its file entries */
+static const unsigned char *cat_runp;	/*!< its runs of blocks */
+static const unsigned char *cat_strp;	/*!< its strings */
+static unsigned long cat_strsize;	/*!< bytes of strings */
+
+static void cat_putu32( unsigned char *p, unsigned long val )
+{
+	p[0] = val & 0xFF;
+	p[1] = (val >> 8) & 0xFF;
+	p[2] = (val >> 16) & 0xFF;
+	p[3] = (val >> 24) & 0xFF;
+}
+
+/**
+ * Put a 64 bit offset or time.
+ *
+ * @param p Pointer to 8 bytes.
+ * @param val Value (-1 is all ones).
+ *
+ * @return nothing.
+ *
+ * @note
+ * off_t may only be 32 bits so it's shifted 16 at a time.
+ */
+
+static void cat_putoff( unsigned char *p, off_t val )
+{
+	cat_putu32( p, (unsigned long)(val & 0xFFFFFFFF) );
+	cat_putu32( p+4, (unsigned long)(((val >> 16) >> 16) & 0xFFFFFFFF) );
+}
+
+static off_t cat_getoff( const unsigned char *p )
+{
+	unsigned long hi = ss_getu32( p+4 );
+
+	if ( hi == 0xFFFFFFFFUL && ss_getu32( p ) == 0xFFFFFFFFUL )
+		return -1;
+	return (((off_t)hi << 16) << 16) | (off_t)ss_getu32( p );
+}
+
+/**
+ * Make room in a buffer.
+ *
+ * @param buf Pointer to buffer.
+ * @param need Number of bytes to add.
+ *
+ * @return pointer to the room (zeroed).
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static unsigned char *cat_grow( struct cat_buf *buf, size_t need )
+{
+	unsigned char *p;
+
+	if ( buf->len + need > buf->size )
+	{
+		buf->size = buf->size ? buf->size*2 : 64*1024;
+		if ( buf->size < buf->len + need )
+			buf->size = buf->len + need;
+		buf->mem = (unsigned char *)realloc( buf->mem, buf->size );
+		if ( !buf->mem )
+		{
+			printf( "Snark: Failed to malloc %lu bytes for the catalog.\n", (unsigned long)buf->size );
+			exit(1);
+		}
+	}
+	p = buf->mem + buf->len;
+	memset( p, 0, need );
+	buf->len += need;
+	return p;
+}
+
+/**
+ * Work out the identity of an image.
+ *
+ * @param image Pointer to name of image.
+ * @param hdr Pointer to CAT_HDR_SIZE bytes of header to put it in.
+ *
+ * @return 0 on success, -1 if it can't be read.
+ *
+ * @note
+ * Only CAT_SAMPLES pieces of it are read.
+ */
+
+static int cat_identify( const char *image, unsigned char *hdr )
+{
+	unsigned char buf[CAT_SAMPLE_SIZE];
+	struct stat st;
+	unsigned int crc;
+	off_t pos, step;
+	int fd, ii;
+	ssize_t sts;
+
+	fd = open( image, CAT_OPEN_FLAGS );
+	if ( fd < 0 )
+		return -1;
+	if ( fstat( fd, &st ) < 0 || !S_ISREG(st.st_mode) )
+	{
+		close( fd );
+		return -1;
+	}
+	crc = 0xFFFFFFFFU;
+	step = st.st_size > CAT_SAMPLE_SIZE ? (st.st_size - CAT_SAMPLE_SIZE)/(CAT_SAMPLES-1) : 0;
+	for ( ii = 0; ii < CAT_SAMPLES; ++ii )
+	{
+		pos = step*ii;
+		if ( lseek( fd, pos, SEEK_SET ) != pos )
+			break;
+		sts = read( fd, buf, sizeof(buf) );
+		if ( sts <= 0 )
+			break;
+		crc = bc_crc32( crc, buf, sts );
+		if ( !step )
+			break;			/* it all fit in the one */
+	}
+	close( fd );
+	cat_putoff( hdr + CAT_H_SIZE, st.st_size );
+	cat_putoff( hdr + CAT_H_MTIME, (off_t)st.st_mtime );
+	cat_putu32( hdr + CAT_H_HASH, crc ^ 0xFFFFFFFFU );
+	return 0;
+}
+
+/**
+ * Load a catalog.
+ *
+ * @param catname Pointer to name of catalog.
+ * @param image Pointer to name of image it's to be the catalog of.
+ *
+ * @return non-zero if it was loaded, 0 if there's no catalog or it's of
+ * some other image (or of this one before it changed).
+ */
+
+int cat_load( const char *catname, const char *image )
+{
+	unsigned char ident[CAT_HDR_SIZE];
+	struct stat st;
+	unsigned long need;
+	int fd;
+
+	cat_close();
+	fd = open( catname, CAT_OPEN_FLAGS );
+	if ( fd < 0 )
+		return 0;
+	if ( fstat( fd, &st ) < 0 || st.st_size < CAT_HDR_SIZE )
+	{
+		close( fd );
+		return 0;
+	}
+	cat_size = st.st_size;
+#if HAVE_MMAP
+	cat_base = (unsigned char *)mmap( NULL, cat_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( cat_base == (unsigned char *)MAP_FAILED )
+		cat_base = NULL;
+	else
+		cat_mapped = 1;
+#endif
+	if ( !cat_base )
+	{
+		cat_base = (unsigned char *)malloc( cat_size );
+		if ( !cat_base || read( fd, cat_base, cat_size ) != (ssize_t)cat_size )
+		{
+			close( fd );
+			cat_close();
+			return 0;
+		}
+	}
+	close( fd );
+	if ( memcmp( cat_base + CAT_H_MAGIC, CAT_MAGIC, 8 )
+		 || ss_getu32( cat_base + CAT_H_VERSION ) != CAT_VERSION )
+	{
+		printf( "Snark: %s isn't a catalog (or is from another version of vmsbackup).\n", catname );
+		cat_close();
+		return 0;
+	}
+	cat_nset = ss_getu32( cat_base + CAT_H_NSETS );
+	cat_nfile = ss_getu32( cat_base + CAT_H_NFILES );
+	cat_strsize = ss_getu32( cat_base + CAT_H_STRSIZE );
+	cat_nrun = ss_getu32( cat_base + CAT_H_NRUNS );
+	need = CAT_HDR_SIZE + cat_nset*CAT_SET_SIZE + cat_nfile*CAT_FILE_SIZE + cat_nrun*CAT_RUN_SIZE + cat_strsize;
+	if ( need != cat_size )
+	{
+		printf( "Snark: %s is %lu bytes, should be %lu. Ignored.\n", catname, (unsigned long)cat_size, need );
+		cat_close();
+		return 0;
+	}
+	memset( ident, 0, sizeof(ident) );
+	if ( cat_identify( image, ident )
+		 || memcmp( ident + CAT_H_SIZE, cat_base + CAT_H_SIZE, CAT_H_HASH + 4 - CAT_H_SIZE ) )
+	{
+		cat_close();
+		return 0;
+	}
+	cat_setp = cat_base + CAT_HDR_SIZE;
+	cat_filep = cat_setp + cat_nset*CAT_SET_SIZE;
+	cat_runp = cat_filep + cat_nfile*CAT_FILE_SIZE;
+	cat_strp = cat_runp + cat_nrun*CAT_RUN_SIZE;
+	return 1;
+}
+
+/**
+ * Start collecting a catalog.
+ *
+ * @param image Pointer to name of image about to be read.
+ * @param format Its framing (TIO_FMT_xxx).
+ * @param packed It's compressed.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Nothing is collected if the image isn't a regular file.
+ */
+
+void cat_begin( const char *image, int format, int packed )
+{
+	memset( cat_ident, 0, sizeof(cat_ident) );
+	if ( cat_identify( image, cat_ident ) )
+		return;
+	memcpy( cat_ident + CAT_H_MAGIC, CAT_MAGIC, 8 );
+	cat_putu32( cat_ident + CAT_H_VERSION, CAT_VERSION );
+	cat_putu32( cat_ident + CAT_H_FORMAT, format );
+	cat_putu32( cat_ident + CAT_H_FLAGS, packed ? CAT_F_PACKED : 0 );
+	cat_sets.len = cat_files.len = cat_strs.len = cat_runs.len = 0;
+	memset( cat_vol1, 0, sizeof(cat_vol1) );
+	memset( cat_hdr1, 0, sizeof(cat_hdr1) );
+	cat_active = 1;
+}
+
+/**
+ * Get the entry of the saveset being read.
+ *
+ * @return pointer to it (NULL if there isn't one yet).
+ */
+
+static unsigned char *cat_curset( void )
+{
+	if ( !cat_active || !cat_sets.len )
+		return NULL;
+	return cat_sets.mem + cat_sets.len - CAT_SET_SIZE;
+}
+
+/**
+ * Note a tape label.
+ *
+ * @param label Pointer to CAT_LABEL_SIZE bytes of label.
+ *
+ * @return nothing.
+ *
+ * @note
+ * An HDR2 starts a saveset, so it's only to be given the ones of
+ * savesets that are going to be read.
+ */
+
+void cat_label( const char *label )
+{
+	unsigned char *set;
+
+	if ( !cat_active )
+		return;
+	if ( !strncmp( label, "VOL1", 4 ) )
+		memcpy( cat_vol1, label, CAT_LABEL_SIZE );
+	else if ( !strncmp( label, "HDR1", 4 ) )
+		memcpy( cat_hdr1, label, CAT_LABEL_SIZE );
+	else if ( !strncmp( label, "HDR2", 4 ) )
+	{
+		set = cat_grow( &cat_sets, CAT_SET_SIZE );
+		memcpy( set + CAT_S_VOL1, cat_vol1, CAT_LABEL_SIZE );
+		memcpy( set + CAT_S_HDR1, cat_hdr1, CAT_LABEL_SIZE );
+		memcpy( set + CAT_S_HDR2, label, CAT_LABEL_SIZE );
+		cat_putu32( set + CAT_S_FIRST, cat_files.len/CAT_FILE_SIZE );
+		cat_putu32( set + CAT_S_FIRSTRUN, cat_runs.len/CAT_RUN_SIZE );
+		memset( cat_vol1, 0, sizeof(cat_vol1) );
+	}
+	else if ( !strncmp( label, "EOF1", 4 ) && (set = cat_curset()) )
+		memcpy( set + CAT_S_EOF1, label, CAT_LABEL_SIZE );
+}
+
+/**
+ * Note the summary record of the saveset being read.
+ *
+ * @param rcd Pointer to record.
+ * @param rsize Number of bytes in it.
+ *
+ * @return nothing.
+ */
+
+void cat_summary( const unsigned char *rcd, int rsize )
+{
+	unsigned char *set;
+
+	if ( !(set = cat_curset()) || ss_getu32( set + CAT_S_SUMMLEN ) )
+		return;
+	cat_putu32( set + CAT_S_SUMMOFF, cat_strs.len );
+	cat_putu32( set + CAT_S_SUMMLEN, rsize );
+	memcpy( cat_grow( &cat_strs, rsize ), rcd, rsize );
+}
+
+/**
+ * Note a file.
+ *
+ * @param cf Pointer to what's known of it. Where its data starts is
+ * left to cat_data().
+ *
+ * @return nothing.
+ */
+
+void cat_file( const struct cat_file *cf )
+{
+	unsigned char *set, *ent;
+	size_t len;
+
+	if ( !(set = cat_curset()) )
+		return;
+	len = strlen( cf->name );
+	ent = cat_grow( &cat_files, CAT_FILE_SIZE );
+	cat_putu32( ent + CAT_F_NAMEOFF, cat_strs.len );
+	ent[CAT_F_NAMELEN] = len & 0xFF;
+	ent[CAT_F_NAMELEN+1] = (len >> 8) & 0xFF;
+	memcpy( cat_grow( &cat_strs, len ), cf->name, len );
+	ent[CAT_F_RECFMT] = cf->recfmt;
+	ent[CAT_F_RECATT] = cf->recatt;
+	ent[CAT_F_VFCSIZE] = cf->vfcsize;
+	ent[CAT_F_DIR] = cf->directory;
+	ent[CAT_F_RECSIZE] = cf->recsize & 0xFF;
+	ent[CAT_F_RECSIZE+1] = (cf->recsize >> 8) & 0xFF;
+	ent[CAT_F_LNCH] = cf->lnch & 0xFF;
+	ent[CAT_F_LNCH+1] = (cf->lnch >> 8) & 0xFF;
+	ent[CAT_F_USR] = cf->usr & 0xFF;
+	ent[CAT_F_USR+1] = (cf->usr >> 8) & 0xFF;
+	ent[CAT_F_GRP] = cf->grp & 0xFF;
+	ent[CAT_F_GRP+1] = (cf->grp >> 8) & 0xFF;
+	cat_putu32( ent + CAT_F_SIZE, cf->size );
+	cat_putu32( ent + CAT_F_NBLK, cf->nblk );
+	cat_putoff( ent + CAT_F_CTIME, (off_t)cf->ctime );
+	cat_putoff( ent + CAT_F_MTIME, (off_t)cf->mtime );
+	cat_putoff( ent + CAT_F_ATIME, (off_t)cf->atime );
+	cat_putoff( ent + CAT_F_BTIME, (off_t)cf->btime );
+	cat_putu32( ent + CAT_F_FRECBLK, cf->frec_blk );
+	cat_putoff( ent + CAT_F_DATAOFF, -1 );
+	cat_putu32( set + CAT_S_NFILES, ss_getu32( set + CAT_S_NFILES ) + 1 );
+	cat_havedata = 0;
+}
+
+/**
+ * Note a VBN record of the last file given to cat_file().
+ *
+ * @param blknum Number of block it's in.
+ * @param off Image offset of it (-1 if not known).
+ *
+ * @return nothing.
+ *
+ * @note
+ * The first one is where the file's data starts, the last where it ends.
+ */
+
+void cat_data( unsigned long blknum, off_t off )
+{
+	unsigned char *ent;
+
+	if ( !cat_curset() || !cat_files.len )
+		return;
+	ent = cat_files.mem + cat_files.len - CAT_FILE_SIZE;
+	cat_putu32( ent + CAT_F_LASTBLK, blknum );
+	if ( cat_havedata )
+		return;
+	cat_putu32( ent + CAT_F_DATABLK, blknum );
+	cat_putoff( ent + CAT_F_DATAOFF, off );
+	cat_havedata = 1;
+}
+
+/**
+ * Note where a block is in the image.
+ *
+ * @param blknum Its block number.
+ * @param off Image offset of it (-1 if not known).
+ *
+ * @return nothing.
+ *
+ * @note
+ * The blocks are to be given in order. One that isn't (a duplicate
+ * say) is left out.
+ */
+
+void cat_block( unsigned long blknum, off_t off )
+{
+	unsigned char *set, *run;
+	unsigned long first, count, stride;
+	off_t roff;
+
+	if ( !(set = cat_curset()) || off < 0 )
+		return;
+	if ( ss_getu32( set + CAT_S_NRUNS ) )
+	{
+		run = cat_runs.mem + cat_runs.len - CAT_RUN_SIZE;
+		first = ss_getu32( run + CAT_R_FIRST );
+		count = ss_getu32( run + CAT_R_COUNT );
+		stride = ss_getu32( run + CAT_R_STRIDE );
+		roff = cat_getoff( run + CAT_R_OFF );
+		if ( blknum < first + count )
+			return;				/* out of order */
+		if ( count == 1 && blknum == first+1 && off > roff && off - roff <= 0xFFFFFFL )
+			stride = (unsigned long)(off - roff);	/* second block of the run says how far apart they are */
+		if ( stride && off == roff + (off_t)(blknum - first)*(off_t)stride )
+		{
+			cat_putu32( run + CAT_R_COUNT, blknum - first + 1 );
+			cat_putu32( run + CAT_R_STRIDE, stride );
+			return;
+		}
+	}
+	run = cat_grow( &cat_runs, CAT_RUN_SIZE );
+	cat_putu32( run + CAT_R_FIRST, blknum );
+	cat_putu32( run + CAT_R_COUNT, 1 );
+	cat_putoff( run + CAT_R_OFF, off );
+	cat_putu32( set + CAT_S_NRUNS, ss_getu32( set + CAT_S_NRUNS ) + 1 );
+}
+
+/**
+ * Note the end of the saveset being read.
+ *
+ * @param errors Number of errors found in it.
+ *
+ * @return nothing.
+ */
+
+void cat_endset( int errors )
+{
+	unsigned char *set;
+
+	if ( !(set = cat_curset()) )
+		return;
+	cat_putu32( set + CAT_S_ERRORS, errors );
+	cat_putu32( set + CAT_S_ENDED, 1 );
+}
+
+/**
+ * Write what's been collected.
+ *
+ * @param catname Pointer to name of catalog.
+ *
+ * @return 0 on success, -1 if nothing was collected or it couldn't be written.
+ *
+ * @note
+ * It's written to a temporary file which is then renamed so a catalog
+ * that's there stays whole until the new one is.
+ */
+
+int cat_write( const char *catname )
+{
+	char *tmpname;
+	FILE *fp;
+	int ok;
+
+	if ( !cat_active )
+		return -1;
+	cat_active = 0;
+	cat_putu32( cat_ident + CAT_H_NSETS, cat_sets.len/CAT_SET_SIZE );
+	cat_putu32( cat_ident + CAT_H_NFILES, cat_files.len/CAT_FILE_SIZE );
+	cat_putu32( cat_ident + CAT_H_STRSIZE, cat_strs.len );
+	cat_putu32( cat_ident + CAT_H_NRUNS, cat_runs.len/CAT_RUN_SIZE );
+	tmpname = (char *)malloc( strlen( catname ) + 5 );
+	if ( !tmpname )
+	{
+		printf( "Snark: Failed to malloc room for a file name.\n" );
+		exit(1);
+	}
+	strcpy( tmpname, catname );
+	strcat( tmpname, ".tmp" );
+	fp = fopen( tmpname, "wb" );
+	if ( !fp )
+	{
+		printf( "Snark: Failed to create catalog '%s'.\n", tmpname );
+		free( tmpname );
+		return -1;
+	}
+	ok = fwrite( cat_ident, CAT_HDR_SIZE, 1, fp ) == 1
+		 && (!cat_sets.len || fwrite( cat_sets.mem, cat_sets.len, 1, fp ) == 1)
+		 && (!cat_files.len || fwrite( cat_files.mem, cat_files.len, 1, fp ) == 1)
+		 && (!cat_runs.len || fwrite( cat_runs.mem, cat_runs.len, 1, fp ) == 1)
+		 && (!cat_strs.len || fwrite( cat_strs.mem, cat_strs.len, 1, fp ) == 1);
+	if ( fclose( fp ) )
+		ok = 0;
+	if ( ok )
+	{
+		remove( catname );		/* rename() won't replace it on Windows */
+		ok = !rename( tmpname, catname );
+	}
+	if ( !ok )
+	{
+		printf( "Snark: Failed to write catalog '%s'.\n", catname );
+		remove( tmpname );
+	}
+	free( tmpname );
+	return ok ? 0 : -1;
+}
+
+/**
+ * Get the framing of the image of the loaded catalog.
+ *
+ * @return one of TIO_FMT_xxx.
+ */
+
+int cat_format( void )
+{
+	return (int)ss_getu32( cat_base + CAT_H_FORMAT );
+}
+
+/**
+ * See if the image of the loaded catalog is compressed.
+ *
+ * @return non-zero if it is (its offsets can't be seeked to).
+ */
+
+int cat_compressed( void )
+{
+	return (ss_getu32( cat_base + CAT_H_FLAGS ) & CAT_F_PACKED) != 0;
+}
+
+/**
+ * Get the number of savesets in the loaded catalog.
+ *
+ * @return number of them.
+ */
+
+int cat_nsets( void )
+{
+	return (int)cat_nset;
+}
+
+/**
+ * Get a saveset of the loaded catalog.
+ *
+ * @param idx Which one (0 to cat_nsets()-1).
+ * @param cs Pointer to place to deposit it.
+ *
+ * @return nothing.
+ */
+
+void cat_getset( int idx, struct cat_set *cs )
+{
+	const unsigned char *set = cat_setp + (size_t)idx*CAT_SET_SIZE;
+	unsigned long off, len;
+
+	memcpy( cs->vol1, set + CAT_S_VOL1, CAT_LABEL_SIZE );
+	memcpy( cs->hdr1, set + CAT_S_HDR1, CAT_LABEL_SIZE );
+	memcpy( cs->hdr2, set + CAT_S_HDR2, CAT_LABEL_SIZE );
+	memcpy( cs->eof1, set + CAT_S_EOF1, CAT_LABEL_SIZE );
+	off = ss_getu32( set + CAT_S_SUMMOFF );
+	len = ss_getu32( set + CAT_S_SUMMLEN );
+	cs->summary = len && off + len <= cat_strsize ? cat_strp + off : NULL;
+	cs->summlen = cs->summary ? (int)len : 0;
+	cs->first = ss_getu32( set + CAT_S_FIRST );
+	cs->nfiles = ss_getu32( set + CAT_S_NFILES );
+	if ( cs->first > cat_nfile )
+		cs->first = cat_nfile;
+	if ( cs->nfiles > cat_nfile - cs->first )
+		cs->nfiles = cat_nfile - cs->first;
+	cs->errors = (int)ss_getu32( set + CAT_S_ERRORS );
+	cs->ended = (int)ss_getu32( set + CAT_S_ENDED );
+}
+
+/**
+ * Get a file of the loaded catalog.
+ *
+ * @param idx Which one (see cat_getset()).
+ * @param cf Pointer to place to deposit it.
+ *
+ * @return nothing.
+ */
+
+void cat_getfile( unsigned long idx, struct cat_file *cf )
+{
+	const unsigned char *ent = cat_filep + (size_t)idx*CAT_FILE_SIZE;
+	unsigned long off, len;
+
+	off = ss_getu32( ent + CAT_F_NAMEOFF );
+	len = ent[CAT_F_NAMELEN] | (ent[CAT_F_NAMELEN+1] << 8);
+	if ( len > CAT_MAXNAME || off + len > cat_strsize )
+		len = 0;
+	memcpy( cf->name, cat_strp + off, len );
+	cf->name[len] = 0;
+	cf->recfmt = ent[CAT_F_RECFMT];
+	cf->recatt = ent[CAT_F_RECATT];
+	cf->vfcsize = ent[CAT_F_VFCSIZE];
+	cf->directory = ent[CAT_F_DIR];
+	cf->recsize = ent[CAT_F_RECSIZE] | (ent[CAT_F_RECSIZE+1] << 8);
+	cf->lnch = ent[CAT_F_LNCH] | (ent[CAT_F_LNCH+1] << 8);
+	cf->usr = ent[CAT_F_USR] | (ent[CAT_F_USR+1] << 8);
+	cf->grp = ent[CAT_F_GRP] | (ent[CAT_F_GRP+1] << 8);
+	cf->size = ss_getu32( ent + CAT_F_SIZE );
+	cf->nblk = (int)ss_getu32( ent + CAT_F_NBLK );
+	cf->ctime = (time_t)cat_getoff( ent + CAT_F_CTIME );
+	cf->mtime = (time_t)cat_getoff( ent + CAT_F_MTIME );
+	cf->atime = (time_t)cat_getoff( ent + CAT_F_ATIME );
+	cf->btime = (time_t)cat_getoff( ent + CAT_F_BTIME );
+	cf->frec_blk = ss_getu32( ent + CAT_F_FRECBLK );
+	cf->data_blk = ss_getu32( ent + CAT_F_DATABLK );
+	cf->last_blk = ss_getu32( ent + CAT_F_LASTBLK );
+	cf->data_off = cat_getoff( ent + CAT_F_DATAOFF );
+}
+
+/**
+ * Find a block of the loaded catalog in the image.
+ *
+ * @param idx Which saveset (0 to cat_nsets()-1).
+ * @param blknum Its block number.
+ *
+ * @return image offset of it (-1 if it's not known).
+ */
+
+off_t cat_blkoff( int idx, unsigned long blknum )
+{
+	const unsigned char *set = cat_setp + (size_t)idx*CAT_SET_SIZE;
+	const unsigned char *run;
+	unsigned long lo, hi, mid, first;
+
+	lo = ss_getu32( set + CAT_S_FIRSTRUN );
+	hi = lo + ss_getu32( set + CAT_S_NRUNS );
+	if ( hi > cat_nrun || lo > hi )
+		return -1;
+	while ( lo < hi )
+	{
+		mid = lo + (hi - lo)/2;
+		run = cat_runp + (size_t)mid*CAT_RUN_SIZE;
+		first = ss_getu32( run + CAT_R_FIRST );
+		if ( blknum < first )
+			hi = mid;
+		else if ( blknum >= first + ss_getu32( run + CAT_R_COUNT ) )
+			lo = mid + 1;
+		else
+			return cat_getoff( run + CAT_R_OFF ) + (off_t)(blknum - first)*(off_t)ss_getu32( run + CAT_R_STRIDE );
+	}
+	return -1;
+}
+
+/**
+ * Let go of the loaded catalog.
+ *
+ * @return nothing.
+ */
+
+void cat_close( void )
+{
+	if ( cat_base )
+	{
+#if HAVE_MMAP
+		if ( cat_mapped )
+			munmap( cat_base, cat_size );
+		else
+#endif
+			free( cat_base );
+	}
+	cat_base = NULL;
+	cat_mapped = 0;
+	cat_nset = cat_nfile = cat_nrun = 0;
+}
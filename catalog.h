@@ -0,0 +1,71 @@
+/**
+ * @file catalog.h
+ *
+ * Catalog of the savesets and files in an image (--catalog).
+ *
+ * Needs <sys/types.h> and <time.h>.
+ */
+
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#define CAT_LABEL_SIZE	(80)	/*!< size of a tape label */
+#define CAT_MAXNAME	(255)	/*!< longest file name kept */
+
+/** A saveset as the catalog has it. */
+struct cat_set
+{
+	char vol1[CAT_LABEL_SIZE];	/*!< VOL1 label read ahead of its HDR1 (all 0 if none) */
+	char hdr1[CAT_LABEL_SIZE];	/*!< its HDR1 label */
+	char hdr2[CAT_LABEL_SIZE];	/*!< its HDR2 label */
+	char eof1[CAT_LABEL_SIZE];	/*!< its EOF1 label (all 0 if none) */
+	const unsigned char *summary;	/*!< its summary record (NULL if none) */
+	int summlen;			/*!< number of bytes in it */
+	unsigned long first;		/*!< index of its first file */
+	unsigned long nfiles;		/*!< number of files in it */
+	int errors;			/*!< errors found reading it */
+	int ended;			/*!< end of saveset was reached */
+};
+
+/** A file as the catalog has it (what process_file() decodes). */
+struct cat_file
+{
+	char name[CAT_MAXNAME+1];	/*!< file name */
+	unsigned long size;		/*!< size in bytes */
+	int nblk;			/*!< size in 512 byte blocks */
+	int lnch;			/*!< bytes used in the last of them */
+	int recfmt;			/*!< record format */
+	int recatt;			/*!< record attributes */
+	int recsize;			/*!< record size */
+	int vfcsize;			/*!< number of VFC bytes */
+	int directory;			/*!< it's a directory */
+	int usr;			/*!< member number of owner */
+	int grp;			/*!< group number of owner */
+	time_t ctime;			/*!< created */
+	time_t mtime;			/*!< modified */
+	time_t atime;			/*!< accessed */
+	time_t btime;			/*!< backed up */
+	unsigned long frec_blk;		/*!< block holding its file record */
+	unsigned long data_blk;		/*!< block its data starts in (0 if it has none) */
+	unsigned long last_blk;		/*!< block its data ends in (0 if it has none) */
+	off_t data_off;			/*!< image offset of its first VBN record (-1 if not known) */
+};
+
+extern int cat_load( const char *catname, const char *image );
+extern void cat_begin( const char *image, int format, int packed );
+extern void cat_label( const char *label );
+extern void cat_summary( const unsigned char *rcd, int rsize );
+extern void cat_file( const struct cat_file *cf );
+extern void cat_data( unsigned long blknum, off_t off );
+extern void cat_block( unsigned long blknum, off_t off );
+extern void cat_endset( int errors );
+extern int cat_write( const char *catname );
+extern int cat_format( void );
+extern int cat_compressed( void );
+extern int cat_nsets( void );
+extern void cat_getset( int idx, struct cat_set *cs );
+extern void cat_getfile( unsigned long idx, struct cat_file *cf );
+extern off_t cat_blkoff( int idx, unsigned long blknum );
+extern void cat_close( void );
+
+#endif	/* _CATALOG_H_ */
@@ -0,0 +1,832 @@
+/**
+ * @file check.c
+ */
+
+/**
+ * Integrity check of a tape or image (--check).
+ *
+ * Nothing is decoded and nothing is written. The records are read in
+ * order by the main thread, which follows the labels, works out which
+ * records are blocks of which saveset and checks their headers: header
+ * size, blocksize and block number. The block numbers are kept track
+ * of so gaps, duplicates and blocks out of order can be reported. The
+ * header checks, which of two copies of a block counts and when a block
+ * number too far ahead is believed are decided by saveset.h, the same
+ * as when extracting.
+ *
+ * The rest, the CRC of each block (with --crc) and a walk over its
+ * record headers, is what takes the time. Blocks are handed out in
+ * batches to a pool of worker threads, one per CPU unless told
+ * otherwise. While the workers are on one batch the main thread fills
+ * the next, so the reading and the checking overlap. A block of a
+ * mapped image is looked at where it is, anything else is copied into
+ * the batch. The results are folded back in block order once a batch
+ * is done so the report comes out the same however many threads there
+ * are.
+ *
+ * At the end of each saveset a report is shown with the ranges of any
+ * blocks that are missing or bad and how many of them could be rebuilt
+ * from their redundancy groups.
+ */
+
+#define _GNU_SOURCE		/* for clock_gettime() */
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+#include	<unistd.h>
+#include	<sys/types.h>
+#include	<time.h>
+#if HAVE_PTHREAD
+#include	<pthread.h>
+#endif
+
+#include	"tapeio.h"
+#include	"blkcrc.h"
+#include	"check.h"
+#include	"saveset.h"
+
+#define CK_MAX_RTYPE	(7)	/*!< highest valid record type (brh_dol_k_fid) */
+#define CK_SUMMARY	(1)	/*!< record type of the summary record */
+#define CK_GROUPSIZE	(14)	/*!< summary item holding /GROUP_SIZE */
+#define CK_BUFFCOUNT	(15)	/*!< summary item holding /BUFFER_COUNT */
+#define CK_SUMM_END	(0)	/*!< summary item ending the list */
+
+#define CK_BATCH	(256)	/*!< blocks handed to the workers at a time */
+#define CK_MAXTHREADS	(64)	/*!< most worker threads */
+#define CK_MAXRANGES	(20)	/*!< most ranges shown on a line */
+
+/* What's known of each block of a saveset (ck_flags[]) */
+#define CK_SEEN		(0x01)	/*!< block has been read */
+#define CK_CRCBAD	(0x02)	/*!< it failed its CRC check */
+#define CK_RECBAD	(0x04)	/*!< its record headers don't add up */
+#define CK_HDRBAD	(0x08)	/*!< a block with a bad header was in its place */
+#define CK_DUP		(0x10)	/*!< it was read more than once */
+#define CK_XOR		(0x20)	/*!< it's an XOR block */
+
+/* Where ck_run() is in the layout of a tape */
+#define CK_ST_HEAD	(0)	/*!< reading HDR labels */
+#define CK_ST_BLOCKS	(1)	/*!< reading the blocks of a saveset */
+#define CK_ST_TAIL	(2)	/*!< reading EOF labels */
+
+/** A block to be checked by a worker. */
+struct ck_job
+{
+	const unsigned char *data;	/*!< pointer to block */
+	unsigned long blknum;		/*!< its block number */
+	int crc;			/*!< what bc_verify() made of it */
+	int recbad;			/*!< its record headers don't add up */
+	int dup;			/*!< a block with this number was read before */
+};
+
+/** A batch of blocks. */
+struct ck_batch
+{
+	struct ck_job jobs[CK_BATCH];	/*!< the blocks */
+	unsigned char *room;		/*!< CK_BATCH blocks worth of room for copies */
+	size_t roomsize;		/*!< size of room */
+	int njobs;			/*!< number of jobs filled in */
+	int next;			/*!< next job for a worker to take */
+	int done;			/*!< number of jobs finished */
+};
+
+static struct ck_batch ck_batches[2];	/*!< one being checked, one being filled */
+static int ck_crc;		/*!< check CRCs (--crc) */
+static int ck_bsize;		/*!< blocksize of current saveset */
+static int ck_winopt;		/*!< --window (0=work it out from the summary record) */
+
+#if HAVE_PTHREAD
+static struct ck_batch *ck_posted;	/*!< batch the workers are on (NULL if none) */
+static pthread_t ck_threads[CK_MAXTHREADS];	/*!< the workers */
+static int ck_nthreads;		/*!< number of workers running */
+static int ck_quit;		/*!< workers are to exit */
+static pthread_mutex_t ck_lock = PTHREAD_MUTEX_INITIALIZER;	/*!< guards the posted batch */
+static pthread_cond_t ck_work = PTHREAD_COND_INITIALIZER;	/*!< a batch has been posted */
+static pthread_cond_t ck_idle = PTHREAD_COND_INITIALIZER;	/*!< a batch is done */
+#endif
+
+/* Current saveset */
+static char ck_name[18];	/*!< its name from HDR1 */
+static unsigned char *ck_flags;	/*!< CK_xxx bits of each block by block number */
+static unsigned long ck_room;	/*!< number of entries in ck_flags */
+static unsigned long ck_max;	/*!< highest block number seen */
+static unsigned long ck_last;	/*!< block number of the last block */
+static unsigned long ck_blocks;	/*!< number of blocksize records */
+static int ck_group;		/*!< /GROUP_SIZE from the summary record */
+static int ck_buffcnt;		/*!< /BUFFER_COUNT from the summary record */
+static int ck_window;		/*!< blocks extracting would read ahead (see ss_faraway()) */
+static unsigned long ck_pend;	/*!< number of block held for being too far ahead (0=none) */
+static unsigned char *ck_pendblk;	/*!< pointer to it */
+static int ck_pendpinned;	/*!< it's in place in the image, not copied to ck_pendroom */
+static unsigned char *ck_pendroom;	/*!< a block's worth of room to copy it to */
+static int ck_dups;		/*!< blocks read more than once */
+static int ck_order;		/*!< blocks out of order */
+static int ck_wrongsize;	/*!< records that aren't labels or blocks */
+static int ck_hdrbad;		/*!< blocks with bad headers */
+static int ck_framing;		/*!< framing errors */
+static int ck_labels;		/*!< label problems */
+static int ck_nocrcs;		/*!< blocks without a CRC */
+static long ck_eofcount;	/*!< block count from EOF1 (-1 if none) */
+static int ck_haveeof;		/*!< EOF1 has been seen */
+
+/**
+ * Walk the record headers of a block.
+ *
+ * @param blk Pointer to block.
+ * @param bsize Size of block.
+ *
+ * @return non-zero if a record runs off the end or has a bad type.
+ *
+ * @note
+ * Same checks as process_block() does.
+ */
+
+static int ck_records( const unsigned char *blk, int bsize )
+{
+	unsigned int rsize, rtype;
+	int ii;
+
+	for ( ii = SS_BBH_SIZE; ii + SS_BRH_SIZE <= bsize; ii += rsize )
+	{
+		rsize = ss_getu16( blk + ii );
+		rtype = ss_getu16( blk + ii + 2 );
+		ii += SS_BRH_SIZE;
+		if ( rtype > CK_MAX_RTYPE || ii + (int)rsize > bsize )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Check a block.
+ *
+ * @param job Pointer to job.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Runs on a worker thread so it must not change anything but @e job.
+ */
+
+static void ck_job( struct ck_job *job )
+{
+	job->crc = !ck_crc ? BC_NONE : bc_verify( job->data, ck_bsize, SS_BBH_CRC );
+	job->recbad = 0;
+	if ( job->crc != BC_BAD && ss_getu16( job->data + SS_BBH_APPLIC ) <= 1
+		 && ss_getu32( job->data + SS_BBH_BLKSIZE ) )
+		job->recbad = ck_records( job->data, ck_bsize );
+}
+
+#if HAVE_PTHREAD
+/**
+ * Worker thread.
+ *
+ * @param arg Not used.
+ *
+ * @return NULL.
+ */
+
+static void *ck_worker( void *arg )
+{
+	struct ck_batch *bp;
+	int jj;
+
+	pthread_mutex_lock( &ck_lock );
+	while ( 1 )
+	{
+		while ( !ck_quit && (!ck_posted || ck_posted->next >= ck_posted->njobs) )
+			pthread_cond_wait( &ck_work, &ck_lock );
+		if ( ck_quit )
+			break;
+		bp = ck_posted;
+		jj = bp->next++;
+		pthread_mutex_unlock( &ck_lock );
+		ck_job( bp->jobs + jj );
+		pthread_mutex_lock( &ck_lock );
+		if ( ++bp->done == bp->njobs )
+			pthread_cond_signal( &ck_idle );
+	}
+	pthread_mutex_unlock( &ck_lock );
+	return NULL;
+}
+#endif
+
+/**
+ * Note the results of a batch.
+ *
+ * @param bp Pointer to batch.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Batches are folded in the order their blocks were read, so which of
+ * two copies of a block counts is settled by ss_keepnew() the same way
+ * extracting does.
+ */
+
+static void ck_fold( struct ck_batch *bp )
+{
+	struct ck_job *job;
+	int jj;
+
+	for ( jj=0, job=bp->jobs; jj < bp->njobs; ++jj, ++job )
+	{
+		if ( job->dup )
+		{
+			if ( !ss_keepnew( (ck_flags[job->blknum] & CK_CRCBAD) != 0, job->crc == BC_BAD ) )
+				continue;	/* the earlier one is kept */
+			ck_flags[job->blknum] &= ~(CK_CRCBAD|CK_RECBAD);	/* the later one replaces it */
+		}
+		if ( job->crc == BC_BAD )
+			ck_flags[job->blknum] |= CK_CRCBAD;
+		else if ( job->crc == BC_NONE && ck_crc && !job->dup )
+			++ck_nocrcs;
+		if ( job->recbad )
+			ck_flags[job->blknum] |= CK_RECBAD;
+	}
+	bp->njobs = bp->next = bp->done = 0;
+}
+
+/**
+ * Hand a batch to the workers.
+ *
+ * @param bp Pointer to batch (one with no jobs to just wait for the last one).
+ *
+ * @return Pointer to batch to fill next.
+ *
+ * @note
+ * Waits for the batch the workers were on to be done and folds it in.
+ * Without workers the batch is checked there and then.
+ */
+
+static struct ck_batch *ck_post( struct ck_batch *bp )
+{
+	int jj;
+
+#if HAVE_PTHREAD
+	if ( ck_nthreads )
+	{
+		struct ck_batch *old;
+
+		pthread_mutex_lock( &ck_lock );
+		while ( ck_posted && ck_posted->done < ck_posted->njobs )
+			pthread_cond_wait( &ck_idle, &ck_lock );
+		old = ck_posted;
+		ck_posted = bp->njobs ? bp : NULL;
+		if ( ck_posted )
+			pthread_cond_broadcast( &ck_work );
+		pthread_mutex_unlock( &ck_lock );
+		if ( old )
+			ck_fold( old );
+		return bp == ck_batches ? ck_batches+1 : ck_batches;
+	}
+#endif
+	for ( jj=0; jj < bp->njobs; ++jj )
+		ck_job( bp->jobs + jj );
+	ck_fold( bp );
+	return bp;
+}
+
+/**
+ * Queue a block to be checked.
+ *
+ * @param bp Pointer to batch being filled.
+ * @param blk Pointer to block.
+ * @param blknum Its block number.
+ * @param dup Non-zero if a block with the same number was queued before.
+ * @param pinned Non-zero if @e blk stays put until tio_close() (see tio_pinned()).
+ *
+ * @return Pointer to batch to fill next.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static struct ck_batch *ck_queue( struct ck_batch *bp, unsigned char *blk, unsigned long blknum, int dup, int pinned )
+{
+	struct ck_job *job;
+	size_t need;
+
+	job = bp->jobs + bp->njobs;
+	if ( pinned )
+		job->data = blk;
+	else
+	{
+		need = (size_t)CK_BATCH*ck_bsize;
+		if ( bp->roomsize < need )
+		{
+			free( bp->room );
+			bp->room = (unsigned char *)malloc( need );
+			if ( !bp->room )
+			{
+				printf( "Snark: Failed to malloc %lu bytes for blocks to check.\n", (unsigned long)need );
+				exit(1);
+			}
+			bp->roomsize = need;
+		}
+		memcpy( bp->room + (size_t)bp->njobs*ck_bsize, blk, ck_bsize );
+		job->data = bp->room + (size_t)bp->njobs*ck_bsize;
+	}
+	job->blknum = blknum;
+	job->dup = dup;
+	if ( ++bp->njobs < CK_BATCH )
+		return bp;
+	return ck_post( bp );
+}
+
+/**
+ * Make room for a block number in ck_flags.
+ *
+ * @param blknum Block number.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static void ck_grow( unsigned long blknum )
+{
+	unsigned long room;
+
+	if ( blknum < ck_room )
+		return;
+	room = ck_room ? ck_room : 1024;
+	while ( room <= blknum )
+		room *= 2;
+	ck_flags = (unsigned char *)realloc( ck_flags, room );
+	if ( !ck_flags )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for block flags.\n", room );
+		exit(1);
+	}
+	memset( ck_flags + ck_room, 0, room - ck_room );
+	ck_room = room;
+}
+
+/**
+ * Get /GROUP_SIZE and /BUFFER_COUNT out of a block's summary record.
+ *
+ * @param blk Pointer to block.
+ *
+ * @return nothing.
+ */
+
+static void ck_summary( const unsigned char *blk )
+{
+	unsigned int rsize, dsize, dtype;
+	int cc;
+
+	if ( ss_getu16( blk + SS_BBH_SIZE + 2 ) != CK_SUMMARY )
+		return;
+	rsize = ss_getu16( blk + SS_BBH_SIZE );
+	if ( SS_BBH_SIZE + SS_BRH_SIZE + rsize > (unsigned int)ck_bsize )
+		return;
+	blk += SS_BBH_SIZE + SS_BRH_SIZE;
+	for ( cc = 2; cc <= (int)rsize-4; cc += dsize+4 )
+	{
+		dsize = ss_getu16( blk + cc );
+		dtype = ss_getu16( blk + cc + 2 );
+		if ( dtype == CK_SUMM_END )
+			break;
+		if ( dtype == CK_GROUPSIZE && dsize == 2 )
+			ck_group = ss_getu16( blk + cc + 4 );
+		else if ( dtype == CK_BUFFCOUNT && dsize == 2 )
+			ck_buffcnt = ss_getu16( blk + cc + 4 );
+	}
+	if ( !ck_winopt )
+		ck_window = ss_window( ck_buffcnt, ck_group );
+}
+
+/**
+ * Note a block with a bad header.
+ *
+ * @return nothing.
+ */
+
+static void ck_badhdr( void )
+{
+	++ck_hdrbad;
+	ck_grow( ck_last+1 );
+	ck_flags[ck_last+1] |= CK_HDRBAD;	/* it was probably the next one */
+}
+
+/**
+ * Take a block as the number it has and queue it to be checked.
+ *
+ * @param bp Pointer to batch being filled.
+ * @param blk Pointer to block.
+ * @param numb Its block number.
+ * @param pinned Non-zero if @e blk stays put until tio_close().
+ *
+ * @return Pointer to batch to fill next.
+ */
+
+static struct ck_batch *ck_take( struct ck_batch *bp, unsigned char *blk, unsigned long numb, int pinned )
+{
+	ck_grow( numb );
+	if ( numb > ck_max )
+		ck_max = numb;
+	if ( (ck_flags[numb] & CK_SEEN) )
+	{
+		++ck_dups;
+		ck_flags[numb] |= CK_DUP;
+		ck_last = numb;
+		return ck_queue( bp, blk, numb, 1, pinned );	/* it's checked and ss_keepnew() decides which counts */
+	}
+	if ( numb <= ck_last )
+		++ck_order;			/* a gap shows up as missing blocks instead */
+	ck_last = numb;
+	ck_flags[numb] |= CK_SEEN;
+	if ( ss_getu16( blk + SS_BBH_APPLIC ) > 1 )
+		ck_flags[numb] |= CK_XOR;
+	else if ( numb == 1 )
+		ck_summary( blk );
+	return ck_queue( bp, blk, numb, 0, pinned );
+}
+
+/**
+ * Look over a block's header and queue it to be checked.
+ *
+ * @param bp Pointer to batch being filled.
+ * @param blk Pointer to block.
+ *
+ * @return Pointer to batch to fill next.
+ *
+ * @note
+ * A block numbered too far past the others (see ss_faraway()) is held
+ * until the next one is read. It's only taken if that one follows on
+ * from it, else it counts as a bad header, which is what extracting
+ * makes of it.
+ */
+
+static struct ck_batch *ck_block( struct ck_batch *bp, unsigned char *blk )
+{
+	unsigned long numb;
+
+	++ck_blocks;
+	if ( ss_blkcheck( blk, ck_bsize, &numb ) != SS_BLK_OK )
+	{
+		ck_badhdr();
+		return bp;
+	}
+	if ( ck_pend )
+	{
+		if ( numb == ck_pend+1 )
+		{
+			bp = ck_take( bp, ck_pendblk, ck_pend, ck_pendpinned );	/* the tape really skipped */
+			ck_pend = 0;
+			return ck_take( bp, blk, numb, tio_pinned() );
+		}
+		ck_pend = 0;
+		ck_badhdr();			/* its block number was bad */
+	}
+	if ( ss_faraway( numb, ck_max, ck_window ) )
+	{
+		ck_pend = numb;
+		ck_pendpinned = tio_pinned();
+		ck_pendblk = blk;
+		if ( !ck_pendpinned )
+		{
+			memcpy( ck_pendroom, blk, ck_bsize );
+			ck_pendblk = ck_pendroom;
+		}
+		return bp;
+	}
+	return ck_take( bp, blk, numb, tio_pinned() );
+}
+
+/**
+ * Show the ranges of blocks that have something in common.
+ *
+ * @param what Pointer to null terminated description.
+ * @param mask CK_xxx bits to look for.
+ * @param want What they have to be.
+ *
+ * @return number of blocks.
+ */
+
+static unsigned long ck_ranges( const char *what, int mask, int want )
+{
+	unsigned long bn, first, count;
+	int shown;
+
+	count = 0;
+	shown = 0;
+	for ( bn = 1; bn <= ck_max; ++bn )
+	{
+		if ( (ck_flags[bn] & mask) != want )
+			continue;
+		first = bn;
+		while ( bn < ck_max && (ck_flags[bn+1] & mask) == want )
+			++bn;
+		count += bn - first + 1;
+		if ( !shown )
+			printf( "    %s:", what );
+		if ( shown < CK_MAXRANGES )
+		{
+			if ( first == bn )
+				printf( "%s %lu", shown ? "," : "", first );
+			else
+				printf( "%s %lu-%lu", shown ? "," : "", first, bn );
+		}
+		else if ( shown == CK_MAXRANGES )
+			printf( ", ..." );
+		++shown;
+	}
+	if ( shown )
+		printf( " (%lu block%s)\n", count, count != 1 ? "s" : "" );
+	return count;
+}
+
+/**
+ * Count the missing or bad blocks that could be rebuilt.
+ *
+ * @return number of them.
+ *
+ * @note
+ * With /GROUP_SIZE=n each n blocks are followed by an XOR block. Any
+ * one block of such a group can be rebuilt from the others.
+ */
+
+static unsigned long ck_rebuildable( void )
+{
+	unsigned long bn, first, last, lost, ans;
+
+	ans = 0;
+	if ( !ck_group )
+		return 0;
+	for ( first = 1; first <= ck_max; first += ck_group+1 )
+	{
+		last = first + ck_group;
+		if ( last > ck_max )
+			break;			/* last group is incomplete, or its XOR block is missing */
+		lost = 0;
+		for ( bn = first; bn <= last; ++bn )
+			if ( !(ck_flags[bn] & CK_SEEN) || (ck_flags[bn] & CK_CRCBAD) )
+				++lost;
+		if ( lost == 1 )
+			++ans;
+	}
+	return ans;
+}
+
+/**
+ * Report on a saveset and get ready for the next one.
+ *
+ * @return number of problems found.
+ */
+
+static int ck_report( void )
+{
+	unsigned long bad;
+	int problems;
+
+	bad = 0;
+	if ( ck_pend )
+	{
+		ck_pend = 0;
+		ck_badhdr();			/* nothing followed on from it */
+	}
+	if ( ck_max )
+		ck_grow( ck_max );
+	printf( "Saveset '%s': %lu blocks of %d bytes", ck_name, ck_blocks, ck_bsize );
+	if ( ck_max )
+		printf( ", numbered 1 to %lu", ck_max );
+	problems = ck_hdrbad + ck_wrongsize + ck_framing + ck_labels;
+	if ( ck_eofcount >= 0 && (unsigned long)ck_eofcount != ck_blocks )
+		++problems;
+	if ( ck_max )
+	{
+		unsigned long bn;
+		for ( bn = 1; bn <= ck_max; ++bn )
+			if ( !(ck_flags[bn] & (CK_SEEN|CK_HDRBAD)) || (ck_flags[bn] & (CK_CRCBAD|CK_RECBAD)) )
+				++bad;
+	}
+	else if ( !ck_hdrbad )
+		++problems;			/* not one good block */
+	problems += bad;
+	if ( !problems )
+		printf( ". OK.\n" );
+	else
+	{
+		printf( ". %d problem%s:\n", problems, problems != 1 ? "s" : "" );
+		if ( !ck_max && !ck_hdrbad )
+			printf( "    no blocks\n" );
+		ck_ranges( "missing", CK_SEEN|CK_HDRBAD, 0 );
+		ck_ranges( "bad header in place of", CK_SEEN|CK_HDRBAD, CK_HDRBAD );
+		ck_ranges( "failed CRC", CK_CRCBAD, CK_CRCBAD );
+		ck_ranges( "bad records", CK_CRCBAD|CK_RECBAD, CK_RECBAD );
+		if ( ck_wrongsize )
+			printf( "    %d record%s not the size of a block\n", ck_wrongsize, ck_wrongsize != 1 ? "s" : "" );
+		if ( ck_framing )
+			printf( "    %d framing error%s\n", ck_framing, ck_framing != 1 ? "s" : "" );
+		if ( ck_labels )
+			printf( "    %d label problem%s\n", ck_labels, ck_labels != 1 ? "s" : "" );
+		if ( ck_eofcount >= 0 && (unsigned long)ck_eofcount != ck_blocks )
+			printf( "    EOF1 says there are %ld blocks\n", ck_eofcount );
+		if ( bad )
+		{
+			unsigned long fix = ck_rebuildable();
+			if ( fix )
+				printf( "    %lu of the missing or failed blocks can be rebuilt from their redundancy groups (/GROUP_SIZE=%d).\n",
+						fix, ck_group );
+			else if ( !ck_group )
+				printf( "    saveset has no redundancy groups to rebuild blocks from.\n" );
+		}
+	}
+	ck_ranges( "duplicated", CK_DUP, CK_DUP );
+	if ( ck_order )
+		printf( "    %d block%s out of order\n", ck_order, ck_order != 1 ? "s" : "" );
+	if ( ck_nocrcs )
+		printf( "    %d block%s had no CRC\n", ck_nocrcs, ck_nocrcs != 1 ? "s" : "" );
+	if ( ck_flags )
+		memset( ck_flags, 0, ck_room );
+	ck_max = ck_last = ck_blocks = 0;
+	ck_group = ck_buffcnt = ck_dups = ck_order = ck_wrongsize = ck_hdrbad = ck_framing = ck_labels = ck_nocrcs = 0;
+	ck_window = ck_winopt ? ck_winopt : MAX_BUFFCOUNT;	/* until the summary record says otherwise */
+	ck_eofcount = -1;
+	ck_haveeof = 0;
+	return problems;
+}
+
+/**
+ * Start the workers.
+ *
+ * @param threads Number wanted (0 for one per CPU).
+ *
+ * @return number actually running.
+ */
+
+static int ck_start( int threads )
+{
+	if ( threads <= 0 )
+	{
+#if defined(_SC_NPROCESSORS_ONLN)
+		threads = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+		if ( threads <= 0 )
+			threads = 1;
+	}
+	if ( threads > CK_MAXTHREADS )
+		threads = CK_MAXTHREADS;
+#if HAVE_PTHREAD
+	ck_quit = 0;
+	for ( ck_nthreads=0; threads > 1 && ck_nthreads < threads; ++ck_nthreads )
+		if ( pthread_create( ck_threads + ck_nthreads, NULL, ck_worker, NULL ) )
+			break;
+	return ck_nthreads ? ck_nthreads : 1;
+#else
+	return 1;
+#endif
+}
+
+/**
+ * Stop the workers.
+ *
+ * @return nothing.
+ */
+
+static void ck_stop( void )
+{
+#if HAVE_PTHREAD
+	pthread_mutex_lock( &ck_lock );
+	ck_quit = 1;
+	pthread_cond_broadcast( &ck_work );
+	pthread_mutex_unlock( &ck_lock );
+	while ( ck_nthreads )
+		pthread_join( ck_threads[--ck_nthreads], NULL );
+#endif
+}
+
+/**
+ * Check the whole tape.
+ *
+ * @param format How the input is framed (one of TIO_FMT_xxx).
+ * @param threads Number of threads to check blocks with (0 for one per CPU).
+ * @param crc Check block CRCs.
+ * @param window Blocks read ahead when extracting (--window, 0 to work
+ * it out from each saveset's summary record).
+ *
+ * @return number of problems found.
+ *
+ * @note
+ * The input has to have been opened with tio_open().
+ * Program will print an error message and exit if malloc fails.
+ */
+
+int ck_run( int format, int threads, int crc, int window )
+{
+	struct ck_batch *bp;
+	unsigned char *rcd;
+	double t0, bytes, secs;
+	int len, state, marks, problems, nsets;
+
+	ck_crc = crc;
+	ck_winopt = window;
+	ck_window = window ? window : MAX_BUFFCOUNT;
+	bc_init();				/* before there's more than one thread */
+	threads = ck_start( threads );
+	bp = ck_batches;
+	state = CK_ST_HEAD;
+	marks = problems = nsets = 0;
+	ck_eofcount = -1;
+	ck_bsize = 0;
+	ck_name[0] = 0;
+	bytes = 0.0;
+	t0 = ss_now();
+	while ( (marks&3) != 3 )
+	{
+		marks <<= 1;
+		len = tio_record( &rcd );
+		if ( len < 0 )
+		{
+			++ck_framing;
+			if ( format != TIO_FMT_RAW )
+				continue;		/* tio_record() carries on past it */
+			len = 0;			/* a tape read error counts as a tape mark */
+		}
+		bytes += len;
+		if ( !len )
+		{
+			marks |= 1;
+			if ( state == CK_ST_HEAD && ck_bsize )
+				state = CK_ST_BLOCKS;
+			else if ( state == CK_ST_BLOCKS )
+				state = CK_ST_TAIL;
+			else if ( state == CK_ST_TAIL )
+			{
+				if ( !ck_haveeof )
+					++ck_labels;	/* no EOF1, the image was probably cut short */
+				bp = ck_post( ck_post( bp ) );
+				problems += ck_report();
+				++nsets;
+				ck_bsize = 0;
+				state = CK_ST_HEAD;
+			}
+			continue;
+		}
+		if ( state == CK_ST_BLOCKS )
+		{
+			if ( len == ck_bsize )
+				bp = ck_block( bp, rcd );
+			else
+				++ck_wrongsize;
+			continue;
+		}
+		if ( len != SS_LABEL_SIZE )
+		{
+			++ck_labels;
+			continue;
+		}
+		if ( state == CK_ST_HEAD && !strncmp( (char *)rcd, "HDR1", 4 ) )
+		{
+			memcpy( ck_name, rcd+4, 17 );
+			ck_name[17] = 0;
+			for ( len = 16; len >= 0 && ck_name[len] == ' '; --len )
+				ck_name[len] = 0;
+		}
+		else if ( state == CK_ST_HEAD && !strncmp( (char *)rcd, "HDR2", 4 ) )
+		{
+			if ( sscanf( (char *)rcd + 5, "%5d", &ck_bsize ) != 1 || ck_bsize < SS_BBH_SIZE + SS_BRH_SIZE )
+			{
+				++ck_labels;
+				ck_bsize = 0;
+			}
+			else if ( !(ck_pendroom = (unsigned char *)realloc( ck_pendroom, ck_bsize )) )
+			{
+				printf( "Snark: Failed to malloc %d bytes for a block.\n", ck_bsize );
+				exit(1);
+			}
+		}
+		else if ( state == CK_ST_TAIL && !strncmp( (char *)rcd, "EOF1", 4 ) )
+		{
+			char count[7];
+			ck_haveeof = 1;
+			memcpy( count, rcd+54, 6 );
+			count[6] = 0;
+			if ( strspn( count, "0123456789" ) == 6 )
+				ck_eofcount = atol( count );
+			if ( strncmp( (char *)rcd+4, ck_name, strlen( ck_name ) ) )
+				++ck_labels;
+		}
+	}
+	if ( state != CK_ST_HEAD )
+	{
+		++ck_labels;			/* ran out before the EOF labels */
+		bp = ck_post( ck_post( bp ) );
+		problems += ck_report();
+		++nsets;
+	}
+	secs = ss_now() - t0;
+	ck_stop();
+	if ( !nsets )
+	{
+		printf( "Snark: No savesets found.\n" );
+		++problems;
+	}
+	printf( "Checked %d saveset%s, %.1f MB in %.2f secs (%.0f MB/s) with %d thread%s. %s\n",
+			nsets, nsets != 1 ? "s" : "", bytes/1048576.0, secs,
+			secs > 0.0 ? bytes/1048576.0/secs : 0.0, threads, threads != 1 ? "s" : "",
+			problems ? "Found problems." : "All OK." );
+	return problems;
+}
@@ -0,0 +1,12 @@
+/**
+ * @file check.h
+ *
+ * Integrity check of a tape or image without extracting anything (--check).
+ */
+
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+extern int ck_run( int format, int threads, int crc, int window );
+
+#endif	/* _CHECK_H_ */
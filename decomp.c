@@ -0,0 +1,576 @@
+/**
+ * @file decomp.c
+ */
+
+/**
+ * Streaming decompression of compressed tape images.
+ *
+ * Images are often kept compressed. Rather than having to decompress
+ * them to a scratch file first, main() looks at the first few bytes of
+ * a -i or -I image and if it recognises the magic number of gzip, bzip2,
+ * xz or zstd it hands the file to dc_open(). From then on the buffered
+ * input in tapeio.c gets its bytes from dc_read() instead of read() and
+ * the record framing is parsed out of the decompressed stream as usual.
+ * The decompression runs on the read-ahead thread when there is one so
+ * it overlaps with the decoding and writing of files.
+ *
+ * Concatenated streams (as made by pigz, pbzip2, "xz -T" and "zstd -T")
+ * are followed from one to the next. Junk after the last complete stream
+ * is ignored, the way gzip does.
+ *
+ * The bytes main() had to read to find the magic number can't be pushed
+ * back into a pipe, so an uncompressed image coming from a pipe is also
+ * passed through here (as DC_NONE) to have them handed back first.
+ */
+
+#define _GNU_SOURCE
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<sys/types.h>
+#if HAVE_ZLIB
+#include	<zlib.h>
+#endif
+#if HAVE_BZLIB
+#include	<bzlib.h>
+#endif
+#if HAVE_LZMA
+#include	<lzma.h>
+#endif
+#if HAVE_ZSTD
+#include	<zstd.h>
+#endif
+
+#include	"decomp.h"
+
+#define DC_INSIZE	(256*1024)	/*!< size of compressed input buffer */
+
+static int dc_on;		/*!< dc_read() is to be used */
+static int dc_type;		/*!< kind of compression (one of DC_xxx) */
+static int dc_fd = -1;		/*!< file descriptor of image */
+static unsigned char *dc_in;	/*!< compressed bytes read from image */
+static size_t dc_inlen;		/*!< number of bytes in dc_in */
+static size_t dc_inpos;		/*!< number of bytes of dc_in consumed */
+static int dc_ineof;		/*!< image has been read to the end */
+static int dc_done;		/*!< no more decompressed bytes to come */
+static int dc_ended;		/*!< set by a decoder when it finishes a stream */
+static int dc_streams;		/*!< number of complete streams */
+static off_t dc_strin;		/*!< compressed bytes consumed by current stream */
+static off_t dc_strout;		/*!< bytes produced by current stream */
+static off_t dc_totin;		/*!< compressed bytes read */
+static off_t dc_totout;		/*!< bytes produced */
+static const char *dc_errmsg;	/*!< why the decoder failed */
+static volatile int dc_quit;	/*!< reading is being given up on (see dc_interrupt()) */
+static long (*dc_step)( unsigned char *out, size_t room );	/*!< decoder */
+
+/**
+ * Identify compressed image by its magic number.
+ *
+ * @param head Pointer to first bytes of image.
+ * @param len Number of bytes at @e head.
+ *
+ * @return One of DC_xxx.
+ */
+
+int dc_magic( const unsigned char *head, int len )
+{
+	if ( len >= 2 && head[0] == 0x1F && head[1] == 0x8B )
+		return DC_GZIP;
+	if ( len >= 4 && !memcmp( head, "BZh", 3 ) && head[3] >= '1' && head[3] <= '9' )
+		return DC_BZIP2;
+	if ( len >= 6 && !memcmp( head, "\xFD" "7zXZ\0", 6 ) )
+		return DC_XZ;
+	if ( len >= 4 && head[0] == 0x28 && head[1] == 0xB5 && head[2] == 0x2F && head[3] == 0xFD )
+		return DC_ZSTD;
+	return DC_NONE;
+}
+
+/**
+ * Get name of kind of compression.
+ *
+ * @param type One of DC_xxx.
+ *
+ * @return Pointer to null terminated name.
+ */
+
+const char *dc_name( int type )
+{
+	switch ( type )
+	{
+	case DC_GZIP:
+		return "gzip";
+	case DC_BZIP2:
+		return "bzip2";
+	case DC_XZ:
+		return "xz";
+	case DC_ZSTD:
+		return "zstd";
+	}
+	return "uncompressed";
+}
+
+/**
+ * Tell whether a kind of compression was built in.
+ *
+ * @param type One of DC_xxx.
+ *
+ * @return non-zero if it can be decompressed.
+ */
+
+int dc_supported( int type )
+{
+	switch ( type )
+	{
+	case DC_NONE:
+		return 1;
+#if HAVE_ZLIB
+	case DC_GZIP:
+		return 1;
+#endif
+#if HAVE_BZLIB
+	case DC_BZIP2:
+		return 1;
+#endif
+#if HAVE_LZMA
+	case DC_XZ:
+		return 1;
+#endif
+#if HAVE_ZSTD
+	case DC_ZSTD:
+		return 1;
+#endif
+	}
+	return 0;
+}
+
+#if HAVE_ZLIB
+static z_stream gz_strm;	/*!< gzip decoder state */
+static int gz_init;		/*!< gz_strm has been initialised */
+
+/**
+ * Decompress some gzip.
+ *
+ * @param out Pointer to place to put decompressed bytes.
+ * @param room Number of bytes available at @e out.
+ *
+ * @return Number of bytes produced or -1 on error.
+ */
+
+static long gz_step( unsigned char *out, size_t room )
+{
+	int sts;
+
+	if ( !gz_init )
+	{
+		memset( &gz_strm, 0, sizeof(gz_strm) );
+		if ( inflateInit2( &gz_strm, 15+32 ) != Z_OK )
+		{
+			dc_errmsg = "can't initialise zlib";
+			return -1;
+		}
+		gz_init = 1;
+	}
+	gz_strm.next_in = dc_in + dc_inpos;
+	gz_strm.avail_in = dc_inlen - dc_inpos;
+	gz_strm.next_out = out;
+	gz_strm.avail_out = room;
+	sts = inflate( &gz_strm, Z_NO_FLUSH );
+	dc_inpos = dc_inlen - gz_strm.avail_in;
+	if ( sts == Z_STREAM_END )
+	{
+		inflateReset( &gz_strm );	/* another member may follow */
+		dc_ended = 1;
+	}
+	else if ( sts != Z_OK && sts != Z_BUF_ERROR )
+	{
+		dc_errmsg = gz_strm.msg ? gz_strm.msg : "corrupt data";
+		return -1;
+	}
+	return room - gz_strm.avail_out;
+}
+#endif
+
+#if HAVE_BZLIB
+static bz_stream bz_strm;	/*!< bzip2 decoder state */
+static int bz_init;		/*!< bz_strm has been initialised */
+
+/**
+ * Decompress some bzip2.
+ *
+ * @param out Pointer to place to put decompressed bytes.
+ * @param room Number of bytes available at @e out.
+ *
+ * @return Number of bytes produced or -1 on error.
+ */
+
+static long bz_step( unsigned char *out, size_t room )
+{
+	int sts;
+
+	if ( !bz_init )
+	{
+		memset( &bz_strm, 0, sizeof(bz_strm) );
+		if ( BZ2_bzDecompressInit( &bz_strm, 0, 0 ) != BZ_OK )
+		{
+			dc_errmsg = "can't initialise libbz2";
+			return -1;
+		}
+		bz_init = 1;
+	}
+	bz_strm.next_in = (char *)dc_in + dc_inpos;
+	bz_strm.avail_in = dc_inlen - dc_inpos;
+	bz_strm.next_out = (char *)out;
+	bz_strm.avail_out = room;
+	sts = BZ2_bzDecompress( &bz_strm );
+	dc_inpos = dc_inlen - bz_strm.avail_in;
+	if ( sts == BZ_STREAM_END )
+	{
+		BZ2_bzDecompressEnd( &bz_strm );	/* another stream may follow */
+		bz_init = 0;
+		dc_ended = 1;
+	}
+	else if ( sts != BZ_OK )
+	{
+		dc_errmsg = "corrupt data";
+		return -1;
+	}
+	return room - bz_strm.avail_out;
+}
+#endif
+
+#if HAVE_LZMA
+static lzma_stream xz_strm = LZMA_STREAM_INIT;	/*!< xz decoder state */
+static int xz_init;		/*!< xz_strm has been initialised */
+
+/**
+ * Decompress some xz.
+ *
+ * @param out Pointer to place to put decompressed bytes.
+ * @param room Number of bytes available at @e out.
+ *
+ * @return Number of bytes produced or -1 on error.
+ */
+
+static long xz_step( unsigned char *out, size_t room )
+{
+	lzma_ret sts;
+
+	if ( !xz_init )
+	{
+		if ( lzma_stream_decoder( &xz_strm, UINT64_MAX, LZMA_CONCATENATED ) != LZMA_OK )
+		{
+			dc_errmsg = "can't initialise liblzma";
+			return -1;
+		}
+		xz_init = 1;
+	}
+	xz_strm.next_in = dc_in + dc_inpos;
+	xz_strm.avail_in = dc_inlen - dc_inpos;
+	xz_strm.next_out = out;
+	xz_strm.avail_out = room;
+	sts = lzma_code( &xz_strm, dc_ineof ? LZMA_FINISH : LZMA_RUN );
+	dc_inpos = dc_inlen - xz_strm.avail_in;
+	if ( sts == LZMA_STREAM_END )
+	{
+		dc_ended = 1;			/* liblzma has already followed any concatenated streams */
+		dc_done = 1;
+	}
+	else if ( sts != LZMA_OK && sts != LZMA_BUF_ERROR )
+	{
+		dc_errmsg = sts == LZMA_MEM_ERROR ? "out of memory" : "corrupt data";
+		return -1;
+	}
+	return room - xz_strm.avail_out;
+}
+#endif
+
+#if HAVE_ZSTD
+static ZSTD_DStream *zs_strm;	/*!< zstd decoder state */
+
+/**
+ * Decompress some zstd.
+ *
+ * @param out Pointer to place to put decompressed bytes.
+ * @param room Number of bytes available at @e out.
+ *
+ * @return Number of bytes produced or -1 on error.
+ */
+
+static long zs_step( unsigned char *out, size_t room )
+{
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer ob;
+	size_t sts;
+
+	if ( !zs_strm )
+	{
+		zs_strm = ZSTD_createDStream();
+		if ( !zs_strm )
+		{
+			dc_errmsg = "can't initialise libzstd";
+			return -1;
+		}
+		ZSTD_initDStream( zs_strm );
+	}
+	in.src = dc_in + dc_inpos;
+	in.size = dc_inlen - dc_inpos;
+	in.pos = 0;
+	ob.dst = out;
+	ob.size = room;
+	ob.pos = 0;
+	sts = ZSTD_decompressStream( zs_strm, &ob, &in );
+	dc_inpos += in.pos;
+	if ( ZSTD_isError( sts ) )
+	{
+		dc_errmsg = ZSTD_getErrorName( sts );
+		return -1;
+	}
+	if ( !sts )
+		dc_ended = 1;			/* end of a frame, another may follow */
+	return ob.pos;
+}
+#endif
+
+/**
+ * Get more compressed bytes from the image.
+ *
+ * @return 0 on success, -1 on error.
+ */
+
+static int dc_fill( void )
+{
+	ssize_t sts;
+
+	do
+		sts = read( dc_fd, dc_in, DC_INSIZE );
+	while ( sts < 0 && errno == EINTR && !dc_quit );
+	if ( sts < 0 )
+	{
+		if ( !dc_quit )
+			printf( "Snark: Failed to read image: %s\n", strerror(errno) );
+		return -1;
+	}
+	if ( !sts )
+		dc_ineof = 1;
+	dc_inlen = sts;
+	dc_inpos = 0;
+	dc_totin += sts;
+	return 0;
+}
+
+/**
+ * Start reading image through here.
+ *
+ * @param fd File descriptor of open image.
+ * @param type Kind of compression (one of DC_xxx).
+ * @param head Pointer to bytes already read from the image.
+ * @param len Number of bytes at @e head (never more than DC_MAGIC_LEN).
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+void dc_open( int fd, int type, const unsigned char *head, int len )
+{
+	dc_in = (unsigned char *)malloc( DC_INSIZE );
+	if ( !dc_in )
+	{
+		printf( "Snark: Failed to malloc %d bytes for decompression.\n", DC_INSIZE );
+		exit(1);
+	}
+	memcpy( dc_in, head, len );
+	dc_inlen = len;
+	dc_inpos = 0;
+	dc_totin = len;
+	dc_totout = 0;
+	dc_ineof = dc_done = dc_ended = 0;
+	dc_streams = 0;
+	dc_strin = dc_strout = 0;
+	dc_fd = fd;
+	dc_type = type;
+	dc_step = NULL;
+#if HAVE_ZLIB
+	if ( type == DC_GZIP )
+		dc_step = gz_step;
+#endif
+#if HAVE_BZLIB
+	if ( type == DC_BZIP2 )
+		dc_step = bz_step;
+#endif
+#if HAVE_LZMA
+	if ( type == DC_XZ )
+		dc_step = xz_step;
+#endif
+#if HAVE_ZSTD
+	if ( type == DC_ZSTD )
+		dc_step = zs_step;
+#endif
+	dc_on = 1;
+}
+
+/**
+ * Tell whether the image is read through here.
+ *
+ * @return non-zero if so.
+ */
+
+int dc_active( void )
+{
+	return dc_on;
+}
+
+/**
+ * Give up on a read that gets interrupted.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Called by tio_close() before it signals the reader thread, so a read()
+ * the signal interrupts isn't tried again. Holds until dc_close().
+ */
+
+void dc_interrupt( void )
+{
+	dc_quit = 1;
+}
+
+/**
+ * Get decompressed bytes.
+ *
+ * @param dst Pointer to place to put them.
+ * @param len Number of bytes wanted.
+ *
+ * @return Number of bytes delivered.
+ *
+ * @note
+ * Fewer bytes than asked for means the end of the image has been reached.
+ * Errors are reported here and then treated as the end of the image.
+ */
+
+long dc_read( unsigned char *dst, size_t len )
+{
+	size_t have = 0, before;
+	ssize_t sts;
+
+	while ( have < len && !dc_done )
+	{
+		if ( dc_inpos >= dc_inlen && !dc_ineof )
+		{
+			if ( dc_type == DC_NONE )
+			{
+				/* the peeked at bytes have been handed back, the rest is straight from the image */
+				do
+					sts = read( dc_fd, dst + have, len - have );
+				while ( sts < 0 && errno == EINTR && !dc_quit );
+				if ( sts <= 0 )
+				{
+					if ( sts < 0 && !dc_quit )
+						printf( "Snark: Failed to read image: %s\n", strerror(errno) );
+					dc_done = 1;
+					break;
+				}
+				have += sts;
+				continue;
+			}
+			if ( dc_fill() )
+			{
+				dc_done = 1;
+				break;
+			}
+		}
+		if ( dc_type == DC_NONE )
+		{
+			sts = dc_inlen - dc_inpos;
+			if ( (size_t)sts > len - have )
+				sts = len - have;
+			memcpy( dst + have, dc_in + dc_inpos, sts );
+			dc_inpos += sts;
+			have += sts;
+			if ( !sts )
+				dc_done = 1;
+			continue;
+		}
+		before = dc_inpos;
+		sts = dc_step( dst + have, len - have );
+		if ( sts < 0 )
+		{
+			dc_done = 1;
+			if ( dc_streams && !dc_strout )
+				break;				/* junk after the last stream, ignore it */
+			printf( "Snark: Failed to decompress %s image: %s\n", dc_name( dc_type ),
+					dc_errmsg ? dc_errmsg : "unknown error" );
+			break;
+		}
+		have += sts;
+		dc_strin += dc_inpos - before;
+		dc_strout += sts;
+		dc_totout += sts;
+		if ( dc_ended )
+		{
+			dc_ended = 0;
+			++dc_streams;
+			dc_strin = dc_strout = 0;
+		}
+		else if ( !sts && dc_inpos == before && dc_ineof )
+		{
+			if ( dc_strin )
+				printf( "Snark: Compressed image is truncated.\n" );
+			dc_done = 1;
+		}
+	}
+	return have;
+}
+
+/**
+ * Show decompression statistics.
+ *
+ * @return nothing.
+ */
+
+void dc_stats( void )
+{
+	if ( dc_on && dc_type != DC_NONE )
+		printf( "Decompression: %s, %.1f MB in, %.1f MB out in %d stream%s.\n",
+				dc_name( dc_type ), dc_totin/1048576.0, dc_totout/1048576.0,
+				dc_streams, dc_streams == 1 ? "" : "s" );
+}
+
+/**
+ * Done with image.
+ *
+ * @return nothing.
+ */
+
+void dc_close( void )
+{
+#if HAVE_ZLIB
+	if ( gz_init )
+		inflateEnd( &gz_strm );
+	gz_init = 0;
+#endif
+#if HAVE_BZLIB
+	if ( bz_init )
+		BZ2_bzDecompressEnd( &bz_strm );
+	bz_init = 0;
+#endif
+#if HAVE_LZMA
+	if ( xz_init )
+		lzma_end( &xz_strm );
+	xz_init = 0;
+#endif
+#if HAVE_ZSTD
+	if ( zs_strm )
+		ZSTD_freeDStream( zs_strm );
+	zs_strm = NULL;
+#endif
+	if ( dc_in )
+		free( dc_in );
+	dc_in = NULL;
+	dc_on = 0;
+	dc_fd = -1;
+	dc_quit = 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file decomp.h
+ *
+ * Streaming decompression of compressed tape images.
+ */
+
+#ifndef _DECOMP_H_
+#define _DECOMP_H_
+
+/* Kinds of compression */
+#define DC_NONE		(0)	/*!< not compressed */
+#define DC_GZIP		(1)	/*!< gzip (.gz) */
+#define DC_BZIP2	(2)	/*!< bzip2 (.bz2) */
+#define DC_XZ		(3)	/*!< xz (.xz) */
+#define DC_ZSTD		(4)	/*!< zstandard (.zst) */
+
+#define DC_MAGIC_LEN	(6)	/*!< bytes needed to recognise all of them */
+
+extern int dc_magic( const unsigned char *head, int len );
+extern const char *dc_name( int type );
+extern int dc_supported( int type );
+extern void dc_open( int fd, int type, const unsigned char *head, int len );
+extern int dc_active( void );
+extern void dc_interrupt( void );
+extern long dc_read( unsigned char *dst, size_t len );
+extern void dc_stats( void );
+extern void dc_close( void );
+
+#endif	/* _DECOMP_H_ */
@@ -68,7 +68,7 @@ int main(int argc, char *argv[])
 	{
 		int savErr;
 		reclen = 0;
-		sts = read(fd, &reclen, sizeof(reclen));
+		sts = read(fd, &reclen, (int)sizeof(reclen));
 		savErr = errno;
 		if ( !sts )
 			break;
@@ -80,7 +80,7 @@ int main(int argc, char *argv[])
 		}
 		if ( sts != sizeof(reclen) )
 		{
-			fprintf(stderr,"Error reading record count bytes. Expected %d, got %d: %s\n", sizeof(reclen), sts, strerror(errno));
+			fprintf(stderr,"Error reading record count bytes. Expected %d, got %d: %s\n", (int)sizeof(reclen), sts, strerror(errno));
 			close(fd);
 			return 1;
 		}
@@ -93,7 +93,7 @@ int main(int argc, char *argv[])
 		if ( reclen < 0 || reclen > 65535 )
 		{
 			fprintf(stderr,"Fatal error decoding file. Record count of 0x%X is > 0xFFFF which is illegal. Corrupt? (sizeof(int)=%d)\n",
-					reclen, sizeof(reclen));
+					reclen, (int)sizeof(reclen));
 			close(fd);
 			return 1;
 		}
@@ -164,7 +164,7 @@ int main(int argc, char *argv[])
 					else if ( sts > 0 )
 					{
 						fprintf(stderr, "Error reading trailing record count bytes. Expected %d bytes, got %d: (%d)%s\n",
-								sizeof(lastRecLen), sts, savErr, strerror(errno));
+								(int)sizeof(lastRecLen), sts, savErr, strerror(errno));
 					}
 			        break;
 		        }
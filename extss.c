@@ -286,7 +286,7 @@ static int write_ss( FILE *inp, int hdrIndx )
     if ( ferror(inp) )
     {
         printf( "Error: Error reading input. Expected %d bytes, got %d. Err=%s",
-            sizeof(bc), retv, strerror(errno) );
+            (int)sizeof(bc), retv, strerror(errno) );
         return -1;
     }
     if ( (wtmhist&3) != 3 )      /* Preceeded by two TM's? */
@@ -330,7 +330,7 @@ static int write_ss( FILE *inp, int hdrIndx )
         if ( outv != (int)sizeof(bc) )
         {
             printf( "Error: Error writing %d byte end of media header. Wrote %d. Err=%s\n",
-                sizeof(bc), outv, strerror(errno) );
+                (int)sizeof(bc), outv, strerror(errno) );
             return -1;
         }
     }
@@ -493,7 +493,7 @@ int main( int argc, char *argv[] )
 	if ( !feof(inp) )
 	{
 		printf( "Error: Unable to read input. Expected %d bytes, got %d. Err=%s",
-            sizeof(bc), retv, strerror(errno) );
+            (int)sizeof(bc), retv, strerror(errno) );
 		return 8;
 	}
 	if ( !hdrIndx )
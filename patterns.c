@@ -0,0 +1,795 @@
+/**
+ * @file patterns.c
+ */
+
+/**
+ * Compiled set of file name patterns (those selecting files, from the
+ * command line and --patterns-from, and those of --exclude).
+ *
+ * Testing a name against each pattern in turn costs more with every
+ * pattern added, and with thousands of them most of the time goes in
+ * failing to match. So they're compiled once, each into one of:
+ *
+ *	literal		no wildcards: a hash set of names
+ *	prefix		no wildcards but a '*' at the end ("[[]DIR]*"): a trie
+ *	wildcard	anything else: one state machine for all of them
+ *
+ * and a name is tested with a hash lookup, a walk down the trie and a
+ * run through the state machine, each one pass over the name however
+ * many patterns there are.
+ *
+ * The state machine starts out as an NFA with a state for each '*' and
+ * each character to match in each pattern. The DFA states (sets of NFA
+ * states) are built as names come to need them and kept, so a name
+ * mostly costs a table lookup per character. If there get to be too
+ * many of them they're thrown away and built again as needed.
+ *
+ * The syntax is that of the original match.c: '*' matches any string,
+ * '?' any one character and '[...]' any character in the list. A list
+ * starting with '!' matches any character not in it, 'a-z' is a range,
+ * and '\' quotes the next character or gives one in octal ("\133").
+ * Anything else matches itself. A list of just one character is that
+ * character, so "[[]" is a literal '['. A VMS directory has to be
+ * written that way to be a prefix: in "[DIR]*" the "[DIR]" is a list
+ * of 'D', 'I' and 'R', so that pattern goes in the state machine.
+ */
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+
+#include	"patterns.h"
+
+#define PAT_LITSIZE	(64)			/*!< starting size of the literal hash table (a power of 2) */
+#define PAT_MAXDFA	(1024)			/*!< most DFA states kept */
+#define PAT_MAXPOOL	(4*1024*1024L)		/*!< most NFA state numbers kept for them */
+#define PAT_DFAHASH	(4096)			/*!< size of the DFA state hash table (a power of 2) */
+
+#define PAT_I_CLASS	(0)	/*!< match a character in the set */
+#define PAT_I_STAR	(1)	/*!< match any string */
+#define PAT_I_END	(2)	/*!< end of the pattern, it matched */
+
+#define PAT_ISSET(set,c)	((set)[(c)>>3] & (1 << ((c)&7)))
+#define PAT_SET(set,c)		((set)[(c)>>3] |= (1 << ((c)&7)))
+#define IS_OCTAL(ch)		((ch) >= '0' && (ch) <= '7')
+
+/** NFA state: a step of a wildcard pattern. */
+struct pat_item
+{
+	int type;			/*!< PAT_I_xxx */
+	unsigned char set[32];		/*!< characters a PAT_I_CLASS matches */
+};
+
+/** Node of the trie of prefixes. */
+struct pat_node
+{
+	unsigned long child;		/*!< first node for the next character (0 if none) */
+	unsigned long sibling;		/*!< next node for another character in this place (0 if none) */
+	unsigned char ch;		/*!< character it's for */
+	char end;			/*!< a prefix ends here */
+};
+
+/** DFA state: a set of NFA states. */
+struct pat_dfa
+{
+	int next[256];			/*!< state after each character (-1 if not built yet) */
+	unsigned long set;		/*!< index of its NFA states in the pool */
+	unsigned long nset;		/*!< number of them (0 means nothing can match any more) */
+	int link;			/*!< next state in the same hash chain (-1 if none) */
+	int accept;			/*!< one of them is the end of a pattern */
+};
+
+/** The compiled patterns. */
+struct pat_set
+{
+	char **lits;			/*!< hash table of literal patterns */
+	unsigned long litsize;		/*!< number of slots in it */
+	unsigned long nlit;		/*!< number of literal patterns */
+	struct pat_node *nodes;		/*!< trie of prefix patterns, node 0 is the root */
+	unsigned long nnode, nodesize;
+	unsigned long nprefix;		/*!< number of prefix patterns */
+	struct pat_item *items;		/*!< NFA states of the wildcard patterns */
+	unsigned long nitem, itemsize;
+	unsigned long *starts;		/*!< first NFA state of each wildcard pattern */
+	unsigned long nwild, wildsize;	/*!< number of wildcard patterns */
+	struct pat_dfa *dfa;		/*!< DFA states built so far */
+	unsigned long ndfa, dfasize;
+	int dfahash[PAT_DFAHASH];	/*!< first DFA state with each hash (-1 if none) */
+	int start;			/*!< DFA state names start in (-1 if not built yet) */
+	unsigned long *pool;		/*!< NFA state numbers of the DFA states */
+	unsigned long npool, poolsize;
+	unsigned long *work;		/*!< NFA states of the DFA state being built */
+	unsigned long nwork;
+	unsigned long *mark;		/*!< when each NFA state was last put in work */
+	unsigned long marksize;
+	unsigned long gen;		/*!< stamp for mark */
+	unsigned long built;		/*!< DFA states built */
+	unsigned long flushes;		/*!< times they were all thrown away */
+};
+
+/**
+ * Make room in an array.
+ *
+ * @param mem Pointer to it.
+ * @param size Pointer to number of elements there's room for.
+ * @param need Number of elements needed.
+ * @param elsize Size of each.
+ *
+ * @return pointer to the array.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static void *pat_grow( void *mem, unsigned long *size, unsigned long need, size_t elsize )
+{
+	if ( need <= *size )
+		return mem;
+	*size = *size ? *size*2 : 64;
+	if ( *size < need )
+		*size = need;
+	mem = realloc( mem, *size*elsize );
+	if ( !mem )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for patterns.\n", (unsigned long)(*size*elsize) );
+		exit(1);
+	}
+	return mem;
+}
+
+/**
+ * Make a set of patterns.
+ *
+ * @return pointer to it (empty).
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+struct pat_set *pat_new( void )
+{
+	struct pat_set *ps;
+
+	ps = (struct pat_set *)calloc( 1, sizeof(*ps) );
+	if ( !ps )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for patterns.\n", (unsigned long)sizeof(*ps) );
+		exit(1);
+	}
+	memset( ps->dfahash, 0xFF, sizeof(ps->dfahash) );
+	ps->start = -1;
+	return ps;
+}
+
+/**
+ * Throw away the DFA states.
+ *
+ * @param ps Pointer to set.
+ *
+ * @return nothing.
+ */
+
+static void pat_flush( struct pat_set *ps )
+{
+	if ( ps->ndfa )
+		++ps->flushes;
+	ps->ndfa = ps->npool = 0;
+	ps->start = -1;
+	memset( ps->dfahash, 0xFF, sizeof(ps->dfahash) );
+}
+
+/**
+ * Hash a string.
+ *
+ * @param str Pointer to null terminated string.
+ *
+ * @return FNV-1a hash of it.
+ */
+
+static unsigned long pat_hash( const char *str )
+{
+	unsigned long h = 2166136261UL;
+
+	while ( *str )
+		h = ((h ^ (unsigned char)*str++) * 16777619UL) & 0xFFFFFFFFUL;
+	return h;
+}
+
+/**
+ * Find the slot for a literal pattern.
+ *
+ * @param ps Pointer to set.
+ * @param str Pointer to null terminated string.
+ *
+ * @return index of the slot holding it, or of the empty one it would go in.
+ */
+
+static unsigned long pat_litslot( const struct pat_set *ps, const char *str )
+{
+	unsigned long ii;
+
+	for ( ii = pat_hash( str ) & (ps->litsize-1); ps->lits[ii]; ii = (ii+1) & (ps->litsize-1) )
+	{
+		if ( !strcmp( ps->lits[ii], str ) )
+			break;
+	}
+	return ii;
+}
+
+/**
+ * Add a literal pattern.
+ *
+ * @param ps Pointer to set.
+ * @param str Pointer to it (taken over by the set).
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static void pat_addlit( struct pat_set *ps, char *str )
+{
+	char **old;
+	unsigned long ii, oldsize;
+
+	if ( (ps->nlit+1)*2 > ps->litsize )
+	{
+		old = ps->lits;
+		oldsize = ps->litsize;
+		ps->litsize = oldsize ? oldsize*2 : PAT_LITSIZE;
+		ps->lits = (char **)calloc( ps->litsize, sizeof(char *) );
+		if ( !ps->lits )
+		{
+			printf( "Snark: Failed to malloc %lu bytes for patterns.\n", (unsigned long)(ps->litsize*sizeof(char *)) );
+			exit(1);
+		}
+		for ( ii = 0; ii < oldsize; ++ii )
+		{
+			if ( old[ii] )
+				ps->lits[pat_litslot( ps, old[ii] )] = old[ii];
+		}
+		free( old );
+	}
+	ii = pat_litslot( ps, str );
+	if ( ps->lits[ii] )
+	{
+		free( str );		/* got it already */
+		return;
+	}
+	ps->lits[ii] = str;
+	++ps->nlit;
+}
+
+/**
+ * Add a prefix pattern.
+ *
+ * @param ps Pointer to set.
+ * @param str Pointer to what the names it matches start with.
+ *
+ * @return nothing.
+ */
+
+static void pat_addprefix( struct pat_set *ps, const char *str )
+{
+	unsigned long nd, ch;
+
+	if ( !ps->nnode )
+	{
+		ps->nodes = (struct pat_node *)pat_grow( ps->nodes, &ps->nodesize, 1, sizeof(struct pat_node) );
+		memset( ps->nodes, 0, sizeof(struct pat_node) );
+		ps->nnode = 1;
+	}
+	for ( nd = 0; *str; ++str )
+	{
+		for ( ch = ps->nodes[nd].child; ch && ps->nodes[ch].ch != (unsigned char)*str; ch = ps->nodes[ch].sibling )
+			;
+		if ( !ch )
+		{
+			ps->nodes = (struct pat_node *)pat_grow( ps->nodes, &ps->nodesize, ps->nnode+1, sizeof(struct pat_node) );
+			ch = ps->nnode++;
+			ps->nodes[ch].child = 0;
+			ps->nodes[ch].sibling = ps->nodes[nd].child;
+			ps->nodes[ch].ch = (unsigned char)*str;
+			ps->nodes[ch].end = 0;
+			ps->nodes[nd].child = ch;
+		}
+		nd = ch;
+	}
+	if ( !ps->nodes[nd].end )
+	{
+		ps->nodes[nd].end = 1;
+		++ps->nprefix;
+	}
+}
+
+/**
+ * Add an NFA state.
+ *
+ * @param ps Pointer to set.
+ * @param type PAT_I_xxx.
+ *
+ * @return pointer to it (with an empty set).
+ */
+
+static struct pat_item *pat_item( struct pat_set *ps, int type )
+{
+	struct pat_item *it;
+
+	ps->items = (struct pat_item *)pat_grow( ps->items, &ps->itemsize, ps->nitem+1, sizeof(struct pat_item) );
+	it = ps->items + ps->nitem++;
+	memset( it, 0, sizeof(*it) );
+	it->type = type;
+	return it;
+}
+
+/**
+ * Get the next character of a list in a pattern.
+ *
+ * @param pp Pointer to pointer into pattern, moved past the character.
+ *
+ * @return the character, with any '\' quoting undone.
+ */
+
+static char pat_nextch( const char **pp )
+{
+	char ch, sum;
+	int count;
+
+	if ( !(ch = **pp) )
+		return ch;
+	++*pp;
+	if ( ch == '\\' && **pp )
+	{
+		ch = *(*pp)++;
+		if ( IS_OCTAL(ch) )
+		{
+			sum = 0;
+			for ( count = 0; count < 3 && IS_OCTAL(ch); ++count )
+			{
+				sum = sum*8 + (ch - '0');
+				ch = *(*pp)++;
+			}
+			--*pp;
+			ch = sum;
+		}
+	}
+	return ch;
+}
+
+/**
+ * See if a PAT_I_CLASS is for the one character.
+ *
+ * @param it Pointer to it.
+ *
+ * @return the character, -1 if it's not just the one.
+ */
+
+static int pat_single( const struct pat_item *it )
+{
+	int ii, ch = -1;
+
+	if ( it->type != PAT_I_CLASS )
+		return -1;
+	for ( ii = 1; ii < 256; ++ii )
+	{
+		if ( PAT_ISSET( it->set, ii ) )
+		{
+			if ( ch >= 0 )
+				return -1;
+			ch = ii;
+		}
+	}
+	return ch;
+}
+
+/**
+ * Add a pattern.
+ *
+ * @param ps Pointer to set.
+ * @param pattern Pointer to null terminated pattern.
+ *
+ * @return 0 if it was added, non-zero if it's no good.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+int pat_add( struct pat_set *ps, const char *pattern )
+{
+	struct pat_item *it;
+	const char *pp = pattern;
+	unsigned long first = ps->nitem, nn, ii;
+	char lo, hi, *str;
+	int neg, ch;
+
+	/* one NFA state for each '*' or character to match */
+	while ( *pp )
+	{
+		if ( *pp == '*' )
+		{
+			if ( ps->nitem == first || ps->items[ps->nitem-1].type != PAT_I_STAR )
+				pat_item( ps, PAT_I_STAR );	/* "**" is the same as "*" */
+			++pp;
+			continue;
+		}
+		it = pat_item( ps, PAT_I_CLASS );
+		if ( *pp == '?' )
+		{
+			memset( it->set, 0xFF, sizeof(it->set) );
+			++pp;
+		}
+		else if ( *pp != '[' )
+		{
+			PAT_SET( it->set, (unsigned char)*pp );
+			++pp;
+		}
+		else
+		{
+			neg = *++pp == '!';
+			if ( neg )
+				++pp;
+			while ( *pp && *pp != ']' )
+			{
+				lo = hi = pat_nextch( &pp );
+				if ( *pp == '-' )
+				{
+					++pp;
+					hi = pat_nextch( &pp );
+				}
+				for ( ch = 1; ch < 256; ++ch )
+				{
+					if ( (char)ch >= lo && (char)ch <= hi )	/* as match() compared them */
+						PAT_SET( it->set, ch );
+				}
+			}
+			if ( !*pp )
+			{
+				printf( "Snark: pattern '%s' has a '[' without its ']'. Ignored.\n", pattern );
+				ps->nitem = first;
+				return 1;
+			}
+			++pp;
+			if ( neg )
+			{
+				for ( ch = 0; ch < (int)sizeof(it->set); ++ch )
+					it->set[ch] = ~it->set[ch];
+			}
+		}
+		it->set[0] &= ~1;	/* names don't have a null in them */
+	}
+
+	/* see if it's a literal or a prefix */
+	nn = ps->nitem - first;
+	str = (char *)malloc( nn+1 );
+	if ( !str )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for patterns.\n", nn+1 );
+		exit(1);
+	}
+	for ( ii = 0; ii < nn && (ch = pat_single( ps->items + first + ii )) >= 0; ++ii )
+		str[ii] = (char)ch;
+	str[ii] = 0;
+	if ( ii == nn )
+	{
+		ps->nitem = first;
+		pat_addlit( ps, str );
+		return 0;
+	}
+	if ( ii == nn-1 && ps->items[first+ii].type == PAT_I_STAR )
+	{
+		ps->nitem = first;
+		pat_addprefix( ps, str );
+		free( str );
+		return 0;
+	}
+	free( str );
+
+	/* else it's part of the NFA */
+	pat_item( ps, PAT_I_END );
+	ps->starts = (unsigned long *)pat_grow( ps->starts, &ps->wildsize, ps->nwild+1, sizeof(unsigned long) );
+	ps->starts[ps->nwild++] = first;
+	pat_flush( ps );	/* the DFA states don't know about it */
+	return 0;
+}
+
+/**
+ * Add the patterns in a file, one to a line.
+ *
+ * @param ps Pointer to set.
+ * @param fname Pointer to name of file.
+ *
+ * @return 0 if it was read, non-zero if not.
+ *
+ * @note
+ * Blank lines are skipped. A pattern that's no good is reported and
+ * skipped too.
+ */
+
+int pat_addfile( struct pat_set *ps, const char *fname )
+{
+	FILE *fp;
+	char line[1024];
+	size_t len;
+	unsigned long lineno = 0;
+	int ans = 0;
+
+	fp = fopen( fname, "r" );
+	if ( !fp )
+	{
+		printf( "Snark: Unable to open patterns file '%s'.\n", fname );
+		return 1;
+	}
+	while ( fgets( line, sizeof(line), fp ) )
+	{
+		++lineno;
+		len = strlen( line );
+		if ( len == sizeof(line)-1 && line[len-1] != '\n' )
+		{
+			printf( "Snark: line %lu of '%s' is too long.\n", lineno, fname );
+			ans = 1;
+			break;
+		}
+		while ( len && (line[len-1] == '\n' || line[len-1] == '\r') )
+			line[--len] = 0;
+		if ( len )
+			pat_add( ps, line );
+	}
+	if ( ferror( fp ) )
+	{
+		printf( "Snark: Error reading patterns file '%s'.\n", fname );
+		ans = 1;
+	}
+	fclose( fp );
+	return ans;
+}
+
+/**
+ * Get the number of patterns.
+ *
+ * @param ps Pointer to set.
+ *
+ * @return number of different patterns in it.
+ */
+
+unsigned long pat_count( const struct pat_set *ps )
+{
+	return ps->nlit + ps->nprefix + ps->nwild;
+}
+
+/**
+ * Put an NFA state, and those it can get to without a character, in
+ * the DFA state being built.
+ *
+ * @param ps Pointer to set.
+ * @param st The NFA state.
+ *
+ * @return nothing.
+ */
+
+static void pat_addstate( struct pat_set *ps, unsigned long st )
+{
+	while ( ps->mark[st] != ps->gen )
+	{
+		ps->mark[st] = ps->gen;
+		ps->work[ps->nwork++] = st;
+		if ( ps->items[st].type != PAT_I_STAR )
+			break;
+		++st;			/* a '*' can match nothing */
+	}
+}
+
+/**
+ * Start building a DFA state.
+ *
+ * @param ps Pointer to set.
+ *
+ * @return nothing.
+ */
+
+static void pat_newstate( struct pat_set *ps )
+{
+	if ( ps->marksize < ps->nitem )
+	{
+		ps->mark = (unsigned long *)pat_grow( ps->mark, &ps->marksize, ps->nitem, sizeof(unsigned long) );
+		memset( ps->mark, 0, ps->marksize*sizeof(unsigned long) );
+		free( ps->work );
+		ps->work = (unsigned long *)malloc( ps->marksize*sizeof(unsigned long) );
+		if ( !ps->work )
+		{
+			printf( "Snark: Failed to malloc %lu bytes for patterns.\n", (unsigned long)(ps->marksize*sizeof(unsigned long)) );
+			exit(1);
+		}
+		ps->gen = 0;
+	}
+	if ( !++ps->gen )
+	{
+		memset( ps->mark, 0, ps->marksize*sizeof(unsigned long) );
+		ps->gen = 1;
+	}
+	ps->nwork = 0;
+}
+
+/**
+ * Compare two NFA state numbers for qsort().
+ */
+
+static int pat_cmp( const void *a, const void *b )
+{
+	unsigned long aa = *(const unsigned long *)a, bb = *(const unsigned long *)b;
+
+	return aa < bb ? -1 : aa > bb;
+}
+
+/**
+ * Finish building a DFA state.
+ *
+ * @param ps Pointer to set.
+ *
+ * @return index of the DFA state with the NFA states in work.
+ *
+ * @note
+ * If it's new and there isn't room for it the others are thrown away
+ * first.
+ */
+
+static int pat_endstate( struct pat_set *ps )
+{
+	struct pat_dfa *df;
+	unsigned long ii, hh;
+	int dd;
+
+	qsort( ps->work, ps->nwork, sizeof(unsigned long), pat_cmp );
+	for ( hh = ii = 0; ii < ps->nwork; ++ii )
+		hh = (hh*31 + ps->work[ii]) & 0xFFFFFFFFUL;
+	hh &= PAT_DFAHASH-1;
+	for ( dd = ps->dfahash[hh]; dd >= 0; dd = ps->dfa[dd].link )
+	{
+		df = ps->dfa + dd;
+		if ( df->nset == ps->nwork && !memcmp( ps->pool + df->set, ps->work, ps->nwork*sizeof(unsigned long) ) )
+			return dd;
+	}
+	if ( ps->ndfa >= PAT_MAXDFA || ps->npool + ps->nwork > PAT_MAXPOOL )
+		pat_flush( ps );
+	ps->dfa = (struct pat_dfa *)pat_grow( ps->dfa, &ps->dfasize, ps->ndfa+1, sizeof(struct pat_dfa) );
+	ps->pool = (unsigned long *)pat_grow( ps->pool, &ps->poolsize, ps->npool+ps->nwork+1, sizeof(unsigned long) );
+	dd = (int)ps->ndfa++;
+	df = ps->dfa + dd;
+	memset( df->next, 0xFF, sizeof(df->next) );
+	df->set = ps->npool;
+	df->nset = ps->nwork;
+	df->accept = 0;
+	for ( ii = 0; ii < ps->nwork; ++ii )
+	{
+		if ( ps->items[ps->work[ii]].type == PAT_I_END )
+			df->accept = 1;
+	}
+	memcpy( ps->pool + ps->npool, ps->work, ps->nwork*sizeof(unsigned long) );
+	ps->npool += ps->nwork;
+	df->link = ps->dfahash[hh];
+	ps->dfahash[hh] = dd;
+	++ps->built;
+	return dd;
+}
+
+/**
+ * Build the DFA state after a character.
+ *
+ * @param ps Pointer to set.
+ * @param dd DFA state before it.
+ * @param ch The character.
+ *
+ * @return index of the DFA state after it.
+ */
+
+static int pat_step( struct pat_set *ps, int dd, int ch )
+{
+	const struct pat_item *it;
+	unsigned long ii, st, flushes = ps->flushes;
+	int nd;
+
+	pat_newstate( ps );
+	for ( ii = 0; ii < ps->dfa[dd].nset; ++ii )
+	{
+		st = ps->pool[ps->dfa[dd].set + ii];
+		it = ps->items + st;
+		if ( it->type == PAT_I_STAR )
+			pat_addstate( ps, st );
+		else if ( it->type == PAT_I_CLASS && PAT_ISSET( it->set, ch ) )
+			pat_addstate( ps, st+1 );
+	}
+	nd = pat_endstate( ps );
+	if ( ps->flushes == flushes )
+		ps->dfa[dd].next[ch] = nd;	/* dd is still there */
+	return nd;
+}
+
+/**
+ * Test a name against the patterns.
+ *
+ * @param ps Pointer to set.
+ * @param name Pointer to null terminated name.
+ *
+ * @return non-zero if one of them matches it.
+ */
+
+int pat_match( struct pat_set *ps, const char *name )
+{
+	const unsigned char *pp;
+	unsigned long nd;
+	unsigned long ii;
+	int dd, next;
+
+	if ( ps->nlit && ps->lits[pat_litslot( ps, name )] )
+		return 1;
+	if ( ps->nprefix )
+	{
+		for ( nd = 0, pp = (const unsigned char *)name; !ps->nodes[nd].end; ++pp )
+		{
+			if ( !*pp )
+				break;
+			for ( nd = ps->nodes[nd].child; nd && ps->nodes[nd].ch != *pp; nd = ps->nodes[nd].sibling )
+				;
+			if ( !nd )
+				break;
+		}
+		if ( ps->nodes[nd].end )
+			return 1;
+	}
+	if ( !ps->nwild )
+		return 0;
+	if ( (dd = ps->start) < 0 )
+	{
+		pat_newstate( ps );
+		for ( ii = 0; ii < ps->nwild; ++ii )
+			pat_addstate( ps, ps->starts[ii] );
+		dd = ps->start = pat_endstate( ps );
+	}
+	for ( pp = (const unsigned char *)name; *pp && ps->dfa[dd].nset; ++pp )
+	{
+		next = ps->dfa[dd].next[*pp];
+		dd = next >= 0 ? next : pat_step( ps, dd, *pp );
+	}
+	return !*pp && ps->dfa[dd].accept;
+}
+
+/**
+ * Show pattern statistics.
+ *
+ * @param ps Pointer to set.
+ * @param what Pointer to what to call it.
+ *
+ * @return nothing.
+ */
+
+void pat_stats( const struct pat_set *ps, const char *what )
+{
+	printf( "%s: %lu literal, %lu prefix, %lu wildcard.\n", what, ps->nlit, ps->nprefix, ps->nwild );
+	if ( ps->built )
+		printf( "%s: built %lu automaton states, started over %lu times.\n", what, ps->built, ps->flushes );
+}
+
+/**
+ * Let go of a set of patterns.
+ *
+ * @param ps Pointer to set.
+ *
+ * @return nothing.
+ */
+
+void pat_free( struct pat_set *ps )
+{
+	unsigned long ii;
+
+	for ( ii = 0; ii < ps->litsize; ++ii )
+		free( ps->lits[ii] );
+	free( ps->lits );
+	free( ps->nodes );
+	free( ps->items );
+	free( ps->starts );
+	free( ps->dfa );
+	free( ps->pool );
+	free( ps->work );
+	free( ps->mark );
+	free( ps );
+}
@@ -0,0 +1,20 @@
+/**
+ * @file patterns.h
+ *
+ * Compiled set of file name patterns (see patterns.c).
+ */
+
+#ifndef _PATTERNS_H_
+#define _PATTERNS_H_
+
+struct pat_set;
+
+extern struct pat_set *pat_new( void );
+extern int pat_add( struct pat_set *ps, const char *pattern );
+extern int pat_addfile( struct pat_set *ps, const char *fname );
+extern unsigned long pat_count( const struct pat_set *ps );
+extern int pat_match( struct pat_set *ps, const char *name );
+extern void pat_stats( const struct pat_set *ps, const char *what );
+extern void pat_free( struct pat_set *ps );
+
+#endif	/* _PATTERNS_H_ */
@@ -0,0 +1,205 @@
+/**
+ * @file saveset.h
+ *
+ * Layout of saveset blocks and the decisions about them that the
+ * decoder (vmsbackup.c), the reader thread (tapeio.c) and --check
+ * (check.c) all have to make the same way.
+ */
+
+#ifndef _SAVESET_H_
+#define _SAVESET_H_
+
+#include	<string.h>
+#include	<time.h>
+
+#define SS_LABEL_SIZE	(80)	/*!< size of a tape label */
+
+/* Where things are in a block header (struct bbh in vmsbackup.c) */
+#define SS_BBH_SIZE	(256)	/*!< sizeof(struct bbh) */
+#define SS_BBH_APPLIC	(6)	/*!< offset of bbh_dol_w_applic */
+#define SS_BBH_NUMBER	(8)	/*!< offset of bbh_dol_l_number */
+#define SS_BBH_VOLNUM	(34)	/*!< offset of bbh_dol_w_volnum */
+#define SS_BBH_CRC	(36)	/*!< offset of bbh_dol_l_crc */
+#define SS_BBH_BLKSIZE	(40)	/*!< offset of bbh_dol_l_blocksize */
+#define SS_BBH_SSNAME	(48)	/*!< offset of bbh_dol_t_ssname (a counted string) */
+#define SS_BRH_SIZE	(16)	/*!< sizeof(struct brh) */
+
+/* What ss_blkcheck() makes of a block header */
+#define SS_BLK_OK	(0)	/*!< looks like a block */
+#define SS_BLK_HDRSIZE	(1)	/*!< header size isn't SS_BBH_SIZE */
+#define SS_BLK_BLKSIZE	(2)	/*!< blocksize is neither 0 nor the saveset's */
+#define SS_BLK_NUMBER	(3)	/*!< block number is 0 */
+
+/*
+ * Blocks read ahead (the window in which duplicate and out of order
+ * blocks are put right) unless the summary record asks for more.
+ */
+#ifndef MAX_BUFFCOUNT
+	#define MAX_BUFFCOUNT (10)	/*!< Smallest number of look ahead buffers */
+#endif
+#define MAX_WINDOW_AUTO	(1024)	/*!< most look ahead buffers the summary record can ask for */
+
+#if defined(__GNUC__)
+#define SS_INLINE __inline__
+#else
+#define SS_INLINE
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SS_LE_LOADS (1)
+#endif
+#endif
+
+/**
+ * Get a little endian 16 bit number.
+ *
+ * @param p Pointer to it (need not be aligned).
+ *
+ * @return the number.
+ */
+
+static SS_INLINE unsigned int ss_getu16( const unsigned char *p )
+{
+#if SS_LE_LOADS
+	unsigned short val;
+
+	memcpy( &val, p, 2 );
+	return val;
+#else
+	return p[0] | (p[1] << 8);
+#endif
+}
+
+/**
+ * Get a little endian 32 bit number.
+ *
+ * @param p Pointer to it (need not be aligned).
+ *
+ * @return the number.
+ */
+
+static SS_INLINE unsigned long ss_getu32( const unsigned char *p )
+{
+#if SS_LE_LOADS
+	unsigned int val;
+
+	memcpy( &val, p, 4 );
+	return val;
+#else
+	return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+#endif
+}
+
+/**
+ * Check a block's header.
+ *
+ * @param blk Pointer to block.
+ * @param bsize Blocksize of the saveset (from HDR2).
+ * @param numb Pointer to place to deposit its block number.
+ *
+ * @return One of SS_BLK_xxx.
+ */
+
+static SS_INLINE int ss_blkcheck( const unsigned char *blk, int bsize, unsigned long *numb )
+{
+	unsigned long bs;
+
+	*numb = 0;
+	if ( ss_getu16( blk ) != SS_BBH_SIZE )
+		return SS_BLK_HDRSIZE;
+	bs = ss_getu32( blk + SS_BBH_BLKSIZE );
+	if ( bs != 0 && bs != (unsigned long)bsize )
+		return SS_BLK_BLKSIZE;
+	*numb = ss_getu32( blk + SS_BBH_NUMBER );
+	return *numb ? SS_BLK_OK : SS_BLK_NUMBER;
+}
+
+/**
+ * Decide which of two copies of a block to keep.
+ *
+ * @param oldbad Non-zero if the copy read first failed its CRC check.
+ * @param newbad Non-zero if the copy read later did.
+ *
+ * @return non-zero if the later copy replaces the first.
+ *
+ * @note
+ * BACKUP writes a block again when it had trouble with it, so the later
+ * copy is the one to use. Unless it's the one that's bad.
+ */
+
+static SS_INLINE int ss_keepnew( int oldbad, int newbad )
+{
+	return !newbad || oldbad;
+}
+
+/**
+ * Check if a block number is too far ahead to take at face value.
+ *
+ * @param numb Its block number.
+ * @param high Highest block number taken so far.
+ * @param window Number of blocks read ahead.
+ *
+ * @return non-zero if it's further past @e high than the window.
+ *
+ * @note
+ * Blocks can turn up out of order within the window. One beyond it is
+ * only believed if the next block read follows on from it (the tape
+ * really skipped), else its block number was bad and the block is
+ * tossed. Taking it would have everything after it seen as too late.
+ */
+
+static SS_INLINE int ss_faraway( unsigned long numb, unsigned long high, int window )
+{
+	return numb > high && numb - high > (unsigned long)window;
+}
+
+/**
+ * Work out the read-ahead window from the summary record.
+ *
+ * @param buffcount /BUFFER_COUNT (0 if none).
+ * @param grpsize /GROUP_SIZE (0 if none).
+ *
+ * @return number of blocks to read ahead.
+ *
+ * @note
+ * BACKUP can have /BUFFER_COUNT blocks on the go at once so a block it
+ * had to write again can turn up that many blocks late, and all of a
+ * redundancy group (/GROUP_SIZE blocks and its XOR block) has to be on
+ * hand to rebuild one of them.
+ */
+
+static SS_INLINE int ss_window( int buffcount, int grpsize )
+{
+	int need;
+
+	need = buffcount + (grpsize ? grpsize+1 : 0);
+	if ( need < MAX_BUFFCOUNT )
+		need = MAX_BUFFCOUNT;
+	if ( need > MAX_WINDOW_AUTO )
+		need = MAX_WINDOW_AUTO;
+	return need;
+}
+
+/**
+ * Get a monotonic time stamp.
+ *
+ * @return time in seconds (0 if there's no such clock).
+ *
+ * @note
+ * Define _GNU_SOURCE ahead of the includes to get clock_gettime().
+ */
+
+static SS_INLINE double ss_now( void )
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1.0e9;
+#else
+	return 0.0;
+#endif
+}
+
+#endif	/* _SAVESET_H_ */
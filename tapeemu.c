@@ -0,0 +1,747 @@
+/**
+ * @file tapeemu.c
+ */
+
+/**
+ * Tape drive emulator for testing and benchmarking the tape code paths.
+ *
+ * Built as a shared library and loaded with LD_PRELOAD it makes a -i or
+ * -I tape image look like a tape drive to the program. Opening the
+ * emulated device (TAPEEMU_DEVICE, /dev/nst0 by default) opens the image
+ * (TAPEEMU_IMAGE) instead, stat() says it's a character device, each
+ * read() delivers exactly one record, a tape mark reads as 0 bytes and
+ * the MTIOCTOP and MTIOCGET ioctl()'s used by vmsbackup (MTSETBLK, MTREW,
+ * MTFSF, MTBSF, MTNOP, MTIOCGET) behave the way the Linux st driver's do.
+ * Nothing else is touched so a build with HAVE_MTIO=1 runs the real tape
+ * code.
+ *
+ * Optionally the drive also has the timing of a real one. It reads from
+ * the tape at TAPEEMU_RATE MB/sec into a buffer of TAPEEMU_DRIVEBUF MB
+ * (default 64) that read() takes the records out of. When the buffer
+ * fills because the program isn't reading fast enough the drive stops,
+ * and when there's room again it has to back up and get going again,
+ * which takes TAPEEMU_REPOS millisecs (default 0) before any more data
+ * comes off the tape. Rewinding and spacing over files cost a
+ * reposition too. With no TAPEEMU_RATE records come as fast as the
+ * image can be read.
+ *
+ * When the device is closed a line of statistics is written to stderr:
+ * how much was read, how often the drive had to stop and how long the
+ * program spent waiting for it.
+ *
+ * Usage:
+ *
+ *	make -f Makefile.linux HAVE_MTIO=1 vmsbackup tapeemu.so
+ *	TAPEEMU_IMAGE=foo.simh TAPEEMU_RATE=160 TAPEEMU_REPOS=2000 \
+ *		LD_PRELOAD=./tapeemu.so ./vmsbackup -t --stats -f /dev/nst0
+ *
+ * Only one emulated device can be open at a time.
+ */
+
+#define _GNU_SOURCE		/* for RTLD_NEXT, stat64() and friends */
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+#include	<stdarg.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<time.h>
+#include	<dlfcn.h>
+#include	<pthread.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<sys/sysmacros.h>
+#include	<sys/ioctl.h>
+#include	<sys/mtio.h>
+
+#define EMU_DEVICE_DEF	"/dev/nst0"	/*!< default name of emulated device */
+#define EMU_DRIVEBUF_DEF (64)		/*!< default size of drive's buffer in MB */
+#define EMU_MINBUF	(256*1024)	/*!< smallest drive buffer (has to hold a whole record) */
+#define EMU_MAXREC	(128*1024)	/*!< largest record a saveset can have (and then some) */
+#define EMU_PROBE_RECS	(8)		/*!< records whose SIMH counts have to match */
+
+#ifndef _STAT_VER
+	#define _STAT_VER (0)	/*!< only used with a C library old enough to define it */
+#endif
+
+static const char *emu_device;	/*!< name of emulated device */
+static const char *emu_image;	/*!< name of image it has loaded */
+static double emu_rate;		/*!< bytes/sec off the tape (0=no limit) */
+static double emu_repos;	/*!< secs to reposition */
+static double emu_cap;		/*!< bytes the drive can buffer */
+
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;	/*!< reader thread and main thread both call in */
+static int emu_fd = -1;		/*!< fd handed to the program (the image's) or -1 */
+static int emu_simh;		/*!< image has SIMH trailing counts */
+static off_t emu_pos;		/*!< offset in image of next record */
+static long emu_fileno;		/*!< file number the tape is in */
+static long emu_blkno;		/*!< record number within that file */
+static int emu_ateod;		/*!< read past the end of the image */
+
+/* Drive buffer model */
+static double drv_fill;		/*!< bytes in the drive's buffer */
+static double drv_time;		/*!< time drv_fill is good for */
+static int drv_moving;		/*!< tape is moving (from drv_time on) */
+
+/* Statistics */
+static unsigned long st_recs;	/*!< records read */
+static unsigned long st_marks;	/*!< tape marks read */
+static double st_bytes;		/*!< bytes read */
+static unsigned long st_stops;	/*!< times the drive stopped with a full buffer */
+static unsigned long st_repos;	/*!< times the drive had to reposition */
+static double st_wait;		/*!< secs program spent waiting for the drive */
+static double st_start;		/*!< time device was opened */
+
+static int (*real_open)( const char *path, int flags, ... );
+static int (*real_close)( int fd );
+static ssize_t (*real_read)( int fd, void *buf, size_t len );
+static int (*real_ioctl)( int fd, unsigned long req, ... );
+static int (*real_stat)( const char *path, struct stat *st );
+static int (*real_stat64)( const char *path, struct stat64 *st );
+static int (*real_fstat)( int fd, struct stat *st );
+static int (*real_fstat64)( int fd, struct stat64 *st );
+static int (*real_xstat)( int ver, const char *path, struct stat *st );
+static int (*real_xstat64)( int ver, const char *path, struct stat64 *st );
+static int (*real_fxstat)( int ver, int fd, struct stat *st );
+static int (*real_fxstat64)( int ver, int fd, struct stat64 *st );
+static off_t (*real_lseek)( int fd, off_t off, int whence );
+static off64_t (*real_lseek64)( int fd, off64_t off, int whence );
+
+/* Only older C libraries have these, there's no prototype for them any more */
+extern int __xstat( int ver, const char *path, struct stat *st );
+extern int __xstat64( int ver, const char *path, struct stat64 *st );
+extern int __fxstat( int ver, int fd, struct stat *st );
+extern int __fxstat64( int ver, int fd, struct stat64 *st );
+extern int __open_2( const char *path, int flags );
+extern int __open64_2( const char *path, int flags );
+extern ssize_t __read_chk( int fd, void *buf, size_t len, size_t buflen );
+
+/**
+ * Look up the real functions and the settings.
+ *
+ * @return nothing.
+ */
+
+static void emu_init( void )
+{
+	static int done;
+	const char *cp;
+
+	if ( done )
+		return;
+	done = 1;
+	real_open = dlsym( RTLD_NEXT, "open" );
+	real_close = dlsym( RTLD_NEXT, "close" );
+	real_read = dlsym( RTLD_NEXT, "read" );
+	real_ioctl = dlsym( RTLD_NEXT, "ioctl" );
+	real_stat = dlsym( RTLD_NEXT, "stat" );
+	real_stat64 = dlsym( RTLD_NEXT, "stat64" );
+	real_fstat = dlsym( RTLD_NEXT, "fstat" );
+	real_fstat64 = dlsym( RTLD_NEXT, "fstat64" );
+	real_xstat = dlsym( RTLD_NEXT, "__xstat" );
+	real_xstat64 = dlsym( RTLD_NEXT, "__xstat64" );
+	real_fxstat = dlsym( RTLD_NEXT, "__fxstat" );
+	real_fxstat64 = dlsym( RTLD_NEXT, "__fxstat64" );
+	real_lseek = dlsym( RTLD_NEXT, "lseek" );
+	real_lseek64 = dlsym( RTLD_NEXT, "lseek64" );
+	emu_device = getenv( "TAPEEMU_DEVICE" );
+	if ( !emu_device || !*emu_device )
+		emu_device = EMU_DEVICE_DEF;
+	emu_image = getenv( "TAPEEMU_IMAGE" );
+	if ( !emu_image || !*emu_image )
+		fprintf( stderr, "tapeemu: TAPEEMU_IMAGE isn't set, %s is not being emulated.\n", emu_device );
+	cp = getenv( "TAPEEMU_RATE" );
+	emu_rate = cp ? atof( cp )*1024*1024 : 0;
+	cp = getenv( "TAPEEMU_REPOS" );
+	emu_repos = cp ? atof( cp )/1000 : 0;
+	cp = getenv( "TAPEEMU_DRIVEBUF" );
+	emu_cap = (cp ? atof( cp ) : EMU_DRIVEBUF_DEF)*1024*1024;
+	if ( emu_cap < EMU_MINBUF )
+		emu_cap = EMU_MINBUF;
+}
+
+/**
+ * See if a name is the emulated device.
+ *
+ * @param path Pointer to null terminated name.
+ *
+ * @return non-zero if it is.
+ */
+
+static int emu_isdev( const char *path )
+{
+	emu_init();
+	return emu_image && *emu_image && path && !strcmp( path, emu_device );
+}
+
+static double emu_now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec/1.0e9;
+}
+
+static void emu_sleep( double secs )
+{
+	struct timespec ts;
+
+	if ( secs <= 0 )
+		return;
+	ts.tv_sec = (time_t)secs;
+	ts.tv_nsec = (long)((secs - ts.tv_sec)*1.0e9);
+	while ( nanosleep( &ts, &ts ) < 0 && errno == EINTR )
+		;
+}
+
+static unsigned long emu_getu32( const unsigned char *p )
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/**
+ * Bring the drive's buffer up to date.
+ *
+ * @param now Current time.
+ *
+ * @return nothing.
+ */
+
+static void drv_run( double now )
+{
+	if ( !drv_moving || now <= drv_time )
+		return;				/* stopped, or still getting going */
+	drv_fill += (now - drv_time)*emu_rate;
+	drv_time = now;
+	if ( drv_fill >= emu_cap )
+	{
+		drv_fill = emu_cap;		/* nowhere to put any more, stop */
+		drv_moving = 0;
+		++st_stops;
+	}
+}
+
+/**
+ * Wait for the drive to have a record's worth of data in its buffer.
+ *
+ * @param len Bytes in record.
+ *
+ * @return nothing.
+ */
+
+static void drv_take( unsigned long len )
+{
+	double now, when;
+
+	if ( emu_rate <= 0 )
+		return;
+	now = emu_now();
+	drv_run( now );
+	if ( !drv_moving && drv_fill < emu_cap )
+	{
+		drv_moving = 1;			/* room again, back up and get going */
+		drv_time = now + emu_repos;
+		++st_repos;
+	}
+	if ( drv_fill < len )
+	{
+		when = drv_time + (len - drv_fill)/emu_rate;
+		emu_sleep( when - now );
+		st_wait += when - now;
+		drv_run( when );
+	}
+	drv_fill -= len;
+	if ( drv_fill < 0 )
+		drv_fill = 0;
+}
+
+/**
+ * Move the tape somewhere else. Whatever the drive had buffered is lost.
+ *
+ * @return nothing.
+ */
+
+static void drv_locate( void )
+{
+	if ( emu_rate <= 0 )
+		return;
+	emu_sleep( emu_repos );
+	st_wait += emu_repos;
+	++st_repos;
+	drv_fill = 0;
+	drv_moving = 1;
+	drv_time = emu_now();
+}
+
+/**
+ * Read the length of the record at a position in the image.
+ *
+ * @param pos Offset in image.
+ * @param len Pointer to place to deposit length.
+ *
+ * @return 0 if there is no more image.
+ */
+
+static int emu_reclen( off_t pos, unsigned long *len )
+{
+	unsigned char hdr[4];
+
+	if ( pread( emu_fd, hdr, 4, pos ) != 4 )
+		return 0;
+	*len = emu_getu32( hdr );
+	return *len <= 0x7FFFFFFFUL;
+}
+
+/**
+ * Space forward over tape marks.
+ *
+ * @param count Number of them.
+ *
+ * @return 0 if success, else -1 (end of data reached).
+ */
+
+static int emu_fsf( int count )
+{
+	unsigned long len;
+
+	drv_locate();
+	while ( count > 0 )
+	{
+		if ( !emu_reclen( emu_pos, &len ) )
+		{
+			emu_ateod = 1;
+			return -1;
+		}
+		emu_pos += 4;
+		if ( !len )
+		{
+			--count;
+			++emu_fileno;
+			emu_blkno = 0;
+			continue;
+		}
+		emu_pos += len + (emu_simh ? 4 : 0);
+	}
+	return 0;
+}
+
+/**
+ * Space backward over tape marks, leaving the tape in front of the last one.
+ *
+ * @param count Number of them.
+ *
+ * @return 0 if success, else -1 (beginning of tape reached).
+ *
+ * @note
+ * The image has to be walked from the start to do it.
+ */
+
+static int emu_bsf( int count )
+{
+	unsigned long len;
+	off_t pos = 0, *marks;
+	long nmarks = 0, ii;
+
+	marks = (off_t *)malloc( (emu_fileno + 1)*sizeof(off_t) );
+	if ( !marks )
+		return -1;
+	while ( nmarks < emu_fileno && emu_reclen( pos, &len ) )
+	{
+		if ( !len )
+			marks[nmarks++] = pos;
+		pos += 4 + (len ? len + (emu_simh ? 4 : 0) : 0);
+	}
+	drv_locate();
+	ii = nmarks - count;
+	if ( ii < 0 )
+	{
+		free( marks );
+		emu_pos = 0;
+		emu_fileno = emu_blkno = 0;
+		return -1;
+	}
+	emu_pos = marks[ii];
+	emu_fileno = ii;
+	emu_blkno = -1;			/* st doesn't know either */
+	free( marks );
+	return 0;
+}
+
+/**
+ * Write statistics to stderr.
+ *
+ * @return nothing.
+ */
+
+static void emu_stats( void )
+{
+	fprintf( stderr, "tapeemu: %lu records (%.1f MB) and %lu tape marks in %.3f secs",
+			 st_recs, st_bytes/(1024*1024), st_marks, emu_now() - st_start );
+	if ( emu_rate > 0 )
+		fprintf( stderr, ", drive stopped %lu times, repositioned %lu times, kept program waiting %.3f secs",
+				 st_stops, st_repos, st_wait );
+	fprintf( stderr, ".\n" );
+}
+
+/**
+ * See if the image has SIMH trailing counts.
+ *
+ * @return non-zero if the first few records all have them.
+ *
+ * @note
+ * A run of equal length records in a -i image looks like a SIMH one for
+ * a record or two, it's when the next length turns out to be data that
+ * it shows.
+ */
+
+static int emu_issimh( void )
+{
+	unsigned char buf[4];
+	unsigned long len;
+	off_t pos = 0;
+	int recs = 0;
+
+	while ( recs < EMU_PROBE_RECS && emu_reclen( pos, &len ) )
+	{
+		pos += 4;
+		if ( !len )
+			continue;
+		if ( len > EMU_MAXREC || pread( emu_fd, buf, 4, pos + len ) != 4 || emu_getu32( buf ) != len )
+			return 0;
+		pos += len + 4;
+		++recs;
+	}
+	return recs > 0;
+}
+
+/**
+ * Load the image into the emulated drive.
+ *
+ * @return file descriptor or -1.
+ */
+
+static int emu_load( void )
+{
+	if ( emu_fd >= 0 )
+	{
+		errno = EBUSY;
+		return -1;
+	}
+	emu_fd = real_open( emu_image, O_RDONLY );
+	if ( emu_fd < 0 )
+		return -1;
+	emu_simh = emu_issimh();
+	emu_pos = 0;
+	emu_fileno = emu_blkno = 0;
+	emu_ateod = 0;
+	drv_fill = 0;
+	drv_moving = 0;
+	st_recs = st_marks = st_stops = st_repos = 0;
+	st_bytes = st_wait = 0;
+	st_start = emu_now();
+	return emu_fd;
+}
+
+static void emu_fakestat( struct stat *st )
+{
+	st->st_mode = (st->st_mode & ~S_IFMT) | S_IFCHR;
+	st->st_rdev = makedev( 9, 128 );	/* nst0 */
+}
+
+static void emu_fakestat64( struct stat64 *st )
+{
+	st->st_mode = (st->st_mode & ~S_IFMT) | S_IFCHR;
+	st->st_rdev = makedev( 9, 128 );
+}
+
+int open( const char *path, int flags, ... )
+{
+	va_list ap;
+	int mode = 0, fd;
+
+	if ( flags & O_CREAT )
+	{
+		va_start( ap, flags );
+		mode = va_arg( ap, int );
+		va_end( ap );
+	}
+	if ( !emu_isdev( path ) )
+		return real_open( path, flags, mode );
+	pthread_mutex_lock( &emu_lock );
+	fd = emu_load();
+	pthread_mutex_unlock( &emu_lock );
+	return fd;
+}
+
+int open64( const char *path, int flags, ... )
+{
+	va_list ap;
+	int mode = 0;
+
+	if ( flags & O_CREAT )
+	{
+		va_start( ap, flags );
+		mode = va_arg( ap, int );
+		va_end( ap );
+	}
+	return open( path, flags | O_LARGEFILE, mode );
+}
+
+int __open_2( const char *path, int flags )
+{
+	return open( path, flags );
+}
+
+int __open64_2( const char *path, int flags )
+{
+	return open( path, flags | O_LARGEFILE );
+}
+
+int close( int fd )
+{
+	emu_init();
+	pthread_mutex_lock( &emu_lock );
+	if ( fd >= 0 && fd == emu_fd )
+	{
+		emu_stats();
+		emu_fd = -1;
+	}
+	pthread_mutex_unlock( &emu_lock );
+	return real_close( fd );
+}
+
+ssize_t read( int fd, void *buf, size_t len )
+{
+	unsigned long reclen;
+	ssize_t sts;
+
+	emu_init();
+	if ( fd < 0 || fd != emu_fd )
+		return real_read( fd, buf, len );
+	pthread_mutex_lock( &emu_lock );
+	if ( emu_ateod || !emu_reclen( emu_pos, &reclen ) )
+	{
+		emu_ateod = 1;
+		pthread_mutex_unlock( &emu_lock );
+		errno = EIO;			/* what st says past the end of data */
+		return -1;
+	}
+	drv_take( reclen );
+	if ( !reclen )
+	{
+		emu_pos += 4;
+		++emu_fileno;
+		emu_blkno = 0;
+		++st_marks;
+		pthread_mutex_unlock( &emu_lock );
+		return 0;
+	}
+	if ( reclen > len )
+	{
+		emu_pos += 4 + reclen + (emu_simh ? 4 : 0);
+		++emu_blkno;
+		pthread_mutex_unlock( &emu_lock );
+		errno = ENOMEM;			/* st in variable block mode won't truncate */
+		return -1;
+	}
+	sts = pread( emu_fd, buf, reclen, emu_pos + 4 );
+	if ( sts == (ssize_t)reclen )
+	{
+		emu_pos += 4 + reclen + (emu_simh ? 4 : 0);
+		++emu_blkno;
+		++st_recs;
+		st_bytes += reclen;
+	}
+	else if ( sts >= 0 )
+	{
+		emu_ateod = 1;			/* truncated image */
+		errno = EIO;
+		sts = -1;
+	}
+	pthread_mutex_unlock( &emu_lock );
+	return sts;
+}
+
+ssize_t __read_chk( int fd, void *buf, size_t len, size_t buflen )
+{
+	return read( fd, buf, len );
+}
+
+int ioctl( int fd, unsigned long req, ... )
+{
+	va_list ap;
+	void *arg;
+	struct mtop *op;
+	struct mtget *get;
+	int sts = 0;
+
+	va_start( ap, req );
+	arg = va_arg( ap, void * );
+	va_end( ap );
+	emu_init();
+	if ( fd < 0 || fd != emu_fd )
+		return real_ioctl( fd, req, arg );
+	pthread_mutex_lock( &emu_lock );
+	if ( req == MTIOCTOP )
+	{
+		op = (struct mtop *)arg;
+		switch ( op->mt_op )
+		{
+		case MTNOP:
+		case MTSETBLK:			/* records are whatever size they are */
+			break;
+		case MTREW:
+			drv_locate();
+			emu_pos = 0;
+			emu_fileno = emu_blkno = 0;
+			emu_ateod = 0;
+			break;
+		case MTFSF:
+			sts = emu_fsf( op->mt_count );
+			if ( sts )
+				errno = EIO;
+			break;
+		case MTBSF:
+			sts = emu_bsf( op->mt_count );
+			if ( sts )
+				errno = EIO;
+			break;
+		default:
+			errno = EINVAL;
+			sts = -1;
+			break;
+		}
+	}
+	else if ( req == MTIOCGET )
+	{
+		get = (struct mtget *)arg;
+		memset( get, 0, sizeof(*get) );
+		get->mt_type = MT_ISSCSI2;
+		get->mt_fileno = emu_fileno;
+		get->mt_blkno = emu_blkno;
+		get->mt_gstat = GMT_ONLINE(~0) | (emu_pos == 0 ? GMT_BOT(~0) : 0)
+			| (emu_blkno == 0 && emu_fileno ? GMT_EOF(~0) : 0) | (emu_ateod ? GMT_EOD(~0) : 0);
+	}
+	else
+	{
+		errno = EINVAL;
+		sts = -1;
+	}
+	pthread_mutex_unlock( &emu_lock );
+	return sts;
+}
+
+off_t lseek( int fd, off_t off, int whence )
+{
+	emu_init();
+	if ( fd >= 0 && fd == emu_fd )
+	{
+		errno = ESPIPE;			/* can't seek a tape */
+		return -1;
+	}
+	return real_lseek( fd, off, whence );
+}
+
+off64_t lseek64( int fd, off64_t off, int whence )
+{
+	emu_init();
+	if ( fd >= 0 && fd == emu_fd )
+	{
+		errno = ESPIPE;
+		return -1;
+	}
+	return real_lseek64( fd, off, whence );
+}
+
+int stat( const char *path, struct stat *st )
+{
+	int sts;
+
+	if ( !emu_isdev( path ) )
+		return real_stat ? real_stat( path, st ) : real_xstat( _STAT_VER, path, st );
+	sts = real_stat ? real_stat( emu_image, st ) : real_xstat( _STAT_VER, emu_image, st );
+	if ( !sts )
+		emu_fakestat( st );
+	return sts;
+}
+
+int stat64( const char *path, struct stat64 *st )
+{
+	int sts;
+
+	if ( !emu_isdev( path ) )
+		return real_stat64 ? real_stat64( path, st ) : real_xstat64( _STAT_VER, path, st );
+	sts = real_stat64 ? real_stat64( emu_image, st ) : real_xstat64( _STAT_VER, emu_image, st );
+	if ( !sts )
+		emu_fakestat64( st );
+	return sts;
+}
+
+int fstat( int fd, struct stat *st )
+{
+	int sts;
+
+	emu_init();
+	sts = real_fstat ? real_fstat( fd, st ) : real_fxstat( _STAT_VER, fd, st );
+	if ( !sts && fd >= 0 && fd == emu_fd )
+		emu_fakestat( st );
+	return sts;
+}
+
+int fstat64( int fd, struct stat64 *st )
+{
+	int sts;
+
+	emu_init();
+	sts = real_fstat64 ? real_fstat64( fd, st ) : real_fxstat64( _STAT_VER, fd, st );
+	if ( !sts && fd >= 0 && fd == emu_fd )
+		emu_fakestat64( st );
+	return sts;
+}
+
+int __xstat( int ver, const char *path, struct stat *st )
+{
+	int sts;
+
+	if ( !emu_isdev( path ) )
+		return real_xstat( ver, path, st );
+	sts = real_xstat( ver, emu_image, st );
+	if ( !sts )
+		emu_fakestat( st );
+	return sts;
+}
+
+int __xstat64( int ver, const char *path, struct stat64 *st )
+{
+	int sts;
+
+	if ( !emu_isdev( path ) )
+		return real_xstat64( ver, path, st );
+	sts = real_xstat64( ver, emu_image, st );
+	if ( !sts )
+		emu_fakestat64( st );
+	return sts;
+}
+
+int __fxstat( int ver, int fd, struct stat *st )
+{
+	int sts;
+
+	emu_init();
+	sts = real_fxstat( ver, fd, st );
+	if ( !sts && fd >= 0 && fd == emu_fd )
+		emu_fakestat( st );
+	return sts;
+}
+
+int __fxstat64( int ver, int fd, struct stat64 *st )
+{
+	int sts;
+
+	emu_init();
+	sts = real_fxstat64( ver, fd, st );
+	if ( !sts && fd >= 0 && fd == emu_fd )
+		emu_fakestat64( st );
+	return sts;
+}
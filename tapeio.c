@@ -0,0 +1,2487 @@
+/**
+ * @file tapeio.c
+ */
+
+/**
+ * Record level input from tape image files.
+ *
+ * The -i and -I image formats are parsed here. When the image is a
+ * regular file it is memory mapped and the record framing is picked
+ * straight out of the mapping, so getting the next record costs no
+ * system calls at all (the old way was two or three read()'s per
+ * record). Only a window of the image is mapped at any one time and
+ * it is slid along the file as the records are consumed so a 32 bit
+ * build can still walk an image of many gigabytes.
+ *
+ * Anything that cannot be mapped (pipes, FIFO's, devices) is pulled
+ * in with large read()'s into a buffer and the framing is parsed out
+ * of that. The buffer has a carry area in front of the read area so
+ * a record straddling the end of a chunk is made contiguous by moving
+ * just its leading part down in front of the next chunk. That is the
+ * only time any data is moved.
+ *
+ * With --direct the image is read with O_DIRECT so a huge image doesn't
+ * push everything else out of the page cache. The buffers are aligned
+ * and the reads are whole chunks at chunk aligned offsets to suit. If
+ * the filesystem won't do O_DIRECT the image is read normally and the
+ * kernel is told to drop each chunk from the page cache once read.
+ *
+ * With --uring a regular file is instead read with io_uring, which
+ * keeps several chunk sized reads in flight ahead of the parsing. Each
+ * read has its own buffer laid out like the one above. If the kernel
+ * doesn't have io_uring the image is mapped or read() as usual.
+ *
+ * A compressed image is always read through the buffer, the bytes
+ * coming from dc_read() (see decomp.c) instead of read().
+ *
+ * Tape devices have real records so they are simply read() one record
+ * at a time.
+ *
+ * Several volumes (-f given more than once) are read as one long tape.
+ * The double tape mark at the end of each volume becomes a single one
+ * and a saveset continued on the next volume (EOV labels) is spliced
+ * back together, checking the block headers' volume numbers follow on,
+ * so the decoder never knows. The next volume is opened, and the start
+ * of it read in, before the end of the current one is reached.
+ *
+ * Unless it's a tape device, the first few records are looked at before
+ * anything else is done to work out how the image is framed. A SIMH
+ * image has to have matching trailing counts, a -i image lengths that
+ * chain from one record to the next. A disk saveset (.BCK) starts right
+ * off with a block header and is nothing but blocks, so labels and tape
+ * marks are made up around them to make it look like a tape.
+ *
+ * Skipping a saveset (-n, -s) doesn't read it. On an image that can be
+ * seeked only the record lengths are read and the data in between is
+ * jumped over. A tape is spaced forward to the next tape mark (MTFSF).
+ * A run of blocks the caller knows it doesn't want (tio_skipn()) is
+ * jumped over the same way, except on a tape where it's just read.
+ *
+ * Where threads are available the reading is done by a reader thread
+ * running ahead of the decoder. It deposits each record, with the block
+ * number already checked out if the record looks like a saveset block,
+ * into a ring of entries that is handed over with nothing more than a
+ * pair of atomic counters. A mutex and condition variable are only
+ * touched when one side has to sleep because the ring is full or empty.
+ * A reader that finds the ring full waits until it is half empty, not
+ * just until there's room for one more, so the two sides aren't woken
+ * for every record once the reader has got ahead (it always does on a
+ * mapped image). The time each side spends asleep is counted and shown
+ * by --stats.
+ *
+ * The reader thread never opens a volume itself. At the end of one it
+ * asks for the next at its place in the ring and waits. tio_record()
+ * opens it once the records in front have all been handed out and
+ * hands it back. To quit, the reader is told to stop and sent a signal
+ * that gets it out of any read() it's stuck in.
+ *
+ * A tape drive gets a much deeper ring (--tapebuf MB of it) because a
+ * drive that has to stop for want of somewhere to put the data has to
+ * back up and get going again, which takes far longer than the read it
+ * was waiting to do. Waiting for the ring to be half empty before
+ * reading again also means each time the drive starts it gets a good
+ * long run instead of stopping again after one record. The position
+ * the drive was at each time it had to stop is asked for with MTIOCGET
+ * and shown by --stats.
+ */
+
+#define _GNU_SOURCE		/* for madvise() and clock_gettime() */
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#if HAVE_DIRECTIO
+#include	<fcntl.h>
+#endif
+#if HAVE_MTIO
+#include	<sys/ioctl.h>
+#include	<sys/mtio.h>
+#endif
+#if HAVE_MMAP
+#include	<sys/mman.h>
+#endif
+#if HAVE_PTHREAD
+#include	<pthread.h>
+#include	<signal.h>
+#include	<time.h>
+#endif
+#if HAVE_URING
+#include	<sys/mman.h>
+#include	<sys/uio.h>
+#include	<sys/syscall.h>
+#include	<linux/io_uring.h>
+#endif
+
+#include	"tapeio.h"
+#include	"decomp.h"
+#include	"saveset.h"
+
+/*
+ * The window must be big enough to hold the largest record a saveset
+ * can have (64KB plus framing) many times over. 64MB is small enough
+ * to always find room in a 32 bit address space.
+ */
+#ifndef TIO_MAP_WINDOW
+	#define TIO_MAP_WINDOW (64*1024*1024)	/*!< number of bytes of image mapped at once */
+#endif
+
+#define TIO_BUFSIZE_DEF	(4)	/*!< default size of read buffer in MB */
+#define TIO_READAHEAD_DEF (32)	/*!< default number of records the reader thread may get ahead */
+#define TIO_TAPEBUF_DEF	(64)	/*!< default size of reader thread's ring for a tape drive in MB */
+
+int tio_bufsize = TIO_BUFSIZE_DEF;	/*!< size of read buffer in MB (--inbuf) */
+int tio_nomap;				/*!< don't memory map images (--nomap) */
+int tio_readahead = TIO_READAHEAD_DEF;	/*!< records to read ahead in a thread (--readahead, 0=don't) */
+int tio_uring;				/*!< number of io_uring reads to keep in flight (--uring, 0=don't) */
+int tio_direct;				/*!< keep image out of the page cache (--direct) */
+int tio_tapebuf = TIO_TAPEBUF_DEF;	/*!< MB of records to read ahead of a tape drive (--tapebuf, 0=don't) */
+int tio_hugepages;			/*!< ask for transparent huge pages for the block slab (--hugepages) */
+
+#define TIO_PROBE_RECS	(8)		/*!< records whose framing has to hold up */
+#define TIO_PROBE_SPAN	(256*1024)	/*!< how far into the image to look (less than a chunk) */
+#define TIO_PREFETCH	(16*1024*1024)	/*!< how much of the next volume to have read in ahead of time */
+#define TIO_SLAB_ALIGN	(4096)		/*!< alignment of the block slab */
+#define TIO_SKIP_TM	(~0UL)		/*!< skip all records up to the next tape mark */
+#define TIO_HUGE_PAGE	(2*1024*1024)	/*!< size a huge page slab is rounded up to */
+
+/** Record as delivered by one of the record sources */
+struct tio_rec
+{
+	int len;		/*!< record length (0=tape mark, negative=error) */
+	unsigned char *data;	/*!< pointer to record's data */
+	unsigned long blknum;	/*!< block number if checked out by reader thread, else 0 */
+	int pinned;		/*!< data is in the mapped image and stays put until tio_close() */
+	unsigned long pos;	/*!< number of records before it (including ones skipped) */
+	off_t off;		/*!< image offset of its data (-1 if it isn't in an image) */
+	unsigned long count;	/*!< SIMH leading count ... */
+	unsigned long trailer;	/*!< ... and the trailing count that didn't match it */
+};
+
+static int tio_fmt;			/*!< framing of the image (one of TIO_FMT_xxx) */
+static int tio_fd = -1;		/*!< file descriptor of image (-1 if not active) */
+static int tio_hitend;		/*!< image has been read to the end */
+static off_t tio_pos;		/*!< image offset of next record's framing */
+static unsigned char *(*tio_window)( off_t pos, size_t need ); /*!< function to get bytes of image */
+static void (*tio_source)( struct tio_rec *rec, unsigned char *room ); /*!< function to get next record */
+static struct tio_rec tio_cur;	/*!< record most recently handed out by tio_record() */
+static unsigned char *raw_buf;	/*!< TIO_MAXREC bytes to read a record into */
+static unsigned long (*tio_skipper)( unsigned long count );	/*!< function to skip records (NULL if it can't) */
+static int tio_canseek;		/*!< image can be read anywhere with pread() */
+static unsigned char *skip_buf;	/*!< 2*TIO_ALIGN bytes to read record lengths into */
+static unsigned long skip_recs;	/*!< records skipped without reading them */
+static double skip_bytes;	/*!< bytes in them */
+#if HAVE_MTIO
+static int raw_tmnext;		/*!< tape was spaced past a tape mark, report it next */
+#endif
+
+static int bck_state;		/*!< which made up record of a disk saveset is next */
+static int bck_bsize;		/*!< blocksize of disk saveset */
+static char bck_name[18];	/*!< saveset name for the made up labels */
+static char bck_label[SS_LABEL_SIZE+1];	/*!< made up label */
+
+static int (*vol_next)( int *format );	/*!< function to open next volume (NULL if just the one) */
+static int (*vol_ahead)( void );	/*!< function to open next volume ahead of time */
+static void (*vol_source)( struct tio_rec *rec, unsigned char *room ); /*!< record source of current volume */
+static struct tio_rec vol_peek;	/*!< record read to see what follows a tape mark */
+static unsigned char *vol_room;	/*!< TIO_MAXREC bytes to read vol_peek into */
+static int vol_havepeek;	/*!< vol_peek is to be handed out next */
+static int vol_tm;		/*!< last record handed out was a tape mark */
+static int vol_ended;		/*!< ran out of volumes */
+static int vol_prefetched;	/*!< next volume has been opened ahead of time */
+static int vol_count;		/*!< number of volumes opened */
+static int vol_bsize;		/*!< blocksize from last HDR2 */
+static int vol_volnum;		/*!< volume number in last block */
+static int vol_expect;		/*!< volume number the next block should have (0=don't check) */
+static char vol_ssname[15];	/*!< saveset name from last HDR1 */
+static off_t vol_size;		/*!< size of current volume if a regular file, else 0 */
+
+static unsigned char *buf_mem;	/*!< carry area followed by read area */
+static size_t buf_chunk;	/*!< size of read area */
+static unsigned char *buf_lo;	/*!< pointer to first valid byte in buf_mem */
+static unsigned char *buf_hi;	/*!< pointer to byte past last valid byte in buf_mem */
+static off_t buf_off;		/*!< image offset of buf_lo */
+static int buf_canseek;		/*!< input can be lseek()'d over */
+static int buf_eof;		/*!< last read came up short */
+
+/*
+ * The carry area is rounded up so the read area that follows it stays
+ * aligned for O_DIRECT.
+ */
+#define TIO_ALIGN	(4096)		/*!< alignment of read areas, offsets and sizes */
+#define BUF_CARRY	(TIO_MAXREC+TIO_ALIGN)	/*!< size of carry area (largest record plus framing) */
+
+#if HAVE_DIRECTIO
+static int dio_on;		/*!< image is being read with O_DIRECT */
+static int dio_fadvise;		/*!< couldn't do O_DIRECT, use posix_fadvise() instead */
+#endif
+
+#if HAVE_MMAP
+static off_t map_size;		/*!< size of image in bytes */
+static unsigned char *map_base;	/*!< pointer to start of mapped window */
+static off_t map_off;		/*!< image offset of map_base */
+static size_t map_len;		/*!< number of bytes in mapped window */
+static off_t map_pgmask;	/*!< mask to page align an image offset */
+static int map_whole;		/*!< the whole image is mapped in one go */
+static off_t map_dropped;	/*!< image offset up to which pages have been let go */
+static unsigned long map_inplace;	/*!< records handed out in place (not copied) */
+
+/** Mapping of a volume gone by that blocks may still be pointing into */
+struct tio_map
+{
+	unsigned char *base;	/*!< start of mapping */
+	size_t len;		/*!< number of bytes mapped */
+	struct tio_map *next;	/*!< next one */
+};
+static struct tio_map *map_kept;	/*!< list of them */
+#endif
+
+#if HAVE_URING
+/*
+ * The io_uring backend keeps a slot per read in flight. Each slot has
+ * a carry area in front of its read area, same as buf_mem, and the
+ * buf_lo/buf_hi/buf_off variables describe the slot being parsed.
+ */
+#define UR_MAXDEPTH	(64)		/*!< most reads to have in flight */
+#define UR_INFLIGHT	(-0x7FFFFFFF)	/*!< ur_len[] of a slot still being read */
+
+static int ur_fd = -1;		/*!< io_uring file descriptor */
+static unsigned int ur_depth;	/*!< number of slots */
+static unsigned int ur_cur;	/*!< slot being parsed */
+static unsigned char *ur_mem;	/*!< ur_depth slots of BUF_CARRY + buf_chunk bytes */
+static struct iovec ur_iov[UR_MAXDEPTH];	/*!< read area of each slot */
+static off_t ur_off[UR_MAXDEPTH];	/*!< image offset of each slot's read area */
+static int ur_len[UR_MAXDEPTH];	/*!< bytes read into each slot (or UR_INFLIGHT) */
+static int ur_pending;		/*!< reads submitted but not yet reaped */
+static off_t ur_next;		/*!< image offset of next chunk to ask for */
+static off_t ur_size;		/*!< size of image in bytes */
+static unsigned long ur_reads;	/*!< reads submitted */
+static unsigned long ur_waits;	/*!< times parsing had to wait for a read */
+
+static void *ur_sq_ptr, *ur_cq_ptr;	/*!< mapped submission and completion rings */
+static size_t ur_sq_sz, ur_cq_sz, ur_sqes_sz;
+static struct io_uring_sqe *ur_sqes;	/*!< mapped submission entries */
+static struct io_uring_cqe *ur_cqes;	/*!< completion entries */
+static unsigned int *ur_sq_tail, *ur_sq_mask, *ur_sq_array;
+static unsigned int *ur_cq_head, *ur_cq_tail, *ur_cq_mask;
+static int ur_active;		/*!< image is being read with io_uring */
+#endif
+
+static unsigned char *slab_mem;	/*!< block slab (TIO_SLAB_ALIGN aligned) */
+static size_t slab_size;	/*!< bytes in block slab */
+static void *slab_raw;		/*!< what malloc() returned for it (NULL if mapped) */
+static int slab_huge;		/*!< huge pages were asked for */
+
+#if HAVE_PTHREAD
+/*
+ * The ring counters only ever increase. The reader owns ring_put and
+ * the consumer owns ring_got, each only reads the other's. Sequentially
+ * consistent loads and stores make sure that a side about to sleep
+ * either sees the other side's progress or gets woken by it.
+ */
+#define RING_LOAD(v)	__atomic_load_n( &(v), __ATOMIC_SEQ_CST )
+#define RING_STORE(v,n)	__atomic_store_n( &(v), (n), __ATOMIC_SEQ_CST )
+
+static struct tio_rec *ring;	/*!< ring of records read ahead */
+static unsigned char *ring_mem;	/*!< TIO_MAXREC bytes of data for each ring entry */
+static unsigned int ring_mask;	/*!< number of ring entries minus 1 (it's a power of 2) */
+static unsigned int ring_resume;	/*!< reader finding ring full waits until just this many are left */
+static unsigned int ring_put;	/*!< count of records put in the ring */
+static unsigned int ring_got;	/*!< count of records released by the consumer */
+static int ring_held;		/*!< consumer still using the entry at ring_got */
+static int ring_done;		/*!< reader has quit */
+static int ring_stop;		/*!< reader is to quit */
+static unsigned int ring_skipreq;	/*!< 1 + index of first record consumer doesn't want (0=none) */
+static unsigned long ring_skipto;	/*!< position of next record consumer wants (0=none) */
+static int rdr_sleeping;	/*!< reader is waiting for room in the ring */
+static int cons_sleeping;	/*!< consumer is waiting for a record */
+static int rdr_running;		/*!< reader thread has been started */
+static pthread_t rdr_thread;	/*!< the reader thread */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;	/*!< only for sleeping */
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;	/*!< only for sleeping */
+static int vol_wantnext;	/*!< reader is waiting for the consumer to open the next volume */
+static unsigned int vol_nextat;	/*!< ring position the consumer has to be at to do it */
+static int vol_nextfd;		/*!< what vol_next() returned for it */
+static int vol_nextfmt;		/*!< and the framing it deposited */
+static int vol_wantahead;	/*!< reader wants the next volume opened ahead of time */
+static unsigned int vol_aheadat;	/*!< ring position the consumer has to be at to do it */
+
+static unsigned long ring_records;	/*!< records passed through the ring */
+static unsigned long rdr_stalls;	/*!< times reader found the ring full */
+static unsigned long cons_stalls;	/*!< times consumer found the ring empty */
+static double rdr_stall;		/*!< seconds reader spent waiting */
+static double cons_stall;		/*!< seconds consumer spent waiting */
+#if HAVE_MTIO
+static int tape_posok;		/*!< MTIOCGET worked at the last stop */
+static long tape_fileno;	/*!< file number the drive was at when it last had to stop */
+static long tape_blkno;		/*!< block number within that file */
+#endif
+
+#define RDR_SIGNAL	SIGUSR1		/*!< signal sent to get the reader thread out of a read() */
+#define TIO_QUITTING()	RING_LOAD(ring_stop)	/*!< reader has been told to quit */
+
+static void ring_wake( void );
+#else
+#define TIO_QUITTING()	(0)
+#endif
+
+#if HAVE_MMAP
+/**
+ * Get pointer to bytes in the image.
+ *
+ * @param pos Offset in image of first byte.
+ * @param need Number of contiguous bytes required.
+ *
+ * @return Pointer to bytes or NULL if image ends before pos+need.
+ *
+ * @note
+ * The returned pointer is only good until the next call since the
+ * window may be moved to satisfy it. Unless the whole image is mapped,
+ * then it's good until tio_close(). Pages well behind are let go of
+ * but a block still pointing there just reads them in again.
+ */
+
+static unsigned char *map_window( off_t pos, size_t need )
+{
+	off_t start;
+	size_t len;
+	void *mp;
+
+	if ( pos + (off_t)need > map_size )
+		return NULL;			/* not that much left in image */
+	if ( map_whole && map_base && pos - map_dropped > 2*(off_t)TIO_MAP_WINDOW )
+	{
+		start = (pos - TIO_MAP_WINDOW) & map_pgmask;	/* let go of pages well behind */
+		madvise( map_base + map_dropped, start - map_dropped, MADV_DONTNEED );
+		map_dropped = start;
+	}
+	if ( map_base && pos >= map_off && pos + (off_t)need <= map_off + (off_t)map_len )
+		return map_base + (pos - map_off);	/* already in window */
+	if ( map_base )
+	{
+		munmap( map_base, map_len );	/* toss old window */
+		map_base = NULL;
+	}
+	start = pos & map_pgmask;
+	len = map_whole ? (size_t)map_size : TIO_MAP_WINDOW;
+	if ( len < (size_t)(pos - start) + need )
+		len = (pos - start) + need;	/* ridiculous record length, but try anyway */
+	if ( (off_t)len > map_size - start )
+		len = map_size - start;		/* don't map past end of image */
+	mp = mmap( NULL, len, PROT_READ, MAP_PRIVATE, tio_fd, start );
+	if ( mp == MAP_FAILED )
+	{
+		printf( "Snark: Failed to map %lu bytes of image at offset %lld: %s\n",
+				(unsigned long)len, (long long)start, strerror(errno) );
+		return NULL;
+	}
+	madvise( mp, len, MADV_SEQUENTIAL );
+	map_base = (unsigned char *)mp;
+	map_off = start;
+	map_len = len;
+	return map_base + (pos - map_off);
+}
+
+/**
+ * Setup to map the image.
+ *
+ * @return non-zero if the image can be mapped.
+ *
+ * @note
+ * With a 64 bit address space the whole image is mapped so records can
+ * be handed out in place (see tio_pinned()).
+ */
+
+static int map_open( void )
+{
+	struct stat st;
+
+	if ( fstat( tio_fd, &st ) < 0 || !S_ISREG(st.st_mode) )
+		return 0;			/* can only map regular files */
+	map_pgmask = ~(off_t)(sysconf( _SC_PAGESIZE ) - 1);
+	map_size = st.st_size;
+	map_whole = sizeof(size_t) >= 8 && (off_t)(size_t)map_size == map_size;
+	map_dropped = 0;
+	if ( map_size && !map_window( 0, 4 ) )
+		return 0;			/* mapping doesn't work, read() it instead */
+	return 1;
+}
+
+/**
+ * Check if a record can be handed out in place.
+ *
+ * @param data Pointer to record's data.
+ *
+ * @return non-zero if it's in a mapping that stays put until tio_close().
+ */
+
+static int map_holds( const unsigned char *data )
+{
+	return map_whole && map_base && data >= map_base && data < map_base + map_len;
+}
+
+/**
+ * Let go of the image's mapping.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ * A whole image mapping is kept until tio_close() since blocks read
+ * ahead may still be in it when the next volume is opened.
+ */
+
+static void map_close( void )
+{
+	struct tio_map *mp;
+
+	if ( !map_base )
+		return;
+	if ( !map_whole )
+		munmap( map_base, map_len );
+	else
+	{
+		mp = (struct tio_map *)malloc( sizeof(struct tio_map) );
+		if ( !mp )
+		{
+			printf( "Snark: Failed to malloc %d bytes for image mapping.\n", (int)sizeof(struct tio_map) );
+			exit(1);
+		}
+		mp->base = map_base;
+		mp->len = map_len;
+		mp->next = map_kept;
+		map_kept = mp;
+	}
+	map_base = NULL;
+}
+#endif
+
+/**
+ * Drop bytes just read from the page cache if asked to.
+ *
+ * @param off Image offset of first byte.
+ * @param len Number of bytes.
+ *
+ * @return nothing.
+ */
+
+static void tio_dontneed( off_t off, size_t len )
+{
+#if HAVE_DIRECTIO
+	if ( dio_fadvise && len )
+		posix_fadvise( tio_fd, off, len, POSIX_FADV_DONTNEED );
+#endif
+}
+
+#if HAVE_DIRECTIO
+/**
+ * Give up on O_DIRECT and just keep the page cache clean instead.
+ *
+ * @return nothing.
+ */
+
+static void dio_off( void )
+{
+	int flags;
+
+	flags = fcntl( tio_fd, F_GETFL );
+	if ( flags != -1 )
+		fcntl( tio_fd, F_SETFL, flags & ~O_DIRECT );
+	dio_on = 0;
+	dio_fadvise = 1;
+	posix_fadvise( tio_fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+}
+
+/**
+ * Switch image to O_DIRECT.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Pipes and such don't go through the page cache so are left alone.
+ * If the filesystem won't do O_DIRECT the page cache is advised instead.
+ */
+
+static void dio_open( void )
+{
+	struct stat st;
+	int flags;
+
+	if ( fstat( tio_fd, &st ) < 0 || (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode)) )
+		return;
+	flags = fcntl( tio_fd, F_GETFL );
+	if ( flags != -1 && fcntl( tio_fd, F_SETFL, flags | O_DIRECT ) == 0 )
+		dio_on = 1;
+	else
+		dio_off();
+}
+#endif
+
+/**
+ * Get memory for input buffers.
+ *
+ * @param size Number of bytes.
+ *
+ * @return Pointer to memory aligned to TIO_ALIGN or NULL if none.
+ */
+
+static void *tio_alloc( size_t size )
+{
+#if HAVE_DIRECTIO
+	void *mem;
+
+	return posix_memalign( &mem, TIO_ALIGN, size ) ? NULL : mem;
+#else
+	return malloc( size );
+#endif
+}
+
+/**
+ * Read a whole chunk of the input.
+ *
+ * @param dst Pointer to read area.
+ * @param off Image offset the read starts at.
+ *
+ * @return Number of bytes read (less than a chunk only at end of input) or -1 on error.
+ */
+
+static ssize_t buf_read( unsigned char *dst, off_t off )
+{
+	size_t have = 0;
+	ssize_t sts;
+
+	while ( have < buf_chunk )
+	{
+		if ( dc_active() )
+			sts = dc_read( dst + have, buf_chunk - have );
+		else
+			sts = read( tio_fd, dst + have, buf_chunk - have );
+		if ( sts < 0 && errno == EINTR && !TIO_QUITTING() )
+			continue;
+#if HAVE_DIRECTIO
+		if ( sts < 0 && errno == EINVAL && dio_on )
+		{
+			dio_off();			/* filesystem took the flag but won't do it */
+			continue;
+		}
+#endif
+		if ( sts < 0 )
+			return -1;
+		if ( !sts )
+			break;
+		have += sts;
+	}
+	tio_dontneed( off, have );
+	return have;
+}
+
+/**
+ * Get pointer to bytes in the input.
+ *
+ * @param pos Offset in image of first byte.
+ * @param need Number of contiguous bytes required (never more than BUF_CARRY).
+ *
+ * @return Pointer to bytes or NULL if input ends before pos+need.
+ *
+ * @note
+ * The input only moves forward. Anything ahead of @e pos is discarded.
+ * The returned pointer is only good until the next call.
+ * The input is only ever read a whole chunk at a time at chunk aligned
+ * offsets into an aligned read area, which is what O_DIRECT requires.
+ */
+
+static unsigned char *buf_window( off_t pos, size_t need )
+{
+	unsigned char *chunk = buf_mem + BUF_CARRY;
+	off_t end, skip;
+	size_t tail;
+	ssize_t sts;
+
+	if ( pos < buf_off )
+		return NULL;			/* can't back up */
+	while ( pos + (off_t)need > (end = buf_off + (buf_hi - buf_lo)) )
+	{
+		if ( buf_eof )
+			return NULL;
+		tail = 0;
+		if ( pos < end )
+		{
+			/* record straddles end of read area, move its head down into the carry area */
+			tail = end - pos;
+			memmove( chunk - tail, buf_hi - tail, tail );
+		}
+		else if ( buf_canseek && (skip = ((pos - end)/buf_chunk)*buf_chunk) )
+		{
+			/* seek over whole chunks nobody wants, otherwise they are read and tossed */
+			if ( lseek( tio_fd, skip, SEEK_CUR ) == (off_t)-1 )
+				return NULL;
+			end += skip;
+		}
+		sts = buf_read( chunk, end );
+		if ( sts < 0 )
+		{
+			if ( !TIO_QUITTING() )
+				printf( "Snark: Failed to read image: %s\n", strerror(errno) );
+			return NULL;
+		}
+		buf_lo = chunk - tail;
+		buf_hi = chunk + sts;
+		buf_off = end - tail;
+		if ( (size_t)sts < buf_chunk )
+			buf_eof = 1;			/* that's all there is */
+	}
+	return buf_lo + (pos - buf_off);
+}
+
+/**
+ * Set size of the chunks the image is read in.
+ *
+ * @return nothing.
+ */
+
+static void buf_setchunk( void )
+{
+	if ( tio_bufsize < 1 )
+		tio_bufsize = 1;
+	if ( tio_bufsize > 16 )
+		tio_bufsize = 16;
+	buf_chunk = (size_t)tio_bufsize*1024*1024;
+}
+
+/**
+ * Setup to read the image through the buffer.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static void buf_open( void )
+{
+	struct stat st;
+
+	buf_setchunk();
+	buf_mem = (unsigned char *)tio_alloc( BUF_CARRY + buf_chunk );
+	if ( !buf_mem )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for input buffer.\n", (unsigned long)(BUF_CARRY + buf_chunk) );
+		exit(1);
+	}
+	buf_lo = buf_hi = buf_mem + BUF_CARRY;
+	buf_off = 0;
+	buf_eof = 0;
+	buf_canseek = !dc_active() && fstat( tio_fd, &st ) == 0 && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))
+				  && lseek( tio_fd, 0, SEEK_CUR ) != (off_t)-1;
+}
+
+#if HAVE_URING
+/**
+ * Enter the kernel to submit reads and/or wait for them.
+ *
+ * @param submit Number of reads just queued.
+ * @param wait Number of completions to wait for.
+ *
+ * @return 0 on success, -1 on error.
+ */
+
+static int ur_enter( unsigned int submit, unsigned int wait )
+{
+	long sts;
+
+	do
+		sts = syscall( __NR_io_uring_enter, ur_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+	while ( sts < 0 && errno == EINTR && !TIO_QUITTING() );
+	if ( sts < 0 )
+		return -1;
+	ur_pending += sts;
+	return (unsigned long)sts == submit ? 0 : -1;
+}
+
+/**
+ * Collect completed reads.
+ *
+ * @return nothing.
+ */
+
+static void ur_reap( void )
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head;
+
+	head = *ur_cq_head;
+	while ( head != __atomic_load_n( ur_cq_tail, __ATOMIC_ACQUIRE ) )
+	{
+		cqe = ur_cqes + (head & *ur_cq_mask);
+		ur_len[cqe->user_data] = cqe->res;
+		--ur_pending;
+		++head;
+	}
+	__atomic_store_n( ur_cq_head, head, __ATOMIC_RELEASE );
+}
+
+/**
+ * Start read of next chunk of the image into a slot.
+ *
+ * @param slot Slot number.
+ *
+ * @return number of reads queued (0 or 1).
+ *
+ * @note
+ * If the image has been completely asked for already the slot is
+ * just marked as holding nothing.
+ */
+
+static unsigned int ur_submit( unsigned int slot )
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail;
+
+	ur_off[slot] = ur_next;
+	if ( ur_next >= ur_size )
+	{
+		ur_len[slot] = 0;			/* nothing left to read */
+		return 0;
+	}
+	ur_iov[slot].iov_base = ur_mem + (size_t)slot*(BUF_CARRY + buf_chunk) + BUF_CARRY;
+	ur_iov[slot].iov_len = buf_chunk;
+	tail = *ur_sq_tail;
+	sqe = ur_sqes + (tail & *ur_sq_mask);
+	memset( sqe, 0, sizeof(*sqe) );
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = tio_fd;
+	sqe->off = ur_next;
+	sqe->addr = (unsigned long)(ur_iov + slot);
+	sqe->len = 1;
+	sqe->user_data = slot;
+	ur_sq_array[tail & *ur_sq_mask] = tail & *ur_sq_mask;
+	__atomic_store_n( ur_sq_tail, tail + 1, __ATOMIC_RELEASE );
+	ur_len[slot] = UR_INFLIGHT;
+	ur_next += buf_chunk;
+	++ur_reads;
+	return 1;
+}
+
+/**
+ * Wait for read into a slot to complete.
+ *
+ * @param slot Slot number.
+ *
+ * @return number of bytes in slot or -1 on error.
+ */
+
+static int ur_wait( unsigned int slot )
+{
+	size_t have;
+	ssize_t sts;
+
+	if ( ur_len[slot] == UR_INFLIGHT )
+	{
+		while ( 1 )
+		{
+			ur_reap();
+			if ( ur_len[slot] != UR_INFLIGHT )
+				break;
+			++ur_waits;				/* decoder caught up with the reads */
+			if ( ur_enter( 0, 1 ) )
+				return -1;
+		}
+		if ( ur_len[slot] < 0 )
+		{
+			errno = -ur_len[slot];
+			return -1;
+		}
+		/* a short read anywhere but the end of the image gets finished the slow way */
+		have = ur_len[slot];
+		while ( have < buf_chunk && ur_off[slot] + (off_t)have < ur_size )
+		{
+			sts = pread( tio_fd, (char *)ur_iov[slot].iov_base + have, buf_chunk - have, ur_off[slot] + have );
+			if ( sts < 0 && errno == EINTR && !TIO_QUITTING() )
+				continue;
+			if ( sts <= 0 )
+				return -1;
+			have += sts;
+		}
+		tio_dontneed( ur_off[slot], have );
+		ur_len[slot] = have;
+	}
+	return ur_len[slot];
+}
+
+/**
+ * Get reads going into all the slots.
+ *
+ * @param off Offset in image to start at.
+ *
+ * @return 0 if success or -1 on error.
+ *
+ * @note
+ * Any reads still in flight are waited for first since their slots are
+ * about to be reused.
+ */
+
+static int ur_start( off_t off )
+{
+	unsigned int ii, queued;
+
+	while ( ur_pending > 0 )
+	{
+		ur_reap();
+		if ( ur_pending > 0 && ur_enter( 0, 1 ) )
+			return -1;
+	}
+	ur_next = off & ~(off_t)(TIO_ALIGN - 1);
+	for ( queued = ii = 0; ii < ur_depth; ++ii )
+		queued += ur_submit( ii );		/* get all of them going */
+	if ( ur_enter( queued, 0 ) || ur_wait( 0 ) < 0 )
+		return -1;
+	ur_cur = 0;
+	buf_lo = ur_mem + BUF_CARRY;
+	buf_hi = buf_lo + ur_len[0];
+	buf_off = ur_off[0];
+	return 0;
+}
+
+/**
+ * Get pointer to bytes in the image.
+ *
+ * @param pos Offset in image of first byte.
+ * @param need Number of contiguous bytes required (never more than BUF_CARRY).
+ *
+ * @return Pointer to bytes or NULL if image ends before pos+need.
+ *
+ * @note
+ * Works like buf_window() except each chunk comes from a different
+ * slot. Moving on to the next slot carries over the unused tail of the
+ * current one and hands the current one back to the kernel to be
+ * filled with the chunk the farthest ahead. A jump past everything
+ * asked for (see frame_skip()) starts the reads over from there.
+ */
+
+static unsigned char *ur_window( off_t pos, size_t need )
+{
+	unsigned char *chunk;
+	unsigned int nxt;
+	size_t tail;
+	int len;
+
+	if ( pos < buf_off )
+		return NULL;			/* can't back up */
+	if ( pos >= ur_next && ur_start( pos ) )
+	{
+		/* skipped past everything asked for, started over from there but that failed */
+		printf( "Snark: Failed to read image: %s\n", strerror(errno) );
+		return NULL;
+	}
+	while ( pos + (off_t)need > buf_off + (buf_hi - buf_lo) )
+	{
+		if ( !ur_len[ur_cur] )
+			return NULL;			/* current slot was the end of image */
+		nxt = (ur_cur + 1) % ur_depth;
+		len = ur_wait( nxt );
+		if ( len < 0 )
+		{
+			if ( !TIO_QUITTING() )
+				printf( "Snark: Failed to read image: %s\n", strerror(errno) );
+			return NULL;
+		}
+		chunk = ur_mem + (size_t)nxt*(BUF_CARRY + buf_chunk) + BUF_CARRY;
+		tail = 0;
+		if ( pos < buf_off + (buf_hi - buf_lo) )
+		{
+			tail = buf_off + (buf_hi - buf_lo) - pos;	/* bring along what's from pos on */
+			memcpy( chunk - tail, buf_hi - tail, tail );
+		}
+		/* current slot is free to be read into again */
+		if ( ur_enter( ur_submit( ur_cur ), 0 ) )
+		{
+			printf( "Snark: Failed to queue read of image: %s\n", strerror(errno) );
+			return NULL;
+		}
+		ur_cur = nxt;
+		buf_lo = chunk - tail;
+		buf_hi = chunk + len;
+		buf_off = ur_off[nxt] - tail;
+	}
+	return buf_lo + (pos - buf_off);
+}
+
+/**
+ * Tear down the ring.
+ *
+ * @return nothing.
+ */
+
+static void ur_close( void )
+{
+	if ( ur_cq_ptr )
+	{
+		while ( ur_pending > 0 )
+		{
+			ur_reap();			/* wait for reads into ur_mem to finish before freeing it */
+			if ( ur_pending > 0 && ur_enter( 0, 1 ) )
+				break;
+		}
+	}
+	if ( ur_sqes )
+		munmap( ur_sqes, ur_sqes_sz );
+	if ( ur_cq_ptr && ur_cq_ptr != ur_sq_ptr )
+		munmap( ur_cq_ptr, ur_cq_sz );
+	if ( ur_sq_ptr )
+		munmap( ur_sq_ptr, ur_sq_sz );
+	if ( ur_fd >= 0 )
+		close( ur_fd );				/* cancels anything still in flight */
+	ur_fd = -1;
+	ur_sqes = NULL;
+	ur_sq_ptr = ur_cq_ptr = NULL;
+	if ( ur_mem )
+		free( ur_mem );
+	ur_mem = NULL;
+}
+
+/**
+ * Setup to read the image with io_uring.
+ *
+ * @return non-zero if io_uring is working.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ * Anything else going wrong just means the image will be read some
+ * other way.
+ */
+
+static int ur_open( void )
+{
+	struct io_uring_params p;
+	struct stat st;
+	size_t sz;
+
+	if ( fstat( tio_fd, &st ) < 0 || !S_ISREG(st.st_mode) )
+		return 0;				/* only regular files are worth it */
+	ur_size = st.st_size;
+	ur_depth = tio_uring > UR_MAXDEPTH ? UR_MAXDEPTH : tio_uring;
+	if ( ur_depth < 2 )
+		ur_depth = 2;				/* need one to parse while another is read */
+	memset( &p, 0, sizeof(p) );
+	ur_fd = syscall( __NR_io_uring_setup, ur_depth, &p );
+	if ( ur_fd < 0 )
+		return 0;				/* kernel doesn't have it (or it's not allowed) */
+	ur_sq_sz = p.sq_off.array + p.sq_entries*sizeof(unsigned int);
+	ur_cq_sz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if ( (p.features & IORING_FEAT_SINGLE_MMAP) && ur_cq_sz > ur_sq_sz )
+		ur_sq_sz = ur_cq_sz;
+	ur_sq_ptr = mmap( NULL, ur_sq_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur_fd, IORING_OFF_SQ_RING );
+	if ( ur_sq_ptr == MAP_FAILED )
+	{
+		ur_sq_ptr = NULL;
+		ur_close();
+		return 0;
+	}
+	if ( (p.features & IORING_FEAT_SINGLE_MMAP) )
+		ur_cq_ptr = ur_sq_ptr;
+	else
+	{
+		ur_cq_ptr = mmap( NULL, ur_cq_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur_fd, IORING_OFF_CQ_RING );
+		if ( ur_cq_ptr == MAP_FAILED )
+		{
+			ur_cq_ptr = NULL;
+			ur_close();
+			return 0;
+		}
+	}
+	ur_sqes_sz = p.sq_entries*sizeof(struct io_uring_sqe);
+	ur_sqes = (struct io_uring_sqe *)mmap( NULL, ur_sqes_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur_fd, IORING_OFF_SQES );
+	if ( (void *)ur_sqes == MAP_FAILED )
+	{
+		ur_sqes = NULL;
+		ur_close();
+		return 0;
+	}
+	ur_sq_tail = (unsigned int *)((char *)ur_sq_ptr + p.sq_off.tail);
+	ur_sq_mask = (unsigned int *)((char *)ur_sq_ptr + p.sq_off.ring_mask);
+	ur_sq_array = (unsigned int *)((char *)ur_sq_ptr + p.sq_off.array);
+	ur_cq_head = (unsigned int *)((char *)ur_cq_ptr + p.cq_off.head);
+	ur_cq_tail = (unsigned int *)((char *)ur_cq_ptr + p.cq_off.tail);
+	ur_cq_mask = (unsigned int *)((char *)ur_cq_ptr + p.cq_off.ring_mask);
+	ur_cqes = (struct io_uring_cqe *)((char *)ur_cq_ptr + p.cq_off.cqes);
+
+	buf_setchunk();
+	sz = (size_t)ur_depth*(BUF_CARRY + buf_chunk);
+	ur_mem = (unsigned char *)tio_alloc( sz );
+	if ( !ur_mem )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for input buffers.\n", (unsigned long)sz );
+		exit(1);
+	}
+	ur_pending = 0;
+	ur_reads = ur_waits = 0;
+	if ( ur_start( 0 ) )
+	{
+		ur_close();				/* something's not supported, do it the old way */
+		return 0;
+	}
+	return 1;
+}
+#endif
+
+/**
+ * Get next record from a tape device.
+ *
+ * @param rec Pointer to place to deposit record.
+ * @param room Pointer to TIO_MAXREC bytes into which to read it.
+ *
+ * @return nothing.
+ */
+
+static void raw_record( struct tio_rec *rec, unsigned char *room )
+{
+	int sts;
+
+#if HAVE_MTIO
+	if ( raw_tmnext )
+	{
+		raw_tmnext = 0;
+		rec->len = 0;			/* the tape mark raw_skip() spaced over */
+		rec->data = room;
+		return;
+	}
+#endif
+	do
+		sts = read( tio_fd, room, TIO_MAXREC );	/* a 0 is a tape mark, a -x is an error */
+	while ( sts < 0 && errno == EINTR && !TIO_QUITTING() );
+	rec->len = sts;
+	rec->data = room;
+}
+
+/**
+ * Get next record from a -i or -I image.
+ *
+ * @param rec Pointer to place to deposit record.
+ * @param room Not used. The record is left where tio_window() found it.
+ *
+ * @return nothing.
+ *
+ * @note
+ * A negative length indicates the SIMH counts don't match. Only the
+ * first TIO_MAXREC bytes of a longer record are available.
+ */
+
+static void frame_record( struct tio_rec *rec, unsigned char *room )
+{
+	unsigned char *hdr, *data;
+	unsigned long reclen, want, trailer;
+
+	rec->len = 0;
+	rec->data = NULL;
+	if ( tio_hitend )
+		return;
+	hdr = tio_window( tio_pos, 4 );
+	if ( !hdr )
+	{
+		tio_hitend = 1;			/* EOF looks like a tape mark */
+		return;
+	}
+	reclen = ss_getu32( hdr );
+	tio_pos += 4;
+	if ( !reclen )
+		return;				/* 0 length record is a tape mark */
+	if ( reclen > 0x7FFFFFFFUL )
+	{
+		tio_hitend = 1;			/* framing is garbage, nothing more can be found */
+		return;
+	}
+	trailer = (tio_fmt == TIO_FMT_SIMH) ? 4 : 0;
+	want = reclen;
+	if ( want > TIO_MAXREC )
+		want = TIO_MAXREC;		/* just the head of an oversize record */
+	data = tio_window( tio_pos, want + (want == reclen ? trailer : 0) );
+	if ( !data )
+	{
+		tio_hitend = 1;			/* truncated image, pretend we hit the end */
+		return;
+	}
+	rec->off = tio_pos;
+	tio_pos += reclen + trailer;
+	if ( trailer && want == reclen && ss_getu32( data + reclen ) != reclen )
+	{
+		rec->len = -1;
+		rec->count = reclen;
+		rec->trailer = ss_getu32( data + reclen );
+		return;
+	}
+	rec->len = (int)reclen;
+	rec->data = data;
+}
+
+#if HAVE_MTIO
+/**
+ * Space a tape forward to the next tape mark.
+ *
+ * @param count Number of records to skip (TIO_SKIP_TM for all of them).
+ *
+ * @return number of records skipped (always 0).
+ *
+ * @note
+ * MTFSF leaves the tape past the tape mark so raw_record() is told to
+ * report it without reading anything. If the tape can't be spaced the
+ * records are read as usual. So are a given number of them, MTFSR
+ * running into a tape mark leaves the tape somewhere that depends on
+ * the drive.
+ */
+
+static unsigned long raw_skip( unsigned long count )
+{
+	struct mtop op;
+
+	if ( count != TIO_SKIP_TM )
+		return 0;
+	op.mt_op = MTFSF;
+	op.mt_count = 1;
+	if ( ioctl( tio_fd, MTIOCTOP, &op ) == 0 )
+		raw_tmnext = 1;
+	return 0;
+}
+#endif
+
+/**
+ * Skip the records of a -i or -I image up to the next tape mark.
+ *
+ * @param count Most records to skip (TIO_SKIP_TM for all of them).
+ *
+ * @return number of records skipped.
+ *
+ * @note
+ * If the image can be read anywhere only the record lengths are read
+ * (a page at a time, which suits O_DIRECT as well) and the data is
+ * jumped over. Otherwise the data still has to go by but isn't looked at.
+ */
+
+static unsigned long frame_skip( unsigned long count )
+{
+	unsigned char *hdr;
+	unsigned long reclen, done = 0;
+	off_t pos = tio_pos, base;
+	size_t want;
+	ssize_t sts;
+	int trailer = (tio_fmt == TIO_FMT_SIMH) ? 4 : 0;
+
+	for ( ; done < count && !tio_hitend; ++done )
+	{
+		if ( tio_canseek )
+		{
+			base = pos & ~(off_t)(TIO_ALIGN - 1);
+			want = (pos - base) + 4 > TIO_ALIGN ? 2*TIO_ALIGN : TIO_ALIGN;
+			sts = pread( tio_fd, skip_buf, want, base );
+			hdr = sts >= (pos - base) + 4 ? skip_buf + (pos - base) : NULL;
+		}
+		else
+			hdr = tio_window( pos, 4 );
+		if ( !hdr )
+			break;				/* end of image, frame_record() will find it too */
+		reclen = ss_getu32( hdr );
+		if ( !reclen || reclen > 0x7FFFFFFFUL )
+			break;				/* tape mark (or garbage) is next */
+		pos += 4 + reclen + trailer;
+		if ( tio_canseek )
+		{
+			++skip_recs;
+			skip_bytes += reclen;
+		}
+	}
+	tio_pos = pos;
+	return done;
+}
+
+/**
+ * Skip the blocks of a disk saveset.
+ *
+ * @param count Most blocks to skip (TIO_SKIP_TM for all of them).
+ *
+ * @return number of blocks skipped.
+ */
+
+static unsigned long bck_skip( unsigned long count )
+{
+	if ( bck_state != 3 )
+		return 0;
+	if ( count == TIO_SKIP_TM )
+	{
+		tio_hitend = 1;			/* bck_record() goes on to the EOF labels */
+		return 0;
+	}
+	if ( vol_size && (off_t)(count*bck_bsize) > vol_size - tio_pos )
+		count = vol_size > tio_pos ? (vol_size - tio_pos)/bck_bsize : 0;
+	tio_pos += (off_t)count*bck_bsize;
+	skip_recs += count;
+	skip_bytes += (double)count*bck_bsize;
+	return count;
+}
+
+/**
+ * Make up a label for a disk saveset.
+ *
+ * @param rec Pointer to place to deposit record.
+ * @param id Label identifier (HDR1, EOF1 etc).
+ *
+ * @return nothing.
+ */
+
+static void bck_mklabel( struct tio_rec *rec, const char *id )
+{
+	if ( id[3] == '1' )
+		sprintf( bck_label, "%s%-17s%-6s%04d%04d", id, bck_name, "", 1, 1 );
+	else
+		sprintf( bck_label, "%sF%05d%05d", id, bck_bsize, bck_bsize );
+	memset( bck_label + strlen(bck_label), ' ', SS_LABEL_SIZE - strlen(bck_label) );
+	rec->len = SS_LABEL_SIZE;
+	rec->data = (unsigned char *)bck_label;
+}
+
+/**
+ * Get next record from a disk saveset.
+ *
+ * @param rec Pointer to place to deposit record.
+ * @param room Not used. Blocks are left where tio_window() found them.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Makes it look like a tape holding the one saveset: HDR1, HDR2, tape
+ * mark, the blocks, tape mark, EOF1, EOF2, tape mark, tape mark.
+ */
+
+static void bck_record( struct tio_rec *rec, unsigned char *room )
+{
+	unsigned char *data;
+
+	rec->len = 0;
+	rec->data = NULL;
+	switch ( bck_state )
+	{
+	case 0:
+		bck_mklabel( rec, "HDR1" );
+		break;
+	case 1:
+		bck_mklabel( rec, "HDR2" );
+		break;
+	case 2:
+		break;				/* tape mark */
+	case 3:
+		data = tio_hitend ? NULL : tio_window( tio_pos, bck_bsize );
+		if ( !data )
+		{
+			tio_hitend = 1;		/* out of blocks, a short one at the end is dropped */
+			break;
+		}
+		rec->off = tio_pos;
+		tio_pos += bck_bsize;
+		rec->len = bck_bsize;
+		rec->data = data;
+		return;				/* stay in this state */
+	case 4:
+		bck_mklabel( rec, "EOF1" );
+		break;
+	case 5:
+		bck_mklabel( rec, "EOF2" );
+		break;
+	default:
+		return;				/* tape marks from here on */
+	}
+	++bck_state;
+}
+
+/**
+ * Check a disk saveset block header.
+ *
+ * @param blk Pointer to at least SS_BBH_SIZE bytes.
+ *
+ * @return blocksize or 0 if it doesn't look like a block header.
+ */
+
+static int probe_bbh( const unsigned char *blk )
+{
+	unsigned long bs;
+
+	if ( ss_getu16( blk ) != SS_BBH_SIZE )
+		return 0;
+	bs = ss_getu32( blk + SS_BBH_BLKSIZE );
+	if ( bs < 2048 || bs > 65535 )
+		return 0;			/* BACKUP/BLOCK_SIZE limits */
+	return (int)bs;
+}
+
+/**
+ * See whether the image is a disk saveset.
+ *
+ * @return non-zero if it is. bck_bsize and bck_name are set.
+ */
+
+static int probe_bck( void )
+{
+	unsigned char *p;
+	int len;
+
+	p = tio_window( 0, SS_BBH_SIZE );
+	if ( !p || !(bck_bsize = probe_bbh( p )) )
+		return 0;
+	len = p[SS_BBH_SSNAME];
+	if ( len > 17 )
+		len = 17;			/* only this much fits in HDR1 */
+	memcpy( bck_name, p + SS_BBH_SSNAME + 1, len );
+	bck_name[len] = 0;
+	if ( bck_bsize <= TIO_PROBE_SPAN - SS_BBH_SIZE )
+	{
+		p = tio_window( bck_bsize, SS_BBH_SIZE );
+		if ( p && probe_bbh( p ) != bck_bsize )
+			return 0;		/* if there's a second block it has to match */
+	}
+	return 1;
+}
+
+/**
+ * See whether the start of the image holds up with a given framing.
+ *
+ * @param format TIO_FMT_DVD or TIO_FMT_SIMH.
+ *
+ * @return non-zero if it does.
+ *
+ * @note
+ * The first record has to be a label or a saveset block and the next
+ * several have to frame correctly. Running into the end of the image or
+ * the double tape mark at the end of tape before that is fine.
+ */
+
+static int probe_frames( int format )
+{
+	unsigned char *p;
+	unsigned long reclen;
+	off_t pos = 0;
+	int recs = 0, marks = 0, trailer = (format == TIO_FMT_SIMH) ? 4 : 0;
+
+	while ( recs < TIO_PROBE_RECS && pos < TIO_PROBE_SPAN - TIO_MAXREC - 8 )
+	{
+		p = tio_window( pos, 4 );
+		if ( !p )
+			return recs > 0;
+		reclen = ss_getu32( p );
+		pos += 4;
+		if ( !reclen )
+		{
+			if ( ++marks == 2 )
+				return recs > 0;	/* end of tape */
+			continue;
+		}
+		marks = 0;
+		if ( reclen > TIO_MAXREC )
+			return 0;
+		p = tio_window( pos, reclen + trailer );
+		if ( !p || (trailer && ss_getu32( p + reclen ) != reclen) )
+			return 0;
+		if ( !recs++ && !(reclen == SS_LABEL_SIZE && (!strncmp( (char *)p, "VOL1", 4 ) || !strncmp( (char *)p, "HDR1", 4 )))
+			 && !(reclen >= SS_BBH_SIZE && probe_bbh( p )) )
+			return 0;
+		pos += reclen + trailer;
+	}
+	return 1;
+}
+
+/**
+ * Work out how the image is framed.
+ *
+ * @return One of TIO_FMT_xxx or TIO_FMT_AUTO if it couldn't tell.
+ *
+ * @note
+ * SIMH is tried before -i because its trailing counts make it the
+ * stricter test. A -i image fails it on the second record.
+ */
+
+static int tio_probe( void )
+{
+	if ( probe_bck() )
+		return TIO_FMT_BCK;
+	if ( probe_frames( TIO_FMT_SIMH ) )
+		return TIO_FMT_SIMH;
+	if ( probe_frames( TIO_FMT_DVD ) )
+		return TIO_FMT_DVD;
+	return TIO_FMT_AUTO;
+}
+
+/**
+ * Setup to read records from a tape or image.
+ *
+ * @param fd File descriptor of open tape or image.
+ * @param format Framing of input (one of TIO_FMT_xxx). The framing of
+ * an image is checked no matter what it's said to be.
+ *
+ * @return Framing actually used (one of TIO_FMT_xxx but never TIO_FMT_AUTO).
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static int tio_input( int fd, int format )
+{
+	struct stat st;
+	int found;
+
+	tio_fd = fd;
+	tio_fmt = format;
+	tio_pos = 0;
+	tio_hitend = 0;
+	tio_canseek = 0;
+	vol_size = 0;
+	if ( format == TIO_FMT_RAW )
+	{
+		if ( !raw_buf )
+			raw_buf = (unsigned char *)malloc( TIO_MAXREC );	/* tape devices have real records */
+		if ( !raw_buf )
+		{
+			printf( "Snark: Failed to malloc %d bytes for input buffer.\n", TIO_MAXREC );
+			exit(1);
+		}
+		tio_source = raw_record;
+		tio_skipper = NULL;
+#if HAVE_MTIO
+		raw_tmnext = 0;
+		tio_skipper = raw_skip;
+#endif
+	}
+	else
+	{
+		tio_source = frame_record;
+		tio_skipper = frame_skip;
+		tio_window = NULL;
+		if ( !dc_active() )			/* a decompressed stream can only be read() */
+		{
+#if HAVE_DIRECTIO
+			if ( tio_direct )
+				dio_open();
+#endif
+#if HAVE_URING
+			if ( tio_uring > 0 && ur_open() )
+			{
+				ur_active = 1;
+				tio_window = ur_window;
+			}
+#endif
+#if HAVE_MMAP
+			if ( !tio_window && !tio_nomap && !tio_direct && map_open() )
+				tio_window = map_window;
+#endif
+		}
+		if ( !tio_window )
+		{
+			buf_open();
+			tio_window = buf_window;
+		}
+		if ( !dc_active() && fstat( fd, &st ) == 0 && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))
+			 && lseek( fd, 0, SEEK_CUR ) != (off_t)-1 )
+		{
+			if ( S_ISREG(st.st_mode) )
+				vol_size = st.st_size;
+			if ( !skip_buf )
+				skip_buf = (unsigned char *)tio_alloc( 2*TIO_ALIGN );
+			tio_canseek = skip_buf != NULL;
+		}
+		found = tio_probe();
+		if ( found != TIO_FMT_AUTO )
+			format = found;
+		else if ( format == TIO_FMT_AUTO )
+		{
+			format = TIO_FMT_DVD;		/* the most common kind */
+			printf( "Snark: Can't tell how the image is framed. Trying it as a %s.\n", tio_name( format ) );
+		}
+		tio_fmt = format;
+		if ( format == TIO_FMT_BCK )
+		{
+			tio_source = bck_record;
+			tio_skipper = bck_skip;
+			bck_state = 0;
+		}
+	}
+	return format;
+}
+
+/**
+ * Let go of everything tio_input() setup except the record buffer.
+ *
+ * @return nothing.
+ */
+
+static void tio_release( void )
+{
+#if HAVE_URING
+	if ( ur_active )
+		ur_close();
+	ur_active = 0;
+#endif
+#if HAVE_DIRECTIO
+	dio_on = dio_fadvise = 0;
+#endif
+#if HAVE_MMAP
+	map_close();
+#endif
+	if ( buf_mem )
+		free( buf_mem );
+	buf_mem = NULL;
+	tio_fd = -1;
+}
+
+/**
+ * Open the next volume ahead of time and have the start of it read in.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Only called in the thread calling tio_record().
+ */
+
+static void vol_openahead( void )
+{
+#if HAVE_DIRECTIO
+	int fd;
+
+	fd = vol_ahead();
+	if ( fd >= 0 && !tio_direct )
+		posix_fadvise( fd, 0, TIO_PREFETCH, POSIX_FADV_WILLNEED );
+#else
+	vol_ahead();			/* at least it's open */
+#endif
+}
+
+/**
+ * Get the next volume opened ahead of time.
+ *
+ * @return nothing.
+ *
+ * @note
+ * The reader thread leaves it to the consumer to do when it gets to
+ * the record about to be put in the ring (see vol_serve()).
+ */
+
+static void vol_prefetch( void )
+{
+	vol_prefetched = 1;
+#if HAVE_PTHREAD
+	if ( rdr_running )
+	{
+		vol_aheadat = RING_LOAD(ring_put);
+		RING_STORE( vol_wantahead, 1 );
+		ring_wake();
+		return;
+	}
+#endif
+	vol_openahead();
+}
+
+/**
+ * Get the next volume opened.
+ *
+ * @param format Pointer to place to deposit the framing it's thought to have.
+ *
+ * @return file descriptor or -1 if there are no more.
+ *
+ * @note
+ * The reader thread asks the consumer to do it once it has taken every
+ * record in front of the end of this volume (see vol_serve()) and waits
+ * for the answer. So the volume changes for the caller in step with the
+ * records it's handed, and nothing it does to open one (prompting for a
+ * tape, giving up with exit()) happens behind its back. If the reader
+ * is told to quit while waiting it gets -1.
+ */
+
+static int vol_open( int *format )
+{
+#if HAVE_PTHREAD
+	if ( rdr_running )
+	{
+		vol_nextat = RING_LOAD(ring_put);
+		RING_STORE( vol_wantnext, 1 );
+		pthread_mutex_lock( &ring_lock );
+		pthread_cond_broadcast( &ring_cond );
+		while ( RING_LOAD(vol_wantnext) && !RING_LOAD(ring_stop) )
+			pthread_cond_wait( &ring_cond, &ring_lock );
+		pthread_mutex_unlock( &ring_lock );
+		if ( RING_LOAD(vol_wantnext) )
+			return -1;			/* told to quit */
+		*format = vol_nextfmt;
+		return vol_nextfd;
+	}
+#endif
+	return vol_next( format );
+}
+
+/**
+ * Keep track of the labels and blocks going by.
+ *
+ * @param rec Pointer to record.
+ *
+ * @return nothing.
+ */
+
+static void vol_note( struct tio_rec *rec )
+{
+	int volnum;
+	unsigned long numb;
+
+	if ( rec->len == SS_LABEL_SIZE && !strncmp( (char *)rec->data, "HDR1", 4 ) )
+	{
+		memcpy( vol_ssname, rec->data + 4, 14 );
+		vol_ssname[14] = 0;
+	}
+	else if ( rec->len == SS_LABEL_SIZE && !strncmp( (char *)rec->data, "HDR2", 4 ) )
+		sscanf( (char *)rec->data + 5, "%5d", &vol_bsize );	/* same as rdhead() */
+	else if ( rec->len == vol_bsize && ss_blkcheck( rec->data, vol_bsize, &numb ) == SS_BLK_OK )
+	{
+		volnum = ss_getu16( rec->data + SS_BBH_VOLNUM );
+		if ( vol_expect && volnum != vol_expect )
+			printf( "Snark: Saveset '%s' continues with blocks of volume %d. Expected volume %d.\n",
+					vol_ssname, volnum, vol_expect );
+		vol_expect = 0;
+		vol_volnum = volnum;
+	}
+	if ( vol_ahead && !vol_prefetched && vol_size && tio_pos + TIO_PREFETCH >= vol_size )
+		vol_prefetch();
+}
+
+/**
+ * Move on to the next volume.
+ *
+ * @return non-zero if there is one.
+ */
+
+static int vol_switch( void )
+{
+	void (*wrap)( struct tio_rec *rec, unsigned char *room ) = tio_source;	/* that's vol_record() */
+	int fd, format;
+
+	tio_release();
+	fd = vol_open( &format );
+	if ( fd < 0 )
+	{
+		vol_ended = 1;
+		return 0;
+	}
+	tio_input( fd, format );
+	vol_source = tio_source;
+	tio_source = wrap;
+	vol_prefetched = 0;
+	++vol_count;
+	return 1;
+}
+
+/**
+ * Pick up a saveset where it continues on the next volume.
+ *
+ * @return non-zero if it does, zero if there's no next volume.
+ *
+ * @note
+ * Everything from the tape mark in front of the EOV labels to the tape
+ * mark behind the next volume's HDR labels is dropped so the blocks
+ * just carry on.
+ */
+
+static int vol_continue( void )
+{
+	struct tio_rec lbl;
+	int marks = 0;
+
+	while ( marks < 2 )
+	{
+		vol_source( &lbl, vol_room );	/* rest of the EOV labels */
+		marks = lbl.len ? 0 : marks + 1;
+	}
+	if ( !vol_switch() )
+	{
+		printf( "Snark: Saveset '%s' continues on another volume but there isn't one.\n", vol_ssname );
+		return 0;
+	}
+	while ( 1 )
+	{
+		vol_source( &lbl, vol_room );	/* VOL1 and HDR labels up to the tape mark */
+		if ( lbl.len <= 0 )
+			break;
+		if ( lbl.len == SS_LABEL_SIZE && !strncmp( (char *)lbl.data, "HDR1", 4 )
+			 && strncmp( (char *)lbl.data + 4, vol_ssname, 14 ) )
+			printf( "Snark: Volume %d starts with saveset '%.14s', not the rest of '%s'.\n",
+					vol_count + 1, (char *)lbl.data + 4, vol_ssname );
+	}
+	vol_expect = vol_volnum + 1;
+	vol_tm = 0;
+	return 1;
+}
+
+/**
+ * Get next record from a list of volumes.
+ *
+ * @param rec Pointer to place to deposit record.
+ * @param room Pointer to TIO_MAXREC bytes for a record.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Looks at what follows each tape mark. The double tape mark at the end
+ * of a volume becomes a single one between it and the next volume. A
+ * saveset continued on the next volume (EOV labels) is spliced together.
+ */
+
+static void vol_record( struct tio_rec *rec, unsigned char *room )
+{
+	if ( vol_havepeek )
+	{
+		*rec = vol_peek;
+		vol_havepeek = 0;
+	}
+	else if ( vol_ended )
+	{
+		rec->len = 0;			/* nothing more */
+		rec->data = NULL;
+	}
+	else
+		vol_source( rec, room );
+	if ( rec->len )
+	{
+		vol_tm = 0;
+		if ( rec->len > 0 )
+			vol_note( rec );
+		return;
+	}
+	if ( vol_tm || vol_ended )
+		return;				/* second of a pair, end of tape */
+	vol_tm = 1;
+	vol_peek.off = -1;
+	vol_source( &vol_peek, vol_room );
+	if ( !vol_peek.len )
+	{
+		if ( !vol_switch() )		/* end of this volume, on to the next */
+			vol_havepeek = 1;	/* no more, hand out the second one too */
+		return;
+	}
+	if ( vol_peek.len == SS_LABEL_SIZE && !strncmp( (char *)vol_peek.data, "EOV1", 4 ) )
+	{
+		if ( vol_continue() )
+			vol_record( rec, room );	/* first block on the next volume instead of the tape mark */
+		else
+		{
+			vol_peek.len = 0;		/* hand out the end of tape */
+			vol_peek.data = NULL;
+			vol_havepeek = 1;
+		}
+		return;
+	}
+	vol_havepeek = 1;
+}
+
+/**
+ * Skip records of the current volume.
+ *
+ * @param count Most records to skip (TIO_SKIP_TM for all up to the next tape mark).
+ *
+ * @return number of records skipped.
+ */
+
+static unsigned long src_skip( unsigned long count )
+{
+	if ( tio_skipper && !vol_havepeek && !vol_ended )
+		return tio_skipper( count );	/* vol_record() hands out vol_peek first, leave it be */
+	return 0;
+}
+
+#if HAVE_PTHREAD
+static void ring_wake( void )
+{
+	pthread_mutex_lock( &ring_lock );
+	pthread_cond_broadcast( &ring_cond );
+	pthread_mutex_unlock( &ring_lock );
+}
+
+/**
+ * Handler for RDR_SIGNAL.
+ *
+ * @param sig Not used.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Does nothing. It's only there so the signal makes a read() the reader
+ * thread is stuck in fail with EINTR instead of killing the program.
+ */
+
+static void rdr_signal( int sig )
+{
+}
+
+#if HAVE_MTIO
+/**
+ * Note where a tape drive is about to be made to stop.
+ *
+ * @return nothing.
+ */
+
+static void tape_stopped( void )
+{
+	struct mtget mt;
+
+	tape_posok = ioctl( tio_fd, MTIOCGET, &mt ) == 0;
+	if ( tape_posok )
+	{
+		tape_fileno = mt.mt_fileno;
+		tape_blkno = mt.mt_blkno;
+	}
+}
+#endif
+
+/**
+ * Reader thread. Fills the ring with records until the end of tape.
+ *
+ * @param arg Not used.
+ *
+ * @return NULL.
+ */
+
+static void *rdr_main( void *arg )
+{
+	struct tio_rec *slot;
+	unsigned char *room;
+	unsigned int put = 0, lasttm = 0, skip;
+	unsigned long pos = 0, skipto;
+	int marks = 0, bsize = 0;
+	double t0;
+
+	while ( 1 )
+	{
+		if ( put - RING_LOAD(ring_got) > ring_mask )
+		{
+#if HAVE_MTIO
+			if ( tio_fmt == TIO_FMT_RAW )
+				tape_stopped();
+#endif
+			t0 = ss_now();			/* ring is full, wait for consumer to make room */
+			pthread_mutex_lock( &ring_lock );
+			RING_STORE( rdr_sleeping, 1 );
+			while ( put - RING_LOAD(ring_got) > ring_resume && !RING_LOAD(ring_stop) )
+				pthread_cond_wait( &ring_cond, &ring_lock );
+			RING_STORE( rdr_sleeping, 0 );
+			pthread_mutex_unlock( &ring_lock );
+			rdr_stall += ss_now() - t0;
+			++rdr_stalls;
+		}
+		if ( RING_LOAD(ring_stop) )
+			break;
+		skip = __atomic_exchange_n( &ring_skipreq, 0, __ATOMIC_SEQ_CST );
+		if ( skip && (int)(lasttm - skip) < 0 )
+			src_skip( TIO_SKIP_TM );	/* no tape mark put since then, skip to the next one */
+		skipto = __atomic_exchange_n( &ring_skipto, 0, __ATOMIC_SEQ_CST );
+		if ( skipto > pos )
+			pos += src_skip( skipto - pos );	/* the ones not read yet */
+		slot = ring + (put & ring_mask);
+		room = ring_mem + (size_t)(put & ring_mask)*TIO_MAXREC;
+		slot->off = -1;
+		tio_source( slot, room );
+		slot->blknum = 0;
+		slot->pinned = 0;
+		slot->pos = pos++;
+		if ( slot->len > 0 )
+		{
+#if HAVE_MMAP
+			slot->pinned = map_holds( slot->data );
+#endif
+			if ( slot->data != room && !slot->pinned )
+			{
+				memcpy( room, slot->data, slot->len < TIO_MAXREC ? slot->len : TIO_MAXREC );
+				slot->data = room;
+			}
+			if ( slot->len == SS_LABEL_SIZE && !strncmp( (char *)slot->data, "HDR2", 4 ) )
+				sscanf( (char *)slot->data + 5, "%5d", &bsize );	/* same as rdhead() */
+			else if ( slot->len == bsize )
+				ss_blkcheck( slot->data, bsize, &slot->blknum );	/* leaves 0 if no good */
+		}
+		marks <<= 1;
+		if ( !slot->len || (slot->len < 0 && tio_fmt == TIO_FMT_RAW) )
+		{
+			marks |= 1;			/* read_record() counts these as tape marks */
+			lasttm = put + 1;
+		}
+		RING_STORE( ring_put, ++put );
+		if ( RING_LOAD(cons_sleeping) )
+			ring_wake();
+		if ( (marks&3) == 3 )
+			break;				/* end of tape, don't go past it */
+	}
+	RING_STORE( ring_done, 1 );
+	ring_wake();
+	return NULL;
+}
+
+/**
+ * Check if the reader thread is waiting on the consumer for a volume.
+ *
+ * @param got Ring position of the next record to be taken.
+ *
+ * @return non-zero if a volume is to be opened there.
+ */
+
+static int vol_due( unsigned int got )
+{
+	return (RING_LOAD(vol_wantahead) && vol_aheadat == got)
+		   || (RING_LOAD(vol_wantnext) && vol_nextat == got);
+}
+
+/**
+ * Open a volume for the reader thread once it's due.
+ *
+ * @param got Ring position of the next record to be taken.
+ *
+ * @return nothing.
+ *
+ * @note
+ * The reader asks (see vol_prefetch() and vol_open()) at the position
+ * of the record it's reading. So by the time the consumer is there it
+ * has taken everything from the current volume that goes before.
+ */
+
+static void vol_serve( unsigned int got )
+{
+	if ( RING_LOAD(vol_wantahead) && vol_aheadat == got )
+	{
+		RING_STORE( vol_wantahead, 0 );
+		vol_openahead();
+	}
+	if ( RING_LOAD(vol_wantnext) && vol_nextat == got )
+	{
+		vol_nextfd = vol_next( &vol_nextfmt );
+		RING_STORE( vol_wantnext, 0 );
+		ring_wake();
+	}
+}
+
+/**
+ * Take next record out of the ring.
+ *
+ * @param rec Pointer to place to deposit record.
+ *
+ * @return nothing.
+ *
+ * @note
+ * The ring entry isn't given back to the reader until the next call.
+ */
+
+static void ring_take( struct tio_rec *rec )
+{
+	unsigned int got = ring_got;
+	double t0;
+
+	if ( ring_held )
+	{
+		RING_STORE( ring_got, ++got );	/* done with previous entry */
+		ring_held = 0;
+		if ( RING_LOAD(rdr_sleeping) && RING_LOAD(ring_put) - got <= ring_resume )
+			ring_wake();
+	}
+	while ( 1 )
+	{
+		vol_serve( got );
+		if ( RING_LOAD(ring_put) != got || RING_LOAD(ring_done) )
+			break;
+		t0 = ss_now();				/* ring is empty, wait for reader to put one */
+		pthread_mutex_lock( &ring_lock );
+		RING_STORE( cons_sleeping, 1 );
+		while ( RING_LOAD(ring_put) == got && !RING_LOAD(ring_done) && !vol_due( got ) )
+			pthread_cond_wait( &ring_cond, &ring_lock );
+		RING_STORE( cons_sleeping, 0 );
+		pthread_mutex_unlock( &ring_lock );
+		cons_stall += ss_now() - t0;
+		++cons_stalls;
+	}
+	if ( RING_LOAD(ring_put) == got )
+	{
+		rec->len = 0;				/* reader quit at end of tape */
+		rec->data = NULL;
+		rec->blknum = 0;
+		return;
+	}
+	*rec = ring[got & ring_mask];
+	ring_held = 1;
+	++ring_records;
+}
+
+/**
+ * Start the reader thread.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ * If the thread cannot be started the records are read without it.
+ */
+
+static void ring_open( void )
+{
+	struct sigaction sa;
+	unsigned int depth, want;
+
+	if ( tio_readahead > 1024 )
+		tio_readahead = 1024;
+	want = tio_readahead;
+	if ( tio_fmt == TIO_FMT_RAW )
+		want = tio_tapebuf*((1024*1024)/TIO_MAXREC);	/* keep the drive streaming */
+	for ( depth = 2; depth < want; depth <<= 1 )
+		;
+	ring = (struct tio_rec *)calloc( depth, sizeof(struct tio_rec) );
+	ring_mem = (unsigned char *)malloc( (size_t)depth*TIO_MAXREC );
+	if ( !ring || !ring_mem )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for read-ahead ring.\n", (unsigned long)depth*TIO_MAXREC );
+		exit(1);
+	}
+	ring_mask = depth - 1;
+	ring_resume = depth/2;			/* wait for it to be half empty */
+	ring_put = ring_got = 0;
+	ring_held = ring_done = ring_stop = 0;
+	ring_skipreq = 0;
+	ring_skipto = 0;
+	rdr_sleeping = cons_sleeping = 0;
+	vol_wantnext = vol_wantahead = 0;
+	memset( &sa, 0, sizeof(sa) );
+	sa.sa_handler = rdr_signal;
+	sigemptyset( &sa.sa_mask );
+	sigaction( RDR_SIGNAL, &sa, NULL );	/* no SA_RESTART, a read() it interrupts fails */
+	rdr_running = 1;			/* before the reader looks at it */
+	if ( pthread_create( &rdr_thread, NULL, rdr_main, NULL ) )
+	{
+		printf( "Snark: Failed to start read-ahead thread. Reading without it.\n" );
+		rdr_running = 0;
+		free( ring );
+		free( ring_mem );
+		ring = NULL;
+		ring_mem = NULL;
+	}
+}
+#endif
+
+/**
+ * Prepare input for record level access.
+ *
+ * @param fd File descriptor of open tape or image.
+ * @param format Framing of input (one of TIO_FMT_xxx). The framing of
+ * an image is checked no matter what it's said to be.
+ *
+ * @return Framing actually used (one of TIO_FMT_xxx but never TIO_FMT_AUTO).
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ * The reader thread, if any, starts reading right away so any
+ * positioning of a tape has to be done before calling this. A tape
+ * gets --tapebuf worth of ring, an image --readahead records.
+ */
+
+int tio_open( int fd, int format )
+{
+	format = tio_input( fd, format );
+	if ( vol_next )
+	{
+		vol_room = (unsigned char *)malloc( TIO_MAXREC );
+		if ( !vol_room )
+		{
+			printf( "Snark: Failed to malloc %d bytes for input buffer.\n", TIO_MAXREC );
+			exit(1);
+		}
+		vol_source = tio_source;
+		tio_source = vol_record;
+		vol_havepeek = vol_tm = vol_ended = vol_prefetched = 0;
+		vol_bsize = vol_volnum = vol_expect = 0;
+		vol_count = 1;
+	}
+#if HAVE_PTHREAD
+	if ( format == TIO_FMT_RAW ? tio_tapebuf > 0 : tio_readahead > 0 )
+		ring_open();
+#endif
+	return format;
+}
+
+/**
+ * Have the input carry on through more volumes.
+ *
+ * @param next Function that opens the next volume. It returns the file
+ * descriptor of it (or -1 if there isn't one) and deposits the framing
+ * it's thought to have in @e format. The current one is done with.
+ * @param ahead Function that opens the next volume ahead of time and
+ * returns its file descriptor (or -1), or NULL.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Has to be called before tio_open(). Both functions are only called
+ * from tio_record(), when the records before the end of the current
+ * volume have all been handed out, even with the reader thread.
+ */
+
+void tio_volumes( int (*next)( int *format ), int (*ahead)( void ) )
+{
+	vol_next = next;
+	vol_ahead = ahead;
+}
+
+/**
+ * Describe a framing.
+ *
+ * @param format One of TIO_FMT_xxx.
+ *
+ * @return Pointer to description.
+ */
+
+const char *tio_name( int format )
+{
+	switch ( format )
+	{
+	case TIO_FMT_RAW:
+		return "tape device";
+	case TIO_FMT_DVD:
+		return "-i image";
+	case TIO_FMT_SIMH:
+		return "-I (SIMH) image";
+	case TIO_FMT_BCK:
+		return "disk saveset (.BCK)";
+	}
+	return "unknown";
+}
+
+/**
+ * Get next record from input.
+ *
+ * @param rcd Pointer to place to deposit pointer to record's data.
+ *
+ * @return
+ *	@arg 0 Indicates a tape mark (or end of image).
+ *	@arg non-zero-positive Number of bytes in record.
+ *	@arg negative Framing error or error code from OS.
+ *
+ * @note
+ * The record's data is only good until the next call, unless
+ * tio_pinned() says otherwise. Only the first TIO_MAXREC bytes of a
+ * longer record are available.
+ */
+
+int tio_record( unsigned char **rcd )
+{
+#if HAVE_PTHREAD
+	if ( rdr_running )
+		ring_take( &tio_cur );
+	else
+#endif
+	{
+		tio_cur.off = -1;
+		tio_source( &tio_cur, raw_buf );
+		tio_cur.blknum = 0;
+		tio_cur.pinned = 0;
+		tio_cur.pos = 0;
+#if HAVE_MMAP
+		if ( tio_cur.len > 0 )
+			tio_cur.pinned = map_holds( tio_cur.data );
+#endif
+	}
+#if HAVE_MMAP
+	if ( tio_cur.len > 0 && tio_cur.pinned )
+		++map_inplace;
+#endif
+	if ( tio_cur.len < 0 && tio_fmt == TIO_FMT_SIMH )
+		printf( "Snark: read_record: SIMH format record count mismatch. Expected %ld read %ld\n",
+				tio_cur.count, tio_cur.trailer );
+	*rcd = tio_cur.len > 0 ? tio_cur.data : NULL;
+	return tio_cur.len;
+}
+
+/**
+ * Get block number of record last returned by tio_record().
+ *
+ * @return
+ *	@arg 0 Record wasn't checked out ahead of time (or it isn't a valid block).
+ *	@arg non-zero Block number of a block that passed get_block_number()'s checks.
+ */
+
+unsigned long tio_blknum( void )
+{
+	return tio_cur.blknum;
+}
+
+/**
+ * Get where the record last returned by tio_record() is in the image.
+ *
+ * @return offset of its data in the current volume (-1 if it isn't in
+ * an image, a tape record or a made up label say).
+ *
+ * @note
+ * For a compressed image it's the offset into what it decompresses to.
+ */
+
+off_t tio_offset( void )
+{
+	return tio_cur.off;
+}
+
+/**
+ * Check if record last returned by tio_record() can be used in place.
+ *
+ * @return
+ *	@arg 0 Its data is only good until the next call to tio_record().
+ *	@arg non-zero Its data is in the mapped image and stays put until tio_close().
+ */
+
+int tio_pinned( void )
+{
+	return tio_cur.pinned;
+}
+
+/**
+ * Skip the records up to the next tape mark.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Only a hint. The caller still reads records until it gets the tape
+ * mark, there just won't be many left in front of it. With the reader
+ * thread the skip is done by it the next time around.
+ */
+
+void tio_skip( void )
+{
+#if HAVE_PTHREAD
+	if ( rdr_running )
+	{
+		RING_STORE( ring_skipreq, ring_got + ring_held + 1 );
+		return;
+	}
+#endif
+	src_skip( TIO_SKIP_TM );
+}
+
+/**
+ * Skip a number of records.
+ *
+ * @param count Number of records after the one last returned by
+ * tio_record() that aren't wanted.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Stops short at a tape mark. With the reader thread the records it
+ * has already read are still handed out, only the rest are skipped.
+ * On a tape they're all still read.
+ */
+
+void tio_skipn( unsigned long count )
+{
+	if ( !count )
+		return;
+#if HAVE_PTHREAD
+	if ( rdr_running )
+	{
+		RING_STORE( ring_skipto, tio_cur.pos + 1 + count );
+		return;
+	}
+#endif
+	src_skip( count );
+}
+
+/**
+ * Get a slab of memory for the decoder's block buffers.
+ *
+ * @param size Number of bytes needed.
+ *
+ * @return Pointer to slab or NULL if out of memory.
+ *
+ * @note
+ * There is only the one slab. Asking for more than it has grows it, in
+ * place if the system can, else it's moved with its contents keeping
+ * their offsets. Asking for less leaves it alone. It is aligned for
+ * O_DIRECT and vector loads. Where memory can be mapped it is anonymous
+ * memory, advised to use transparent huge pages with --hugepages.
+ */
+
+unsigned char *tio_slab( size_t size )
+{
+	unsigned char *mem;
+	void *raw;
+
+	if ( size <= slab_size )
+		return slab_mem;
+	size = (size + TIO_SLAB_ALIGN-1) & ~(size_t)(TIO_SLAB_ALIGN-1);
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+	if ( tio_hugepages )
+		size = (size + TIO_HUGE_PAGE-1) & ~(size_t)(TIO_HUGE_PAGE-1);
+	if ( !slab_raw )
+	{
+		void *mp = MAP_FAILED;
+
+#if defined(MREMAP_MAYMOVE)
+		if ( slab_mem )
+			mp = mremap( slab_mem, slab_size, size, MREMAP_MAYMOVE );
+#endif
+		if ( mp == MAP_FAILED )
+		{
+			mp = mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+			if ( mp != MAP_FAILED && slab_mem )
+			{
+				memcpy( mp, slab_mem, slab_size );
+				munmap( slab_mem, slab_size );
+			}
+		}
+		if ( mp != MAP_FAILED )
+		{
+#if defined(MADV_HUGEPAGE)
+			if ( tio_hugepages )
+				slab_huge = madvise( mp, size, MADV_HUGEPAGE ) == 0;
+#endif
+			slab_mem = (unsigned char *)mp;
+			slab_size = size;
+			return slab_mem;
+		}
+	}
+#endif
+	raw = malloc( size + TIO_SLAB_ALIGN );
+	if ( !raw )
+		return NULL;
+	mem = (unsigned char *)raw + (TIO_SLAB_ALIGN - (unsigned long)raw % TIO_SLAB_ALIGN) % TIO_SLAB_ALIGN;
+	if ( slab_mem )
+		memcpy( mem, slab_mem, slab_size );
+	if ( slab_raw )
+		free( slab_raw );
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+	else if ( slab_mem )
+		munmap( slab_mem, slab_size );
+#endif
+	slab_raw = raw;
+	slab_mem = mem;
+	slab_size = size;
+	return slab_mem;
+}
+
+/**
+ * Show input statistics.
+ *
+ * @return nothing.
+ */
+
+void tio_stats( void )
+{
+#if HAVE_MTIO && defined(MT_ST_SOFTERR_SHIFT)
+	struct mtget mt;
+
+#endif
+	if ( vol_count > 1 )
+		printf( "Volumes: read %d of them.\n", vol_count );
+	if ( skip_recs )
+		printf( "Skipping: passed over %lu records (%.1f MB) reading just their lengths.\n",
+				skip_recs, skip_bytes/(1024*1024) );
+#if HAVE_PTHREAD
+	if ( rdr_running )
+	{
+		printf( "Read-ahead: %lu records through a ring of %u.\n", ring_records, ring_mask + 1 );
+		printf( "Read-ahead: reader waited %lu times for %.3f secs (ring full).\n", rdr_stalls, rdr_stall );
+		printf( "Read-ahead: decoder waited %lu times for %.3f secs (ring empty).\n", cons_stalls, cons_stall );
+#if HAVE_MTIO
+		if ( tio_fmt == TIO_FMT_RAW )
+		{
+			if ( !rdr_stalls )
+				printf( "Tape: drive never had to stop for the decoder.\n" );
+			else if ( tape_posok )
+				printf( "Tape: drive had to stop %lu times, the last at file %ld block %ld.\n",
+						rdr_stalls, tape_fileno, tape_blkno );
+			else
+				printf( "Tape: drive had to stop %lu times.\n", rdr_stalls );
+		}
+#endif
+	}
+	else
+#endif
+		printf( "Read-ahead: not used.\n" );
+#if HAVE_MTIO && defined(MT_ST_SOFTERR_SHIFT)
+	if ( tio_fmt == TIO_FMT_RAW && tio_fd >= 0 && ioctl( tio_fd, MTIOCGET, &mt ) == 0 )
+		printf( "Tape: drive recovered from %ld errors.\n",
+				(long)((mt.mt_erreg >> MT_ST_SOFTERR_SHIFT) & MT_ST_SOFTERR_MASK) );
+#endif
+#if HAVE_MMAP
+	if ( map_inplace )
+		printf( "Mapped: %lu records handed over in place, not copied.\n", map_inplace );
+#endif
+	if ( slab_size )
+		printf( "Block buffers: %luKB in one slab%s.\n", (unsigned long)(slab_size/1024),
+				slab_huge ? " on huge pages" : (tio_hugepages ? " (huge pages not possible)" : "") );
+#if HAVE_DIRECTIO
+	if ( dio_on )
+		printf( "Direct I/O: image read with O_DIRECT.\n" );
+	else if ( dio_fadvise )
+		printf( "Direct I/O: not possible, dropped image from page cache as it was read.\n" );
+#endif
+#if HAVE_URING
+	if ( ur_active )
+		printf( "io_uring: %lu reads of %luKB with %u in flight, had to wait %lu times.\n",
+				ur_reads, (unsigned long)buf_chunk/1024, ur_depth, ur_waits );
+	else if ( tio_uring > 0 )
+		printf( "io_uring: not used.\n" );
+#endif
+}
+
+/**
+ * Done with input.
+ *
+ * @return nothing.
+ */
+
+void tio_close( void )
+{
+#if HAVE_PTHREAD
+	struct timespec ts;
+
+	if ( rdr_running )
+	{
+		RING_STORE( ring_stop, 1 );
+		dc_interrupt();
+		pthread_mutex_lock( &ring_lock );
+		pthread_cond_broadcast( &ring_cond );
+		while ( !RING_LOAD(ring_done) )
+		{
+			/* it might be stuck in a read(), keep poking it until it notices */
+			pthread_kill( rdr_thread, RDR_SIGNAL );
+			clock_gettime( CLOCK_REALTIME, &ts );
+			ts.tv_nsec += 10*1000*1000;
+			if ( ts.tv_nsec >= 1000*1000*1000 )
+			{
+				ts.tv_nsec -= 1000*1000*1000;
+				++ts.tv_sec;
+			}
+			pthread_cond_timedwait( &ring_cond, &ring_lock, &ts );
+		}
+		pthread_mutex_unlock( &ring_lock );
+		pthread_join( rdr_thread, NULL );
+		rdr_running = 0;
+		ring_stop = 0;
+		free( ring );
+		free( ring_mem );
+		ring = NULL;
+		ring_mem = NULL;
+	}
+#endif
+	tio_release();
+#if HAVE_MMAP
+	while ( map_kept )
+	{
+		struct tio_map *mp = map_kept;
+
+		munmap( mp->base, mp->len );
+		map_kept = mp->next;
+		free( mp );
+	}
+#endif
+	if ( raw_buf )
+		free( raw_buf );
+	raw_buf = NULL;
+	if ( vol_room )
+		free( vol_room );
+	vol_room = NULL;
+	if ( skip_buf )
+		free( skip_buf );
+	skip_buf = NULL;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file tapeio.h
+ *
+ * Record level access to tapes and tape images (-i and -I files).
+ */
+
+#ifndef _TAPEIO_H_
+#define _TAPEIO_H_
+
+/* Record framing of the input */
+#define TIO_FMT_RAW	(0)	/*!< tape device, one read() per record */
+#define TIO_FMT_DVD	(1)	/*!< -i: 4 byte length followed by data */
+#define TIO_FMT_SIMH	(2)	/*!< -I: 4 byte length, data, 4 byte length */
+#define TIO_FMT_BCK	(3)	/*!< disk saveset: nothing but blocks */
+#define TIO_FMT_AUTO	(-1)	/*!< image, have a look to see which of the above */
+
+#define TIO_MAXREC	(128*1024)	/*!< most bytes of a record tio_record() delivers */
+
+extern int tio_bufsize;
+extern int tio_nomap;
+extern int tio_readahead;
+extern int tio_uring;
+extern int tio_direct;
+extern int tio_tapebuf;
+extern int tio_hugepages;
+
+extern int tio_open( int fd, int format );
+extern const char *tio_name( int format );
+extern void tio_volumes( int (*next)( int *format ), int (*ahead)( void ) );
+extern int tio_record( unsigned char **rcd );
+extern unsigned long tio_blknum( void );
+extern off_t tio_offset( void );
+extern int tio_pinned( void );
+extern void tio_skip( void );
+extern void tio_skipn( unsigned long count );
+extern unsigned char *tio_slab( size_t size );
+extern void tio_stats( void );
+extern void tio_close( void );
+
+#endif	/* _TAPEIO_H_ */
@@ -0,0 +1,44 @@
+#!/bin/bash
+#
+# Decoding microbenchmark. Run by "make bench", or by hand:
+#
+#   bash tests/bench.sh [runs [vmsbackup ...]]
+#
+# Makes an image of about 1.3M short VAR records with tests/mkimage and
+# times -x -i --nocrc of it with each vmsbackup given (by default the
+# release build and vmsbackup_trace, which tests vflag at run time).
+# The runs of each are interleaved so they see the same conditions, and
+# the min and median user CPU time of each are shown. Most of the time
+# left is the stdio writes, so compare medians over plenty of runs.
+
+RUNS=${1:-21}
+shift
+BINS=("${@:-./vmsbackup}")
+[ $# -eq 0 ] && BINS+=(./vmsbackup_trace)
+MKIMAGE=${MKIMAGE:-./tests/mkimage}
+
+WORK=`mktemp -d ${TMPDIR:-/tmp}/vmsbackup_bench.XXXXXX` || exit 1
+trap 'rm -rf "$WORK"' 0
+"$MKIMAGE" -f 100 -l 20000 -w 16 "$WORK/bench.data" || exit 1
+for b in "${!BINS[@]}"
+do
+	case ${BINS[$b]} in /*) ;; *) BINS[$b]=`pwd`/${BINS[$b]} ;; esac
+	: > "$WORK/times.$b"
+done
+echo "$RUNS runs of -x -i --nocrc on a `du -m "$WORK/bench.data" | cut -f1` MB image"
+
+TIMEFORMAT=%U
+for (( run = 0; run < RUNS; ++run ))
+do
+	for b in "${!BINS[@]}"
+	do
+		rm -rf "$WORK/x"
+		mkdir "$WORK/x"
+		( cd "$WORK/x" && time "${BINS[$b]}" -x -i --nocrc -f ../bench.data > /dev/null ) 2>> "$WORK/times.$b"
+	done
+done
+for b in "${!BINS[@]}"
+do
+	sort -n "$WORK/times.$b" | awk -v name="${BINS[$b]##*/}" \
+		'{ t[NR] = $1 } END { printf "%-20s min %.3f  median %.3f user s\n", name, t[1], t[int((NR+1)/2)] }'
+done
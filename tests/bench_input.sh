@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Input benchmark, buffered against O_DIRECT reads. Run by "make
+# bench_input", or by hand:
+#
+#   bash tests/bench_input.sh [runs [savesets [vmsbackup]]]
+#
+# Makes an image of 'savesets' copies (default 100, about 1 GB) of a
+# saveset of about 340 32 KB blocks with tests/mkimage and times -t -i
+# of it read each way: mapped (the default), --nomap, --direct and
+# --direct --uring=4. The image is dropped from the page cache before
+# every run (dd iflag=nocache) so each one reads it from the disk, and
+# how much the page cache grew is shown along with the median wall
+# clock time. It's made in /var/tmp, not /tmp which is often tmpfs
+# where there's no disk to read and O_DIRECT isn't allowed. --direct
+# only has an effect where vmsbackup was built with HAVE_DIRECTIO,
+# --uring where it was built with HAVE_URING.
+
+RUNS=${1:-3}
+SETS=${2:-100}
+VMSBACKUP=${3:-./vmsbackup}
+MKIMAGE=${MKIMAGE:-./tests/mkimage}
+case $VMSBACKUP in /*) ;; *) VMSBACKUP=`pwd`/$VMSBACKUP ;; esac
+MODES=("" "--nomap" "--direct" "--direct --uring=4")
+
+WORK=`mktemp -d ${TMPDIR:-/var/tmp}/vmsbackup_bench.XXXXXX` || exit 1
+trap 'rm -rf "$WORK"' 0
+"$MKIMAGE" -b 32768 -f 650 -s "$SETS" "$WORK/bench.data" || exit 1
+echo "$RUNS runs of -t -i on a `du -m "$WORK/bench.data" | cut -f1` MB image, page cache dropped before each"
+
+# cached: page cache in KB
+cached() {
+	awk '/^Cached:/ { print $2 }' /proc/meminfo
+}
+
+TIMEFORMAT=%R
+for m in "${!MODES[@]}"
+do
+	: > "$WORK/times.$m"
+	: > "$WORK/cache.$m"
+done
+for (( run = 0; run < RUNS; ++run ))
+do
+	for m in "${!MODES[@]}"
+	do
+		dd if="$WORK/bench.data" iflag=nocache count=0 2> /dev/null
+		before=`cached`
+		( time "$VMSBACKUP" -t -i ${MODES[$m]} -f "$WORK/bench.data" > /dev/null ) 2>> "$WORK/times.$m"
+		echo $(( (`cached` - before) / 1024 )) >> "$WORK/cache.$m"
+	done
+done
+for m in "${!MODES[@]}"
+do
+	sort -n "$WORK/cache.$m" > "$WORK/cache.sorted"
+	sort -n "$WORK/times.$m" | awk -v name="${MODES[$m]:-mapped (default)}" -v cache=`awk '{ c[NR] = $1 } END { print c[int((NR+1)/2)] }' "$WORK/cache.sorted"` \
+		'{ t[NR] = $1 } END { printf "%-20s median %.2f s  page cache %+dMB\n", name, t[int((NR+1)/2)], cache }'
+done
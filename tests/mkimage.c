@@ -0,0 +1,535 @@
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdlib.h>
+#include	<unistd.h>
+#include	<getopt.h>
+
+/* Writes a small made up tape image (the -i format: each record is
+ * preceded by its length as 4 bytes, a length of 0 is a tape mark)
+ * holding one or more BACKUP savesets of text and binary files, with
+ * optional damage to the first saveset's blocks. It's used by
+ * run_tests.sh and bench.sh to build what they need at run time.
+ *
+ * Usage: mkimage [options] outfile
+ *
+ * With -v the savesets are split across volumes, outfile being the
+ * first and outfile.2, outfile.3 and so on the rest. -I writes a SIMH
+ * image instead (the length after each record as well) and -B a disk
+ * saveset (.BCK, one saveset's blocks and nothing else).
+ *
+ * The contents only depend on the options, so two images made with
+ * the same seed and damage options hold the same files.
+ */
+
+#define MK_BBH_SIZE	(256)	/* sizeof(struct bbh) */
+#define MK_BRH_SIZE	(16)	/* sizeof(struct brh) */
+#define MK_VBN_BLOCKS	(4)	/* disk blocks in each VBN record */
+
+/* Record types */
+#define MK_NULL		(0)
+#define MK_SUMMARY	(1)
+#define MK_FILE		(3)
+#define MK_VBN		(4)
+
+static int bsize = 8192;	/* blocksize */
+static int nfiles = 20;		/* files in each saveset */
+static int nsets = 1;		/* savesets */
+static int group;		/* /GROUP_SIZE (0=no XOR blocks) */
+static int crcs;		/* write block CRCs */
+static int varlines;		/* lines in each text file (0=a few hundred) */
+static int varwidth = 120;	/* longest padding of a text line */
+static int binblocks;		/* extra disk blocks in each binary file */
+static int volblocks;		/* blocks on each volume (0=all on one) */
+static int format = 'i';	/* 'i', 'I' (SIMH) or 'B' (disk saveset) */
+static unsigned long seed = 1;
+
+static unsigned char *bodies;	/* what follows the header of each data block */
+static int nbodies;		/* number of them */
+static int maxbodies;		/* room for this many */
+static int used;		/* bytes of the last one filled in */
+
+static FILE *out;
+static const char *outname;	/* first volume's file */
+static int volume = 1;		/* volume being written */
+static int volused;		/* blocks written to it */
+
+static void put_u16( unsigned char *p, unsigned int v )
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+}
+
+static void put_u32( unsigned char *p, unsigned long v )
+{
+	put_u16( p, (unsigned int)(v & 0xFFFF) );
+	put_u16( p+2, (unsigned int)((v >> 16) & 0xFFFF) );
+}
+
+/* AUTODIN-II CRC, a bit at a time so it has nothing in common with blkcrc.c */
+static unsigned long crc32( const unsigned char *p, size_t len )
+{
+	unsigned long crc = 0xFFFFFFFFUL;
+	int ii;
+
+	while ( len-- )
+	{
+		crc ^= *p++;
+		for ( ii = 0; ii < 8; ++ii )
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+	}
+	return ~crc & 0xFFFFFFFFUL;
+}
+
+static unsigned long rnd( void )
+{
+	seed = seed*1103515245UL + 12345UL;
+	return (seed >> 16) & 0x7FFF;
+}
+
+static void *mk_alloc( size_t len )
+{
+	void *ans;
+
+	ans = calloc( 1, len );
+	if ( !ans )
+	{
+		printf( "mkimage: Failed to malloc %lu bytes.\n", (unsigned long)len );
+		exit(1);
+	}
+	return ans;
+}
+
+static void put_record( const unsigned char *data, size_t len )
+{
+	unsigned char hdr[4];
+
+	if ( format == 'B' && len != (size_t)bsize )
+		return;				/* no labels or tape marks on disk */
+	put_u32( hdr, len );
+	if ( (format != 'B' && fwrite( hdr, 1, 4, out ) != 4)
+		 || (len && fwrite( data, 1, len, out ) != len)
+		 || (format == 'I' && len && fwrite( hdr, 1, 4, out ) != 4) )
+	{
+		perror( "mkimage: Failed to write image" );
+		exit(1);
+	}
+}
+
+static void open_out( const char *name )
+{
+	out = fopen( name, "wb" );
+	if ( !out )
+	{
+		perror( "mkimage: Failed to create image" );
+		exit(1);
+	}
+}
+
+static void close_out( void )
+{
+	if ( fclose( out ) )
+	{
+		perror( "mkimage: Failed to write image" );
+		exit(1);
+	}
+}
+
+static void put_label( const char *text )
+{
+	unsigned char label[80];
+	size_t len;
+
+	len = strlen( text );
+	memset( label, ' ', sizeof(label) );
+	memcpy( label, text, len < sizeof(label) ? len : sizeof(label) );
+	put_record( label, sizeof(label) );
+}
+
+/* Start another data block */
+static unsigned char *new_body( void )
+{
+	int room = bsize - MK_BBH_SIZE;
+
+	if ( nbodies >= maxbodies )
+	{
+		unsigned char *more;
+
+		maxbodies = maxbodies ? 2*maxbodies : 64;
+		more = (unsigned char *)mk_alloc( (size_t)maxbodies*room );
+		if ( bodies )
+			memcpy( more, bodies, (size_t)nbodies*room );
+		free( bodies );
+		bodies = more;
+	}
+	used = 0;
+	return bodies + (size_t)nbodies++*room;
+}
+
+/* Fill out the last block with a null record */
+static void end_body( void )
+{
+	int room = bsize - MK_BBH_SIZE;
+	unsigned char *brh;
+
+	if ( !nbodies || room - used < MK_BRH_SIZE )
+		return;
+	brh = bodies + (size_t)(nbodies-1)*room + used;
+	put_u16( brh, room - used - MK_BRH_SIZE );
+	put_u16( brh+2, MK_NULL );
+	used = room;
+}
+
+/* Add a record to the blocks, splitting a VBN record on a disk block
+ * boundary if it doesn't fit */
+static void add_record( int rtype, const unsigned char *data, size_t len )
+{
+	int room = bsize - MK_BBH_SIZE;
+	unsigned char *brh;
+	size_t fit;
+	long left;
+
+	while ( 1 )
+	{
+		if ( !nbodies )
+			new_body();
+		left = (long)room - used - MK_BRH_SIZE - (long)len;
+		if ( left < 0 || (left > 0 && left < MK_BRH_SIZE) )
+		{
+			if ( rtype == MK_VBN && room - used >= 2*MK_BRH_SIZE + 512 )
+			{
+				fit = ((room - used - 2*MK_BRH_SIZE)/512)*512;
+				brh = bodies + (size_t)(nbodies-1)*room + used;
+				put_u16( brh, (unsigned int)fit );
+				put_u16( brh+2, rtype );
+				memcpy( brh + MK_BRH_SIZE, data, fit );
+				used += MK_BRH_SIZE + fit;
+				data += fit;
+				len -= fit;
+				continue;
+			}
+			end_body();
+			new_body();
+			continue;
+		}
+		brh = bodies + (size_t)(nbodies-1)*room + used;
+		put_u16( brh, (unsigned int)len );
+		put_u16( brh+2, rtype );
+		memcpy( brh + MK_BRH_SIZE, data, len );
+		used += MK_BRH_SIZE + len;
+		return;
+	}
+}
+
+/* Add an attribute to a summary or file record */
+static size_t add_bsa( unsigned char *rec, size_t len, int type, const void *data, size_t dlen )
+{
+	put_u16( rec+len, (unsigned int)dlen );
+	put_u16( rec+len+2, type );
+	memcpy( rec+len+4, data, dlen );
+	return len + 4 + dlen;
+}
+
+static void add_summary( const char *ssname )
+{
+	unsigned char rec[512], val[4];
+	char cmd[40];
+	size_t len;
+
+	rec[0] = rec[1] = 1;
+	len = add_bsa( rec, 2, 1, ssname, strlen(ssname) );
+	sprintf( cmd, "BACKUP/GROUP=%d", group );
+	len = add_bsa( rec, len, 2, cmd, strlen(cmd) );
+	put_u32( val, bsize );
+	len = add_bsa( rec, len, 13, val, 4 );
+	put_u16( val, group );
+	len = add_bsa( rec, len, 14, val, 2 );
+	put_u16( val, 3 );
+	len = add_bsa( rec, len, 15, val, 2 );
+	len = add_bsa( rec, len, 0, "", 0 );
+	add_record( MK_SUMMARY, rec, len );
+}
+
+static void add_file( int fi )
+{
+	static const char *types[] = { "TXT", "DAT", "LIS" };
+	unsigned char rec[512], fmt[32], val[8], *data;
+	char name[80], line[300];
+	size_t size, alloc, off, len;
+	unsigned long nblk;
+	int kind, ii, nlines;
+
+	kind = fi % 3;
+	sprintf( name, "[TEST.SUB%d]FILE%d.%s;1", fi % 2, fi, types[kind] );
+	if ( kind == 1 )		/* FIXED 512 */
+	{
+		size = (binblocks + 1 + rnd() % 30)*512;
+		data = (unsigned char *)mk_alloc( size );
+		for ( off = 0; off < size; ++off )
+			data[off] = (unsigned char)rnd();
+	}
+	else				/* VAR with CR carriage control */
+	{
+		nlines = varlines ? varlines : (int)(5 + rnd() % 396);
+		alloc = (size_t)nlines*(sizeof(line) + 3);
+		data = (unsigned char *)mk_alloc( alloc );
+		size = 0;
+		for ( ii = 0; ii < nlines; ++ii )
+		{
+			sprintf( line, "line %d of %s ", ii, name );
+			len = strlen( line );
+			off = varwidth ? rnd() % (varwidth + 1) : 0;
+			memset( line + len, 'x', off );
+			len += off;
+			put_u16( data + size, (unsigned int)len );
+			memcpy( data + size + 2, line, len );
+			size += 2 + len + (len & 1);
+		}
+	}
+	nblk = (size + 511)/512;
+	memset( fmt, 0, sizeof(fmt) );
+	fmt[0] = kind == 1 ? 1 : 2;	/* FIXED or VAR */
+	fmt[1] = kind == 1 ? 0 : 2;	/* CR */
+	put_u16( fmt+2, kind == 1 ? 512 : 200 );
+	put_u16( fmt+8, (unsigned int)(nblk >> 16) );
+	put_u16( fmt+10, (unsigned int)(nblk & 0xFFFF) );
+	put_u16( fmt+12, (unsigned int)(size - (nblk-1)*512) );
+	fmt[15] = 2;
+	rec[0] = rec[1] = 1;
+	len = add_bsa( rec, 2, 0x2A, name, strlen(name) );
+	put_u16( val, 1 );
+	put_u16( val+2, 2 );
+	len = add_bsa( rec, len, 0x2F, val, 4 );
+	len = add_bsa( rec, len, 0x34, fmt, sizeof(fmt) );
+	memset( val, 0, sizeof(val) );
+	val[0] = (unsigned char)fi;
+	val[6] = 0xA0;
+	len = add_bsa( rec, len, 0x37, val, 8 );
+	len = add_bsa( rec, len, 0, "", 0 );
+	add_record( MK_FILE, rec, len );
+	for ( off = 0; off < nblk*512; off += MK_VBN_BLOCKS*512 )
+	{
+		len = nblk*512 - off;
+		if ( len > MK_VBN_BLOCKS*512 )
+			len = MK_VBN_BLOCKS*512;
+		if ( off + len > size )	/* last one is padded out with zeros */
+		{
+			unsigned char *pad = (unsigned char *)mk_alloc( len );
+			memcpy( pad, data + off, size - off );
+			add_record( MK_VBN, pad, len );
+			free( pad );
+		}
+		else
+			add_record( MK_VBN, data + off, len );
+	}
+	free( data );
+}
+
+/* Put a header on a block and write it */
+static void put_block( unsigned char *blk, const unsigned char *body, unsigned long num,
+					   int applic, const char *ssname, unsigned long number, int damage )
+{
+	memset( blk, 0, MK_BBH_SIZE );
+	put_u16( blk, MK_BBH_SIZE );
+	put_u16( blk+2, 0x400 );
+	put_u16( blk+4, 1 );
+	put_u16( blk+6, applic );
+	put_u32( blk+8, num );
+	put_u16( blk+32, 1 );
+	put_u16( blk+34, volume );
+	put_u32( blk+40, bsize );
+	blk[48] = (unsigned char)strlen( ssname );
+	memcpy( blk+49, ssname, strlen(ssname) );
+	memcpy( blk + MK_BBH_SIZE, body, bsize - MK_BBH_SIZE );
+	if ( crcs && !number )
+		put_u32( blk+36, crc32( blk, bsize ) );
+	if ( number )			/* renumbered, the CRC would be wrong */
+		put_u32( blk+8, number );
+	if ( damage )			/* after the CRC so it fails */
+		blk[MK_BBH_SIZE + 44] ^= 0x55;
+	put_record( blk, bsize );
+	++volused;
+}
+
+/* End the volume in the middle of a saveset and carry on with the next */
+static void new_volume( const char *ssname, int set )
+{
+	char *name, label[81];
+
+	put_record( NULL, 0 );
+	sprintf( label, "EOV1%-17s", ssname );
+	put_label( label );
+	sprintf( label, "EOV2F%05d", bsize );
+	put_label( label );
+	put_record( NULL, 0 );
+	put_record( NULL, 0 );
+	close_out();
+	++volume;
+	volused = 0;
+	name = (char *)mk_alloc( strlen( outname ) + 12 );
+	sprintf( name, "%s.%d", outname, volume );
+	open_out( name );
+	free( name );
+	put_label( "VOL1TESTVOL" );
+	sprintf( label, "HDR1%-17sTESTVO%04d%04d", ssname, volume, set+1 );
+	put_label( label );
+	sprintf( label, "HDR2F%05d%05d", bsize, bsize );
+	put_label( label );
+	put_record( NULL, 0 );
+}
+
+static void usage( void )
+{
+	printf( "Usage: mkimage [options] outfile\n"
+			"Where:\n"
+			"-b n      Blocksize (default 8192)\n"
+			"-B        Write a disk saveset (.BCK) instead of a tape image (just the one saveset)\n"
+			"-c        Write block CRCs\n"
+			"-f n      Files in each saveset (default 20)\n"
+			"-g n      /GROUP_SIZE, an XOR block after each n blocks (default none)\n"
+			"-I        Write a SIMH tape image instead of a -i one\n"
+			"-k n      Extra disk blocks in each binary file\n"
+			"-l n      Lines in each text file (default a few hundred)\n"
+			"-r n      Seed (default 1)\n"
+			"-s n      Savesets (default 1)\n"
+			"-v n      Start another volume (outfile.2, ...) after every n blocks\n"
+			"-w n      Longest padding of a text line (default 120)\n"
+			"Damage to the first saveset (block numbers count from 1):\n"
+			"-d n      Write block n twice, the first copy damaged\n"
+			"-D n      Write block n twice, the second copy damaged\n"
+			"-j n:m    Give block n the block number m\n"
+			"-x n      Leave block n out\n"
+			);
+	exit(1);
+}
+
+int main( int argc, char *argv[] )
+{
+	unsigned long dup1 = 0, dup2 = 0, jump = 0, jumpto = 0, drop = 0;
+	unsigned long num, bn;
+	unsigned char *blk, *xor;
+	char ssname[20], label[81];
+	int cc, set, ii, jj, room, ngrp;
+
+	while ( (cc = getopt( argc, argv, "b:Bcd:D:f:g:Ij:k:l:r:s:v:w:x:" )) != EOF )
+	{
+		switch (cc)
+		{
+		case 'b':
+			bsize = atoi( optarg );
+			break;
+		case 'B':
+		case 'I':
+			format = cc;
+			break;
+		case 'c':
+			crcs = 1;
+			break;
+		case 'd':
+			dup1 = strtoul( optarg, NULL, 0 );
+			break;
+		case 'D':
+			dup2 = strtoul( optarg, NULL, 0 );
+			break;
+		case 'f':
+			nfiles = atoi( optarg );
+			break;
+		case 'g':
+			group = atoi( optarg );
+			break;
+		case 'j':
+			if ( sscanf( optarg, "%lu:%lu", &jump, &jumpto ) != 2 )
+				usage();
+			break;
+		case 'k':
+			binblocks = atoi( optarg );
+			break;
+		case 'l':
+			varlines = atoi( optarg );
+			break;
+		case 'r':
+			seed = strtoul( optarg, NULL, 0 );
+			break;
+		case 's':
+			nsets = atoi( optarg );
+			break;
+		case 'v':
+			volblocks = atoi( optarg );
+			break;
+		case 'w':
+			varwidth = atoi( optarg );
+			if ( varwidth > 200 )
+				varwidth = 200;
+			break;
+		case 'x':
+			drop = strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			usage();
+		}
+	}
+	if ( optind != argc-1 || bsize < 2048 || bsize > 65024 || (bsize & 511) || nfiles < 1 || nsets < 1
+		 || (format == 'B' && (nsets > 1 || volblocks)) )
+		usage();
+	outname = argv[optind];
+	open_out( outname );
+	room = bsize - MK_BBH_SIZE;
+	blk = (unsigned char *)mk_alloc( bsize );
+	xor = (unsigned char *)mk_alloc( room );
+	put_label( "VOL1TESTVOL" );
+	for ( set = 0; set < nsets; ++set )
+	{
+		sprintf( ssname, "SET%d.BCK", set+1 );
+		nbodies = 0;
+		add_summary( ssname );
+		for ( ii = 0; ii < nfiles; ++ii )
+			add_file( ii );
+		end_body();
+		sprintf( label, "HDR1%-17sTESTVO0001%04d", ssname, set+1 );
+		put_label( label );
+		sprintf( label, "HDR2F%05d%05d", bsize, bsize );
+		put_label( label );
+		put_record( NULL, 0 );
+		num = 0;
+		ngrp = 0;
+		for ( ii = 0; ii < nbodies; ++ii )
+		{
+			const unsigned char *body = bodies + (size_t)ii*room;
+			int applic = 1;
+
+			for ( jj = 0; jj < 2; ++jj )	/* a data block, then maybe an XOR block */
+			{
+				if ( volblocks && volused >= volblocks && num )
+					new_volume( ssname, set );	/* not before its first block */
+				bn = ++num;
+				if ( set || bn != drop )
+				{
+					if ( !set && bn == dup1 )
+						put_block( blk, body, bn, applic, ssname, 0, 1 );
+					put_block( blk, body, bn, applic, ssname, !set && bn == jump ? jumpto : 0, 0 );
+					if ( !set && bn == dup2 )
+						put_block( blk, body, bn, applic, ssname, 0, 1 );
+				}
+				if ( jj || !group )
+					break;
+				if ( !ngrp++ )
+					memset( xor, 0, room );
+				for ( cc = 0; cc < room; ++cc )
+					xor[cc] ^= body[cc];
+				if ( ngrp < group )
+					break;
+				ngrp = 0;
+				body = xor;
+				applic = 2;
+			}
+		}
+		put_record( NULL, 0 );
+		sprintf( label, "EOF1%-17s", ssname );
+		put_label( label );
+		sprintf( label, "EOF2F%05d", bsize );
+		put_label( label );
+		put_record( NULL, 0 );
+	}
+	put_record( NULL, 0 );
+	close_out();
+	return 0;
+}
@@ -0,0 +1,250 @@
+#!/bin/sh
+#
+# Regression tests for vmsbackup. Run by "make test", or by hand:
+#
+#   sh tests/run_tests.sh [vmsbackup [mkimage]]
+#
+# Each test makes its images with mkimage, so nothing needs to be kept
+# in the tree. A damaged image is made with the same options as a clean
+# one and what is extracted from both is compared.
+
+VMSBACKUP=${1:-./vmsbackup}
+MKIMAGE=${2:-./tests/mkimage}
+case $VMSBACKUP in /*) ;; *) VMSBACKUP=`pwd`/$VMSBACKUP ;; esac
+case $MKIMAGE in /*) ;; *) MKIMAGE=`pwd`/$MKIMAGE ;; esac
+
+WORK=`mktemp -d ${TMPDIR:-/tmp}/vmsbackup_tests.XXXXXX` || exit 1
+trap 'rm -rf "$WORK"' 0
+failed=0
+
+# image NAME MKIMAGE-OPTIONS...
+image() {
+	name=$1
+	shift
+	"$MKIMAGE" "$@" "$WORK/$name.data" || { echo "mkimage $* failed"; exit 1; }
+}
+
+# extract_from NAME FILE VMSBACKUP-OPTIONS... (into NAME.x, output is left in NAME.log)
+extract_from() {
+	name=$1
+	file=$2
+	shift 2
+	rm -rf "$WORK/$name.x"
+	mkdir "$WORK/$name.x"
+	( cd "$WORK/$name.x" && "$VMSBACKUP" -x -d "$@" -f "$file" ) > "$WORK/$name.log" 2>&1
+}
+
+# extract NAME VMSBACKUP-OPTIONS... (NAME.data as a -i image)
+extract() {
+	name=$1
+	shift
+	extract_from "$name" "../$name.data" -i "$@"
+}
+
+# same NAME TEST-NAME (NAME.x has to be the same as clean.x)
+same() {
+	diff -r "$WORK/clean.x" "$WORK/$1.x" > "$WORK/$1.diff" 2>&1
+	status=$?
+	[ $status = 0 ] || cat "$WORK/$1.log" >> "$WORK/$1.diff"
+	result "$2" $status "$WORK/$1.diff"
+}
+
+# result TEST-NAME STATUS [LOG]
+result() {
+	if [ "$2" = 0 ]
+	then
+		echo "PASS $1"
+	else
+		echo "FAIL $1"
+		[ -n "$3" ] && sed 's/^/    /' "$3"
+		failed=1
+	fi
+}
+
+# However the image is read it has to give the same files.
+image clean -f 40
+extract clean
+for opts in --nomap --direct --uring=4 "--direct --uring=4" --readahead=0 "--nomap --readahead=0"
+do
+	extract_from clean_in ../clean.data -i $opts
+	same clean_in "input $opts"
+done
+extract_from stdin - -i < "$WORK/clean.data"
+same stdin "input -f -"
+
+# A compressed image is found out from its first bytes, from a file or
+# from a pipe.
+for z in gzip bzip2 xz
+do
+	command -v $z > /dev/null || { echo "SKIP input $z (no $z)"; continue; }
+	$z -c "$WORK/clean.data" > "$WORK/clean.$z"
+	extract_from $z "../clean.$z"
+	if grep -q "support for that wasn't built in" "$WORK/$z.log"
+	then
+		echo "SKIP input $z (not built in)"
+		continue
+	fi
+	same $z "input $z"
+	extract_from ${z}_pipe - < "$WORK/clean.$z"
+	same ${z}_pipe "input $z from -f -"
+done
+
+# So are SIMH images and disk savesets, without -i or -I.
+image simh -f 40 -I
+image disk -f 40 -B
+for fmt in simh disk
+do
+	extract_from $fmt "../$fmt.data"
+	"$VMSBACKUP" -t -f "$WORK/$fmt.data" | grep "^Format:" >> "$WORK/$fmt.log"
+	same $fmt "input $fmt"
+done
+grep -q "^Format: -I (SIMH) image" "$WORK/simh.log" \
+	&& grep -q "^Format: disk saveset (.BCK)" "$WORK/disk.log"
+result "format probe" $? "$WORK/disk.log"
+
+# -s and -n pick out one saveset. The first of two is the same as a
+# saveset made alone with the same options.
+image one -f 20
+image two -f 20 -s 2
+extract one
+extract_from two_s1 ../two.data -i -s 1
+extract_from two_s2 ../two.data -i -s 2
+extract_from two_n2 ../two.data -i -n SET2.BCK
+diff -r "$WORK/one.x" "$WORK/two_s1.x" > "$WORK/two.diff" 2>&1 \
+	&& diff -r "$WORK/two_s2.x" "$WORK/two_n2.x" >> "$WORK/two.diff" 2>&1 \
+	&& ! diff -r "$WORK/two_s1.x" "$WORK/two_s2.x" > /dev/null 2>&1
+result "saveset picked by -s and -n" $? "$WORK/two.diff"
+
+# A block with a bad block number far past the others is tossed, and
+# the blocks after it are still used.
+image clean_g10 -f 60 -g 10
+image jump -f 60 -g 10 -j 5:900000
+extract clean_g10
+extract jump
+diff -r "$WORK/clean_g10.x" "$WORK/jump.x" > "$WORK/jump.diff" 2>&1 \
+	&& grep -q "Found block numbered 900000 too far" "$WORK/jump.log"
+result "bad block number" $? "$WORK/jump.diff"
+
+# One not so far past the others goes the same way, and --check has to
+# agree: a bad header in place of block 5, nothing missing or out of order.
+image jump_near -f 60 -g 10 -j 5:5000
+extract jump_near
+diff -r "$WORK/clean_g10.x" "$WORK/jump_near.x" > "$WORK/jump_near.diff" 2>&1 \
+	&& grep -q "Found block numbered 5000 too far" "$WORK/jump_near.log"
+result "bad block number near" $? "$WORK/jump_near.diff"
+"$VMSBACKUP" --check -i -f "$WORK/jump_near.data" > "$WORK/jump_near.check" 2>&1
+grep -q "bad header in place of: 5 (1 block)" "$WORK/jump_near.check" \
+	&& grep -q "numbered 1 to 127\." "$WORK/jump_near.check" \
+	&& ! grep -q -e "missing:" -e "out of order" "$WORK/jump_near.check"
+result "bad block number near (--check)" $? "$WORK/jump_near.check"
+
+# A block left out is rebuilt from the rest of its redundancy group,
+# be it one of the data blocks or the group's XOR block (11 of -g 10).
+for gap in 5 11
+do
+	image gap_$gap -f 60 -g 10 -x $gap
+	extract gap_$gap
+	diff -r "$WORK/clean_g10.x" "$WORK/gap_$gap.x" > "$WORK/gap_$gap.diff" 2>&1 \
+		&& grep -q "block $gap is missing. Rebuilt it from its redundancy group" "$WORK/gap_$gap.log"
+	result "missing block $gap rebuilt" $? "$WORK/gap_$gap.diff"
+done
+
+# A saveset split across volumes (-v 45 makes three of it, split in the
+# middle of a redundancy group) extracts the same as it does whole, -f
+# given for each volume, with or without the reader thread. With the
+# middle volume left out the volume numbers in the block headers don't
+# follow on, and that has to be said.
+image vol -f 60 -g 10 -v 45
+for opt in --readahead=32 --readahead=0
+do
+	rm -rf "$WORK/vol.x"
+	mkdir "$WORK/vol.x"
+	( cd "$WORK/vol.x" && "$VMSBACKUP" -x -d -i $opt -f ../vol.data -f ../vol.data.2 -f ../vol.data.3 ) > "$WORK/vol.log" 2>&1
+	diff -r "$WORK/clean_g10.x" "$WORK/vol.x" > "$WORK/vol.diff" 2>&1 \
+		&& ! grep -q "volume" "$WORK/vol.log"
+	status=$?
+	[ $status = 0 ] || cat "$WORK/vol.log" >> "$WORK/vol.diff"
+	result "three volumes ($opt)" $status "$WORK/vol.diff"
+done
+"$VMSBACKUP" --check -i -f "$WORK/vol.data" -f "$WORK/vol.data.2" -f "$WORK/vol.data.3" > "$WORK/vol.check" 2>&1 \
+	&& grep -q "numbered 1 to 127\. OK" "$WORK/vol.check"
+result "three volumes (--check)" $? "$WORK/vol.check"
+( cd "$WORK/vol.x" && "$VMSBACKUP" -x -d -i -f ../vol.data -f ../vol.data.3 ) > "$WORK/vol.log" 2>&1
+grep -q "continues with blocks of volume 3. Expected volume 2" "$WORK/vol.log"
+result "volume left out" $? "$WORK/vol.log"
+
+# With a catalog written by -t, -x of some files reads just their
+# blocks and gets the same as a plain -x. Once the image has been
+# changed the catalog is no good and the whole image is read instead.
+PAT='[[]TEST.SUB1]*'
+image cat -f 60
+"$VMSBACKUP" -t -i --catalog="$WORK/cat.cat" -f "$WORK/cat.data" > "$WORK/cat.list" 2>&1
+"$VMSBACKUP" --check -i -f "$WORK/cat.data" > "$WORK/cat.check" 2>&1
+total=`sed -n "s/.*: \([0-9]*\) blocks of .*/\1/p" "$WORK/cat.check"`
+for pass in unchanged changed
+do
+	if [ $pass = changed ]
+	then
+		sleep 1			# so the edit changes its modification time
+		off=`grep -a -b -o "line 5 of \[TEST.SUB1\]" "$WORK/cat.data" | head -1 | cut -d: -f1`
+		printf 'L' | dd of="$WORK/cat.data" bs=1 seek="$off" conv=notrunc 2> /dev/null
+	fi
+	extract cat "$PAT"
+	rm -rf "$WORK/cat_plain.x"
+	mv "$WORK/cat.x" "$WORK/cat_plain.x"
+	extract cat --stats --catalog="$WORK/cat.cat" "$PAT"
+	nblks=`sed -n "s/^Catalog: read \([0-9]*\) blocks.*/\1/p" "$WORK/cat.log"`
+	if [ $pass = unchanged ]
+	then
+		diff -r "$WORK/cat_plain.x" "$WORK/cat.x" > "$WORK/cat.diff" 2>&1 \
+			&& [ -n "$nblks" ] && [ -n "$total" ] && [ "$nblks" -lt "$total" ]
+	else
+		diff -r "$WORK/cat_plain.x" "$WORK/cat.x" > "$WORK/cat.diff" 2>&1 \
+			&& [ -z "$nblks" ] && grep -q "^Catalog: wrote" "$WORK/cat.log"
+	fi
+	status=$?
+	[ $status = 0 ] || { echo "read $nblks of $total blocks"; cat "$WORK/cat.log"; } >> "$WORK/cat.diff"
+	result "catalog extract ($pass image)" $status "$WORK/cat.diff"
+done
+
+# The block CRC is the AUTODIN-II one gzip puts in its trailer. With
+# gzip's CRC of block 3 (the CRC field taken as zero) put in an image
+# made without CRCs the block has to pass, and with its complement in
+# place of it the block has to fail.
+image kat -f 10
+off=`expr 256 + 2 \* 8196 + 4`		# VOL1, HDR1, HDR2, tape mark, blocks 1-2
+dd if="$WORK/kat.data" of="$WORK/kat.blk" bs=1 skip=$off count=8192 2> /dev/null
+gzip -c "$WORK/kat.blk" | tail -c 8 | head -c 4 > "$WORK/kat.crc"
+cp "$WORK/kat.data" "$WORK/kat_not.data"
+for b in `od -An -tu1 "$WORK/kat.crc"`
+do
+	printf "\\`printf %o \`expr 255 - $b\``"
+done > "$WORK/kat_not.crc"
+dd if="$WORK/kat.crc" of="$WORK/kat.data" bs=1 seek=`expr $off + 36` conv=notrunc 2> /dev/null
+dd if="$WORK/kat_not.crc" of="$WORK/kat_not.data" bs=1 seek=`expr $off + 36` conv=notrunc 2> /dev/null
+"$VMSBACKUP" --check --crc -i -f "$WORK/kat.data" > "$WORK/kat.check" 2>&1 \
+	&& ! grep -q "failed CRC" "$WORK/kat.check"
+result "block CRC known answer" $? "$WORK/kat.check"
+"$VMSBACKUP" --check --crc -i -f "$WORK/kat_not.data" > "$WORK/kat_not.check" 2>&1
+grep -q "failed CRC: 3 (1 block)" "$WORK/kat_not.check"
+result "block CRC complement rejected" $? "$WORK/kat_not.check"
+
+# Of a block read twice the later copy is used, unless it failed its
+# CRC check (--crc) and the earlier one didn't. --check has to agree.
+image clean_c -f 30 -c
+extract clean_c
+for which in d D
+do
+	image dup_$which -f 30 -c -$which 7
+	extract dup_$which --crc
+	diff -r "$WORK/clean_c.x" "$WORK/dup_$which.x" > "$WORK/dup_$which.diff" 2>&1
+	result "duplicate block (-$which) extract" $? "$WORK/dup_$which.diff"
+	"$VMSBACKUP" --check=2 --crc -i -f "$WORK/dup_$which.data" > "$WORK/dup_$which.check" 2>&1 \
+		&& grep -q "duplicated: 7 (1 block)" "$WORK/dup_$which.check" \
+		&& ! grep -q "failed CRC" "$WORK/dup_$which.check"
+	result "duplicate block (-$which) check" $? "$WORK/dup_$which.check"
+done
+grep -q "Found duplicate block numbered 7 with a bad CRC. Discarded it" "$WORK/dup_D.log"
+result "duplicate block (-D) warning" $? "$WORK/dup_D.log"
+
+exit $failed
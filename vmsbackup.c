@@ -148,6 +148,70 @@
  *  	Re-worked the method of exporting binary as a result of
  *  	errors in VAR/VFC record structures.
  *
+ *  Version 3.13 - October 2026
+ *  	Memory map -i and -I images that are regular files and pick
+ *  	the record framing straight out of the mapping.
+ *  	Read -i and -I images that can't be mapped in large chunks
+ *  	and parse the framing out of the buffer. Added --inbuf and --nomap.
+ *  	Read ahead in a separate thread so reading overlaps decoding and
+ *  	writing. Added --readahead and --stats.
+ *  	Optionally read regular file images with io_uring keeping several
+ *  	large reads in flight. Added --uring.
+ *  	Added --direct to read images with O_DIRECT (or at least
+ *  	drop them from the page cache) so huge images don't flush it.
+ *  	Decompress gzip, bzip2, xz and zstd compressed -i and -I images
+ *  	on the fly.
+ *  	Read -i and -I images from stdin (-f -) and FIFOs.
+ *  	Work out from the first few records whether an image is -i, -I
+ *  	or a disk saveset (.BCK) instead of relying on -i and -I, and
+ *  	show which in the listing.
+ *  	Read a saveset spread over several volumes given as more than one
+ *  	-f (or a wildcard) as one stream.
+ *  	Skip unwanted savesets (-n, -s) without reading them: only the
+ *  	record lengths of an image are read, a tape is spaced with MTFSF.
+ *  	Read a tape drive through a deep ring (--tapebuf) so the drive
+ *  	keeps streaming, and show where it had to stop with --stats.
+ *  	Added tapeemu.c, an LD_PRELOAD tape drive emulator with a transfer
+ *  	rate and reposition penalty, to test and time the tape code.
+ *  	Keep the blocks read ahead in a ring indexed by block number
+ *  	instead of a list that was searched and sorted on every refill.
+ *  	A block numbered far past the ring is only believed if the next
+ *  	block follows on from it, else it's tossed as a bad block number.
+ *  	Size the read-ahead window from the /BUFFER_COUNT and /GROUP_SIZE
+ *  	in the summary record instead of a fixed 10 blocks. Added --window.
+ *  	Allocate the block buffers as one aligned slab instead of one at a
+ *  	time. Added --hugepages.
+ *  	Hand blocks of a mapped image to process_block() where they are
+ *  	instead of copying each one into a buffer first.
+ *  	The 32 bit header fields are ints, not longs, so a 64 bit build
+ *  	reads savesets too.
+ *  	Rebuild a missing block from the rest of its redundancy group and
+ *  	the group's XOR block instead of losing the file it belongs to.
+ *  	With --crc check the CRC of each block (blkcrc.c). One that fails
+ *  	is rebuilt from its redundancy group if it can be, else its file
+ *  	is flagged. It's off by default until it has been tried against
+ *  	savesets written by VMS. Added --crc and --nocrc.
+ *  	Added --check to check a tape or image for missing, duplicated
+ *  	and bad blocks without extracting anything, with the CRCs done
+ *  	by a pool of threads (check.c).
+ *  	Added --quick to list (-t) from the file records alone, skipping
+ *  	the blocks that can only hold file data without reading them.
+ *  	The -v tracing levels (all but 0x01) are only built in with
+ *  	HAVE_TRACE=1 or as vmsbackup_trace, and getu16()/getu32() are
+ *  	inline loads, so decoding doesn't test vflag for every record.
+ *  	Added --catalog to note the savesets and files of an image in a
+ *  	catalog file (catalog.c) as it's read, and to list (-t) the image
+ *  	from that instead of reading it again.
+ *  	The catalog also has where each block is in the image, so -x with
+ *  	patterns reads just the blocks of the files they select.
+ *  	Added --patterns-from to read patterns from a file. All of them
+ *  	are compiled into one matcher (patterns.c, replacing match.c) so
+ *  	a name is tested in one pass however many there are. Only a
+ *  	directory written "[[]DIR]*" goes in its prefix trie.
+ *  	Added --exclude, --exclude-from and --exclude-type. The file types
+ *  	not extracted are one sorted table matched on the whole type, in
+ *  	place of typecmp()'s lists, and checked before openfile().
+ *
  *  Installation:
  *
  *	Computer Centre
@@ -164,6 +228,7 @@
 #include	<string.h>
 #include	<strings.h>
 #include	<stdlib.h>
+#include	<stddef.h>
 #include	<unistd.h>
 #include	<getopt.h>
 #include	<time.h>
@@ -182,6 +247,17 @@
 #endif
 #include	<sys/file.h>
 
+#if HAVE_GLOB
+#include	<glob.h>
+#endif
+#include	"tapeio.h"
+#include	"decomp.h"
+#include	"blkcrc.h"
+#include	"check.h"
+#include	"catalog.h"
+#include	"patterns.h"
+#include	"saveset.h"
+
 #if MSYS2 || MINGW
 #define MKDIR(a,b) mkdir(a)
 #define OPEN_FLAGS O_RDONLY|O_BINARY
@@ -196,8 +272,6 @@
 
 #define INT_SIZEOF(x) (int)(sizeof(x))
 
-extern int match ( const char *string, const char *pattern );
-static int typecmp ( const char *str, int which );
 
 #define MAX_FILENAME_LEN (128)
 #define MAX_FORMAT_LEN	 (16)
@@ -208,13 +282,13 @@ struct bbh
 	short bbh_dol_w_opsys;
 	short bbh_dol_w_subsys;
 	short bbh_dol_w_applic;
-	long bbh_dol_l_number;
+	int bbh_dol_l_number;
 	char bbh_dol_t_spare_1[20];
 	short bbh_dol_w_struclev;
 	short bbh_dol_w_volnum;
-	long bbh_dol_l_crc;
-	long bbh_dol_l_blocksize;
-	long bbh_dol_l_flags;
+	int bbh_dol_l_crc;
+	int bbh_dol_l_blocksize;
+	int bbh_dol_l_flags;
 	char bbh_dol_t_ssname[32];
 	short bbh_dol_w_fid[3];
 	short bbh_dol_w_did[3];
@@ -225,22 +299,30 @@ struct bbh
 	char bbh_dol_b_bktsize;
 	char bbh_dol_b_vfcsize;
 	short bbh_dol_w_maxrec;
-	long bbh_dol_l_filesize;
+	int bbh_dol_l_filesize;
 	char bbh_dol_t_spare_2[22];
 	short bbh_dol_w_checksum;
 };
 
+/* saveset.h has where things are for code that doesn't use struct bbh, they have to agree */
+typedef char bbh_size_ok[sizeof(struct bbh) == SS_BBH_SIZE ? 1 : -1];
+typedef char bbh_crc_ok[offsetof( struct bbh, bbh_dol_l_crc ) == SS_BBH_CRC ? 1 : -1];
+typedef char bbh_number_ok[offsetof( struct bbh, bbh_dol_l_number ) == SS_BBH_NUMBER ? 1 : -1];
+typedef char bbh_blocksize_ok[offsetof( struct bbh, bbh_dol_l_blocksize ) == SS_BBH_BLKSIZE ? 1 : -1];
+
 static unsigned long last_block_number;
 
 struct brh
 {
 	short brh_dol_w_rsize;
 	short brh_dol_w_rtype;
-	long brh_dol_l_flags;
-	long brh_dol_l_address;
-	long brh_dol_l_spare;
+	int brh_dol_l_flags;
+	int brh_dol_l_address;
+	int brh_dol_l_spare;
 };
 
+typedef char brh_size_ok[sizeof(struct brh) == SS_BRH_SIZE ? 1 : -1];
+
 /* define record types */
 
 #define	brh_dol_k_null	0
@@ -312,7 +394,10 @@ struct file_details
 	FileState_t file_state;
 } file;
 
-char *tapefile;
+char *tapefile;			/* name of volume being read */
+static char **tapefiles;	/*!< names of the volumes given with -f, in order */
+static int num_tapefiles;	/*!< number of them */
+static int cur_tapefile;	/*!< index of the one being read */
 
 time_t secs_adj;
 
@@ -384,6 +469,10 @@ time_t secs_adj;
 
 int fd;				/* tape file descriptor */
 int cDelim, dflag, eflag, iflag, Iflag, lcflag, nflag, binaryFlag, tflag, vflag, wflag, xflag, Rflag, vfcflag;
+int statflag;
+int crcflag;			/*!< check block CRCs (--crc) */
+int checkflag;			/*!< just check the tape (--check) */
+int checkthreads;		/*!< threads to check it with (0 for one per CPU) */
 int setnr, selset, skipSet, numHdrs, saveSet_errors, total_errors;
 char selsetname[14];
 
@@ -400,9 +489,26 @@ int skipping;			/*!< Bit mask of errors as described below */
 #define VERB_DEBUG_LVL	(16)	/* generic debug statements */
 #define VERB_BLOCK_LVL	(32) /* squawk during block processing */
 #define VERB_DEBUG_U32	(64) /* squawk about what getu32() does */
+#define VERB_TRACE	(VERB_FILE_RDLVL|VERB_FILE_WRLVL|VERB_QUEUE_LVL|VERB_DEBUG_LVL|VERB_BLOCK_LVL|VERB_DEBUG_U32)
+
+/*
+ * The squawks are tested with VERB(). Unless it's built with
+ * HAVE_TRACE=1 (or as vmsbackup_trace) only VERB_LVL is left and the
+ * tests for the others are compiled out, so decoding a block doesn't
+ * look at vflag for every record, field and record length in it.
+ */
+#if HAVE_TRACE
+#define VERB(bits)	(vflag & (bits))
+#else
+#define VERB(bits)	(vflag & (bits) & VERB_LVL)
+#endif
 
 char **gargv;
 int goptind, gargc;
+static struct pat_set *patterns;	/*!< patterns selecting files (NULL if there aren't any) */
+static struct pat_set *excl_pats;	/*!< patterns of files left out (--exclude, NULL if there aren't any) */
+static char **excl_types;		/*!< file types not extracted, sorted once the options are in */
+static int excl_ntypes;			/*!< number of them */
 
 #define	LABEL_SIZE	80
 char label[32768 + LABEL_SIZE];
@@ -410,63 +516,147 @@ char label[32768 + LABEL_SIZE];
 static int blocksize;
 
 /*
- * Someday, one might want to make MAX_BUFFCOUNT dynamic and get the actual
- * value from the /BUFF field of the backup command (as reported in the
- * summary record). For now, I just picked something that seemed reasonable.
+ * The number of blocks read ahead (the window in which duplicate and out
+ * of order blocks are put right) comes from the /BUFFER_COUNT and
+ * /GROUP_SIZE in the saveset's summary record, or --window. BACKUP can
+ * have /BUFFER_COUNT blocks on the go at once so a block it had to write
+ * again can turn up that many blocks late, and all of a redundancy group
+ * (/GROUP_SIZE blocks and its XOR block) has to be on hand to rebuild one
+ * of them (see ss_window()). MAX_BUFFCOUNT is the least it'll be.
  */
-#ifndef MAX_BUFFCOUNT
-	#define MAX_BUFFCOUNT (10)	/*!< Number of look ahead buffers */
-#endif
+#define MAX_WINDOW_OPT	(8192)	/*!< most look ahead buffers --window can ask for */
+#define MAX_GROUP_SIZE	(100)	/*!< largest /GROUP_SIZE BACKUP allows (bigger ones aren't rebuilt) */
 
 /* A 'buffer' is actually a struct buff_ctl */
 
 struct buff_ctl
 {
 	unsigned char *buffer;	/*!< pointer to buffer */
-	int next;			/*!< index to next buffer (kept as index so we can realloc if necessary) */
-	int amt;			/*!< amount of data in this buffer (0=tape mark) */
+	unsigned char *data;	/*!< pointer to block (buffer, or the block in place in a mapped image) */
+	int next;			/*!< index to next free buffer (kept as index so we can realloc if necessary) */
+	int amt;			/*!< amount of data in this buffer */
 	unsigned long blknum;	/*!< block number (stored here for ease of use) */
+	int crcbad;		/*!< block failed its CRC check */
+	off_t off;		/*!< image offset of block (-1 if not known) */
 };
 
+#define BUFF_SLOT_ALIGN	(512)	/*!< buffer sizes are rounded up to this (suits O_DIRECT) */
+
 static int buffalloc;		/*!< size of each buffer within buff_ctl */
 static int num_buffers;		/*!< number of buffers currently allocated */
 static int buff_cnt;		/*!< buffer count spec'd with /BUFF to VMS BACKUP (from saveset) */
+static int grp_size;		/*!< redundancy group size spec'd with /GROUP to VMS BACKUP (from saveset) */
+static int read_window = MAX_BUFFCOUNT;	/*!< number of blocks to read ahead in this saveset */
+static int window_opt;		/*!< --window (0=work it out from the summary record) */
 static struct buff_ctl *buffers; /*!< pointer to array of buffers (0th entry is unused) */
 static int freebuffs;		/*!< index to first item in freelist  */
-static int busybuffs;		/*!< index to first item in busy list */
+
+/*
+ * The busy queue is a ring of slots indexed by block number modulo the
+ * size of the ring, so a block read ahead goes straight into its place.
+ * A duplicate lands on top of the original and blocks that come off the
+ * tape out of order come out of the ring in order, with no searching or
+ * sorting. A block too far ahead to fit, or further past the others
+ * than the window (see ss_faraway()), waits in busy_pend. It is only
+ * believed if the next block read is the one after it, in which case
+ * the tape really skipped, and both wait there until the ring has
+ * emptied. Otherwise its block number was bad and it is tossed. --check
+ * goes by the same rule.
+ */
+static int *busy_ring;		/*!< index of buffer for each block number in the window (0=not read) */
+static unsigned long busy_mask;	/*!< number of slots minus 1 (it's a power of 2) */
+static unsigned long busy_lo;	/*!< lowest block number that can be in the ring */
+static int busy_pend;		/*!< index of block beyond the window waiting for the ring to empty (0=none) */
+static int busy_sure;		/*!< the block after busy_pend was read too (it's held in its next) */
+static int busy_active;		/*!< a saveset's blocks are being read */
+static int busy_tm;		/*!< read ahead has reached the tape mark after them */
 static int num_busys;		/*!< number of items currently on busy queue */
 
+/*
+ * BACKUP follows each /GROUP_SIZE blocks with an XOR block (applic field
+ * above 1) holding the XOR of their data. The blocks of the group that
+ * have been used are kept until it has gone by so a single missing block
+ * can be rebuilt from the rest (see grp_rebuild()).
+ */
+static int grp_kept[MAX_GROUP_SIZE];	/*!< index of each block of the current group already used */
+static int grp_nkept;		/*!< number of them */
+static unsigned long grp_next;	/*!< block number the current group starts with (0=lost track) */
+static int grp_rebuilt;		/*!< number of blocks rebuilt */
+
+/*
+ * A quick listing (-t --quick) only looks at summary and file records.
+ * From a file's size it's known how many of the blocks after its file
+ * record can hold nothing but its data. Those are skipped: the ones
+ * already read are dropped unlooked at and tapeio is told not to bother
+ * with the rest.
+ */
+static int quickflag;		/*!< list without looking at file data (--quick) */
+static unsigned long quick_vbn;	/*!< bytes of VBN records of the current file seen */
+static unsigned long quick_thru;	/*!< blocks up to this one are just file data */
+static unsigned long quick_skipped;	/*!< number of blocks skipped */
+static unsigned long read_hi;	/*!< highest block number read so far (bar one held in busy_pend) */
+
+/*
+ * With --catalog what's decoded is noted as it goes by (see catalog.c)
+ * and written out at the end. A -t of an image that has a catalog is
+ * done from the catalog instead, and a -x with patterns reads just
+ * the blocks the catalog says the files they select are in.
+ */
+static char *catname;		/*!< catalog to list from or write (--catalog) */
+static int cat_packed;		/*!< image is compressed */
+static int cat_written;		/*!< catalog was written */
+static off_t blk_off;		/*!< image offset of block being processed (-1 if not known) */
+static const char *cat_only;	/*!< name of the one file being extracted from the catalog's index */
+
 /* Byte-swapping routines.  Note that these do not depend on the size
    of datatypes such as short, long, etc., nor do they require us to
-   detect the endianness of the machine we are running on.  It is
-   possible they should be macros for speed, but I'm not sure it is
-   worth bothering.  We don't have signed versions although we could
-   add them if needed.  They are, of course little-endian as that is
-   the byteorder used by all integers in a BACKUP saveset.  */
-
-static unsigned long getu32 ( unsigned char *addr )
+   detect the endianness of the machine we are running on.  We don't
+   have signed versions although we could add them if needed.  They
+   are, of course little-endian as that is the byteorder used by all
+   integers in a BACKUP saveset.
+
+   They're used for every block and record header, every field of a
+   file record and every VAR record length, so they're the inline
+   loads in saveset.h (a plain unaligned load with gcc or clang on a
+   little-endian machine). The VERB_DEBUG_U32 squawk is only there
+   with HAVE_TRACE.  */
+
+static SS_INLINE unsigned long getu32 ( const unsigned char *addr )
 {
 	unsigned long ans;
-	ans = addr[3];
-	ans = (ans<<8) | addr[2];
-	ans = (ans<<8) | addr[1];
-	ans = (ans<<8) | addr[0];
-	if ( (vflag&VERB_DEBUG_U32) )
+
+	ans = ss_getu32( addr );
+	if ( VERB(VERB_DEBUG_U32) )
 		printf("getu32(): %p=%02X %02X %02X %02x = 0x%lX (%ld)\n", (void *)addr, addr[0], addr[1], addr[2], addr[3], ans, ans);
 	return ans;
 }
 
-static unsigned int getu16 ( unsigned char *addr )
+static SS_INLINE unsigned int getu16 ( const unsigned char *addr )
 {
 	unsigned int ans;
-	ans = (addr[1] << 8) | addr[0];
-	if ( (vflag&VERB_DEBUG_U32) )
+
+	ans = ss_getu16( addr );
+	if ( VERB(VERB_DEBUG_U32) )
 		printf("getu16(): %p=%02X %02X = 0x%X (%d)\n", (void *)addr, addr[0], addr[1], ans, ans);
 	return ans;
 }
 
+static void putu16 ( unsigned char *addr, unsigned int val )
+{
+	addr[0] = val & 0xFF;
+	addr[1] = (val >> 8) & 0xFF;
+}
+
+static void putu32 ( unsigned char *addr, unsigned long val )
+{
+	putu16( addr, val & 0xFFFF );
+	putu16( addr+2, (val >> 16) & 0xFFFF );
+}
+
 #define GETU16(x) getu16( (unsigned char *)&(x) )
 #define GETU32(x) getu32( (unsigned char *)&(x) )
+#define PUTU16(x,v) putu16( (unsigned char *)&(x), (v) )
+#define PUTU32(x,v) putu32( (unsigned char *)&(x), (v) )
 
 /**
  * Dump the contents (indicies only) of the busy and free queues.
@@ -480,20 +670,25 @@ static unsigned int getu16 ( unsigned char *addr )
 
 static void dump_queues( int which )
 {
-	if ( (vflag&VERB_QUEUE_LVL) )
+	if ( VERB(VERB_QUEUE_LVL) )
 	{
 		int idx;
 		struct buff_ctl *bptr;
 		if ( (which&1) )
 		{
-			printf( "\tBusy queue (%d): ", busybuffs );
-			idx = busybuffs;
-			while ( idx )
+			unsigned long bn;
+
+			printf( "\tBusy queue (%d from %ld): ", num_busys, busy_lo );
+			for ( bn=busy_lo; busy_ring && bn <= busy_lo + busy_mask; ++bn )
 			{
-				printf( "%d ", idx );
-				bptr = buffers + idx;
-				idx = bptr->next;
+				idx = busy_ring[bn & busy_mask];
+				if ( idx )
+					printf( "%d=%ld ", idx, buffers[idx].blknum );
 			}
+			if ( busy_pend )
+				printf( "pending %d=%ld ", busy_pend, buffers[busy_pend].blknum );
+			if ( busy_tm )
+				printf( "TM" );
 			printf( "\n" );
 		}
 		if ( (which&2) )
@@ -512,80 +707,41 @@ static void dump_queues( int which )
 }
 
 /**
- * Pop top item off busy queue
+ * Pop lowest numbered block off busy queue
  *
  * @return Pointer to item or 0 if nothing available.
+ *
+ * @note
+ * Block numbers missing in front of it are passed over.
  */
 
 static struct buff_ctl *popbusy_buff(void)
 {
 	struct buff_ctl *bptr;
-	if ( !busybuffs )
+	if ( !num_busys )
 	{
-		if ( (vflag&VERB_QUEUE_LVL) )
+		if ( VERB(VERB_QUEUE_LVL) )
 		{
 			printf( "popbusy_buff(): No items on queue.\n" );
 			dump_queues( 3 );
 		}
 		return NULL;
 	}
-	bptr = buffers + busybuffs;
-	busybuffs = bptr->next;
-	bptr->next = 0;
+	while ( !busy_ring[busy_lo & busy_mask] )
+		++busy_lo;			/* missing, the decoder will complain */
+	bptr = buffers + busy_ring[busy_lo & busy_mask];
+	busy_ring[busy_lo & busy_mask] = 0;
+	++busy_lo;
 	--num_busys;
-	if ( (vflag&VERB_QUEUE_LVL) )
+	if ( VERB(VERB_QUEUE_LVL) )
 	{
 		printf( "popbusy_buff(): popped %d off busy queue. num_busys now %d\n",
-				bptr-buffers, num_busys );
+				(int)(bptr-buffers), num_busys );
 		dump_queues( 3 );
 	}
 	return bptr;
 }
 
-/**
- * Add item to busy queue.
- *
- * @param bptr Pointer to item.
- * @param front Flag indicating where to add.
- *	@arg 0 Append to end of list.
- *	@arg 1 Prepend to front of list.
- *
- * @return nothing
- */
-
-static void add_busybuff( struct buff_ctl *bptr, int front ) 
-{
-	int prev, ii;
-
-	++num_busys;
-	if ( (vflag&VERB_QUEUE_LVL) )
-	{
-		printf( "add_busybuff(): Added item %d to %s of busy queue. num_busys now %d\n",
-				bptr - buffers, front ? "head" : "tail", num_busys );
-	}
-	if ( front )
-	{
-		bptr->next = busybuffs;
-		busybuffs = bptr-buffers;
-	}
-	else
-	{
-		prev = 0;
-		ii = busybuffs;
-		bptr->next = 0;		/* make sure this is off */
-		while ( ii )		/* walk the chain */
-		{
-			prev = ii;		/* remember this */
-			ii = buffers[ii].next;	/* advance to next */
-		}
-		if ( prev )			/* if there was a chain */
-			buffers[prev].next = bptr-buffers; /* link it */
-		else
-			busybuffs = bptr-buffers; /* else we are on top */
-	}
-	dump_queues( 3 );
-}
-
 /**
  * Get an item from free queue.
  *
@@ -597,7 +753,7 @@ static struct buff_ctl *getfree_buff(void)
 	struct buff_ctl *bptr;
 	if ( !freebuffs )
 	{
-		if ( (vflag&VERB_QUEUE_LVL) )
+		if ( VERB(VERB_QUEUE_LVL) )
 		{
 			printf( "getfree_buff(): Nothing on free list!!! num_busys now %d\n", num_busys );
 			dump_queues( 3 );
@@ -609,9 +765,10 @@ static struct buff_ctl *getfree_buff(void)
 	bptr->next = 0;
 	bptr->amt = 0;
 	bptr->blknum = 0;
-	if ( (vflag&VERB_QUEUE_LVL) )
+	bptr->crcbad = 0;
+	if ( VERB(VERB_QUEUE_LVL) )
 	{
-		printf( "getfree_buff(): Extracted %d from freelist. num_busys now %d\n", bptr-buffers, num_busys );
+		printf( "getfree_buff(): Extracted %d from freelist. num_busys now %d\n", (int)(bptr-buffers), num_busys );
 		dump_queues( 3 );
 	}
 	return bptr;
@@ -631,172 +788,296 @@ static void free_buff( struct buff_ctl *bptr )
 	{
 		bptr->next = freebuffs;
 		freebuffs = bptr - buffers;
-		if ( (vflag&VERB_QUEUE_LVL) )
+		if ( VERB(VERB_QUEUE_LVL) )
 		{
-			printf( "free_buff(): Put %d on freelist. num_busys now %d\n", bptr - buffers, num_busys );
+			printf( "free_buff(): Put %d on freelist. num_busys now %d\n", (int)(bptr - buffers), num_busys );
 			dump_queues( 3 );
 		}
 	}
 }
 
-/** 
- * Put all buffers back on free queue.
+/**
+ * Add item to busy queue.
  *
- * @return nothing.
+ * @param bptr Pointer to item. Its block number has to be set.
+ *
+ * @return nothing
+ *
+ * @note
+ * If there's already a block with the same number the later one wins,
+ * unless it failed its CRC check and the earlier one didn't (see
+ * ss_keepnew()). A block numbered lower than one already popped is too
+ * late to be of any use and is tossed. One too far ahead of the rest
+ * (see ss_faraway()), or past the end of the ring, is held in busy_pend.
  */
 
-static void freeall( void )
+static void add_busybuff( struct buff_ctl *bptr ) 
 {
-	if ( buffers )
+	int *slot;
+
+	if ( bptr->blknum < busy_lo )
 	{
-		struct buff_ctl *bp;
-		int ii;
-		bp = buffers+1;
-		for ( ii=1; ii < num_buffers-1; ++ii, ++bp )
-			bp->next = ii+1;
-		bp->next = 0;
-		freebuffs = 1;
-		busybuffs = 0;
-		if ( (vflag&VERB_QUEUE_LVL) )
-		{
-			printf( "freeall(): Free'd all buffers.\n" );
-			dump_queues( 3 );
-		}
+		printf( "Snark: Found block numbered %ld after block %ld was used. Discarded it.\n",
+				bptr->blknum, busy_lo-1 );
+		free_buff( bptr );
+		return;
+	}
+	if ( bptr->blknum - busy_lo > busy_mask || ss_faraway( bptr->blknum, read_hi, read_window ) )
+	{
+		if ( busy_sure )
+			buffers[busy_pend].next = bptr - buffers;	/* the one after it */
+		else
+			busy_pend = bptr - buffers;	/* ahead of the window, hold it until it's borne out */
+		if ( VERB(VERB_QUEUE_LVL) )
+			printf( "add_busybuff(): Block %ld is past the window. Holding item %d.\n",
+					bptr->blknum, (int)(bptr - buffers) );
+		return;
+	}
+	if ( bptr->blknum > read_hi )
+		read_hi = bptr->blknum;
+	slot = busy_ring + (bptr->blknum & busy_mask);
+	if ( *slot && !ss_keepnew( buffers[*slot].crcbad, bptr->crcbad ) )
+	{
+		printf( "Snark: Found duplicate block numbered %ld with a bad CRC. Discarded it.\n", bptr->blknum );
+		free_buff( bptr );
+		return;
+	}
+	if ( *slot )
+	{
+		if ( VERB(VERB_FILE_RDLVL) )
+			printf( "Found duplicate block numbered %ld. Discarded original.\n", bptr->blknum );
+		free_buff( buffers + *slot );
+	}
+	else
+		++num_busys;
+	*slot = bptr - buffers;
+	if ( VERB(VERB_QUEUE_LVL) )
+	{
+		printf( "add_busybuff(): Added item %d for block %ld to busy queue. num_busys now %d\n",
+				(int)(bptr - buffers), bptr->blknum, num_busys );
+		dump_queues( 3 );
 	}
 }
 
 /**
- * Remove duplicate blocks from busy list.
+ * Toss the block held past the window.
+ *
+ * @return nothing
+ *
+ * @note
+ * The block read after it wasn't the next one, so it was a bad block
+ * number and not a gap in the tape. Moving the window up to it would
+ * have thrown away every block after it as too late.
+ */
+
+static void drop_pend( void )
+{
+	printf( "Snark: Found block numbered %ld too far past block %ld. Bad block number? Discarded it.\n",
+			buffers[busy_pend].blknum, busy_lo );
+	free_buff( buffers + busy_pend );
+	busy_pend = busy_sure = 0;
+}
+
+/*
+ * XOR is done a vector at a time (SSE2 or NEON with gcc and clang) and
+ * the loads and stores are memcpy()s since a block in a mapped image
+ * can be anywhere.
+ */
+#if defined(__GNUC__)
+typedef unsigned long xor_vec __attribute__ ((vector_size (16)));
+#else
+typedef unsigned long xor_vec;
+#endif
+
+/**
+ * XOR one block's data into another's.
+ *
+ * @param dst Pointer to block to XOR into.
+ * @param src Pointer to block to XOR with it.
  *
  * @return nothing.
+ *
+ * @note
+ * The block headers are left alone.
  */
 
-static void remove_dups( void )
+static void xor_block( unsigned char *dst, const unsigned char *src )
 {
-	int ii, lim, jj;
-	struct buff_ctl *bptr, *la;
-	int buffs[MAX_BUFFCOUNT];		/* place to hold clone of buffer layout */
-
-	if ( num_busys <= 1 )
-		return;				/* nothing to do if there's only one item */
-	memset( buffs, 0, sizeof(buffs) );	/* preclear local array */
-	buffs[0] = busybuffs;
-	bptr = buffers + busybuffs;
-	lim = 1;
-	while ( lim < MAX_BUFFCOUNT && bptr->next )	/* clone the busy list to our local array */
-	{
-		buffs[lim++] = bptr->next;
-		la = buffers + bptr->next;
-		bptr = la;
-	}
-	if ( lim >= MAX_BUFFCOUNT && bptr->next )
-	{
-		printf( "Snark: fatal internal error. Too many items on buffer list.\n" );
-		skipping |= SKIP_TO_SAVESET;	/* toss the remainder of this saveset */
-		return;
-	}
-	if ( lim != num_busys )
-	{
-		printf( "Snark: fatal internal error. busy list count (%d) != num_busys (%d).\n",
-				lim, num_busys );
-		skipping |= SKIP_TO_SAVESET;	/* toss the remainder of this saveset */
-		return;
-	}
-	if ( lim == 2 && !bptr->amt )	/* only two items, but second is a tm */
-		return;				/* so, nothing to do */
-/* First, check each entry for a duplicate entry */
-	if ( (vflag&VERB_QUEUE_LVL) )
+	xor_vec a0, a1, b0, b1;
+	int ii;
+
+	ii = sizeof( struct bbh );
+	for ( ; ii + 2*(int)sizeof(xor_vec) <= blocksize; ii += 2*sizeof(xor_vec) )
 	{
-		printf( "Before checking for duplicates:\n\tBusy queue (?): " );
-		for ( ii=0; ii < lim; ++ii )
-			printf( "%d ", buffs[ii] );
-		printf( "\n\tblknums: " );
-		for ( ii=0; ii < lim; ++ii )
-		{
-			bptr = buffers + buffs[ii];
-			printf( "%7ld ", bptr->blknum );
-		}
-		printf( "\n" );
-		dump_queues( 2 );
+		memcpy( &a0, dst+ii, sizeof(xor_vec) );
+		memcpy( &a1, dst+ii+sizeof(xor_vec), sizeof(xor_vec) );
+		memcpy( &b0, src+ii, sizeof(xor_vec) );
+		memcpy( &b1, src+ii+sizeof(xor_vec), sizeof(xor_vec) );
+		a0 ^= b0;
+		a1 ^= b1;
+		memcpy( dst+ii, &a0, sizeof(xor_vec) );
+		memcpy( dst+ii+sizeof(xor_vec), &a1, sizeof(xor_vec) );
 	}
-/*
- * If there are duplicate blocks, the later one must win.
+	for ( ; ii < blocksize; ++ii )
+		dst[ii] ^= src[ii];
+}
+
+/**
+ * Get the applic field of a block.
+ *
+ * @param blk Pointer to block.
+ *
+ * @return 0 or 1 for a block of data, more for an XOR block.
+ */
+
+static unsigned int blk_applic( unsigned char *blk )
+{
+	return GETU16( ((struct bbh *)blk)->bbh_dol_w_applic );
+}
+
+/**
+ * Rebuild the next block if it's missing.
+ *
+ * @return non-zero if it was and it has been put on the busy queue.
+ *
+ * @note
+ * XOR'ing the XOR block of a group with the other blocks in it gives
+ * back the one that's missing, so long as only one is. The ones already
+ * used are in grp_kept[] and the rest have to be in the window. A
+ * missing XOR block is rebuilt too so nothing complains about it past
+ * the one message. A block that failed its CRC check counts as missing.
  */
-	for ( ii=0; ii < lim-1; ++ii )	 /* for each item in busy list */
+
+static int grp_rebuild( void )
+{
+	struct buff_ctl *bptr, *xptr;
+	struct bbh *hdr;
+	unsigned long bn, xn;
+	int ii, idx, bad;
+
+	bad = busy_ring[busy_lo & busy_mask];
+	if ( bad && !buffers[bad].crcbad )
+		return 0;			/* it's there and it's fine */
+	if ( busy_lo <= quick_thru )
+		return 0;			/* not wanted anyway */
+	if ( !grp_size || grp_size > MAX_GROUP_SIZE || !grp_next || !num_busys
+		 || busy_lo != grp_next + grp_nkept )
+		return 0;			/* something before it went missing too */
+	xptr = NULL;
+	xn = busy_lo;
+	if ( grp_nkept < grp_size )
 	{
-		bptr = buffers + buffs[ii];
-		for ( jj=ii+1; jj < lim; ++jj )	 /* check to see if there's a like numbered one that came later */
+		for ( xn = busy_lo+1; xn <= grp_next + grp_size && xn - busy_lo <= busy_mask; ++xn )
 		{
-			la = buffers + buffs[jj];
-			if ( la->amt && la->blknum == bptr->blknum )
+			idx = busy_ring[xn & busy_mask];
+			if ( !idx || buffers[idx].crcbad )
+				return 0;		/* another one is missing or bad, or it's past the window */
+			if ( blk_applic( buffers[idx].data ) > 1 )
 			{
-				if ( (vflag&VERB_FILE_RDLVL) )
-					printf( "Found duplicate block numbered %ld. Discarded original.\n", bptr->blknum );
-				buffs[ii] = buffs[jj];	/* Just place the duplicate in the original's location */
-				if ( lim-jj > 1 )	/* and shift what's left (if any) up one spot */
-					memmove( buffs+jj, buffs+jj+1, (lim-jj-1) * sizeof(int) );
-				--ii;			/* conteract the outer for loop's ++ */
-				--lim;			/* shrink the total by 1 */
-				--num_busys;		/* reduce busy count too */
-				if ( (vflag&VERB_QUEUE_LVL) )
-				{
-					printf( "Found duplicate block numbered %ld. Discarding buffer %d\n",
-							bptr->blknum, bptr-buffers );
-					busybuffs = buffs[0]; /* fixup the busy que so it'll display correctly */
-					for ( jj=0; jj < lim-1; ++jj )
-					{
-						la = buffers + buffs[jj];
-						la->next = buffs[jj+1];
-					}
-					la = buffers + buffs[jj];
-					la->next = 0;
-				}
-				free_buff( bptr );	/* toss the original buffer */
-				break;			/* look again from the beginning */
+				xptr = buffers + idx;
+				break;
 			}
 		}
+		if ( !xptr )
+			return 0;
 	}
-	if ( (vflag&VERB_QUEUE_LVL) )
+	else if ( !grp_nkept )
+		return 0;
+	bptr = getfree_buff();
+	if ( !bptr )
+		return 0;
+	bptr->data = bptr->buffer;
+	memcpy( bptr->data, xptr ? xptr->data : buffers[grp_kept[0]].data, blocksize );
+	if ( !xptr )
+		memset( bptr->data + sizeof(struct bbh), 0, blocksize - sizeof(struct bbh) );
+	for ( ii=0; ii < grp_nkept; ++ii )
+		xor_block( bptr->data, buffers[grp_kept[ii]].data );
+	for ( bn = busy_lo+1; bn < xn; ++bn )
+		xor_block( bptr->data, buffers[busy_ring[bn & busy_mask]].data );
+	hdr = (struct bbh *)bptr->data;
+	PUTU32( hdr->bbh_dol_l_number, busy_lo );
+	PUTU16( hdr->bbh_dol_w_applic, xptr ? 1 : 2 );
+	PUTU32( hdr->bbh_dol_l_crc, 0 );	/* there's no telling what it was */
+	bptr->blknum = busy_lo;
+	bptr->amt = blocksize;
+	bptr->off = -1;				/* it isn't anywhere in the image */
+	++grp_rebuilt;
+	if ( bad )
 	{
-		printf( "After removing duplicates:\n\tBusy queue (?): " );
-		for ( ii=0; ii < lim; ++ii )
-			printf( "%d ", buffs[ii] );
-		printf( "\n" );
-		dump_queues( 2 );
+		busy_ring[busy_lo & busy_mask] = 0;	/* make way for it */
+		--num_busys;
+		free_buff( buffers + bad );
+		printf( "Snark: block %ld failed its CRC check. Rebuilt it from its redundancy group.\n", busy_lo );
 	}
-/*
- * There may be missing blocks, so we bubble sort what's left
- * in case that happens. The decoder will check for and decide
- * what to do about missing blocks.
+	else if ( xptr )
+		printf( "Snark: block %ld is missing. Rebuilt it from its redundancy group.\n", busy_lo );
+	else
+		printf( "Snark: XOR block %ld is missing. Rebuilt it from its redundancy group.\n", busy_lo );
+	add_busybuff( bptr );
+	return 1;
+}
+
+/**
+ * Done with a block.
+ *
+ * @param bptr Pointer to item.
+ *
+ * @return nothing.
+ *
+ * @note
+ * A block of a redundancy group is kept until its XOR block has been
+ * used, then they all go back on the free queue.
  */
-	for ( ii=0; ii < num_busys-1; ++ii )
+
+static void grp_done( struct buff_ctl *bptr )
+{
+	int xor;
+
+	if ( grp_size && grp_size <= MAX_GROUP_SIZE )
 	{
-		bptr = buffers + buffs[ii];
-		for ( jj=ii+1; jj < num_busys; ++jj )
+		xor = blk_applic( bptr->data ) > 1;
+		if ( !xor && !bptr->crcbad && grp_next && grp_nkept < grp_size && bptr->blknum == grp_next + grp_nkept )
 		{
-			la = buffers + buffs[jj];
-			if ( bptr->amt && bptr->blknum > la->blknum )
-			{
-				int sav = buffs[ii];
-				buffs[ii] = buffs[jj];
-				buffs[jj] = sav;
-				bptr = la;
-			}
+			grp_kept[grp_nkept++] = bptr - buffers;
+			return;
 		}
+		while ( grp_nkept )
+			free_buff( buffers + grp_kept[--grp_nkept] );
+		grp_next = xor ? bptr->blknum+1 : 0;	/* if not, a group starts after the next XOR block */
 	}
-/* Now rebuild the linked busy list */
-	for ( ii=0; ii < num_busys-1; ++ii )
-	{
-		bptr = buffers + buffs[ii];
-		bptr->next = buffs[ii+1];
-	}
-	bptr = buffers + buffs[ii];
-	bptr->next = 0;
-	busybuffs = buffs[0];
-	if ( (vflag&VERB_QUEUE_LVL) )
+	free_buff( bptr );
+}
+
+/** 
+ * Put all buffers back on free queue.
+ *
+ * @return nothing.
+ */
+
+static void freeall( void )
+{
+	if ( buffers )
 	{
-		printf( "After sorting:\n" );
-		dump_queues( 3 );
+		struct buff_ctl *bp;
+		int ii;
+		bp = buffers+1;
+		for ( ii=1; ii < num_buffers-1; ++ii, ++bp )
+			bp->next = ii+1;
+		bp->next = 0;
+		freebuffs = 1;
+		if ( busy_ring )
+			memset( busy_ring, 0, (busy_mask+1)*sizeof(int) );
+		busy_pend = busy_sure = 0;
+		busy_active = busy_tm = 0;
+		num_busys = 0;
+		grp_nkept = 0;
+		grp_next = 1;
+		quick_thru = read_hi = 0;
+		if ( VERB(VERB_QUEUE_LVL) )
+		{
+			printf( "freeall(): Free'd all buffers.\n" );
+			dump_queues( 3 );
+		}
 	}
 }
 
@@ -877,8 +1158,8 @@ static int getRfmRatt(struct file_details *file, char *rcdFormat, int dstLen, ch
  *
  * @note
  * Convert VMS filename, 'fn', to unix filename, 'ufn'.
- * Check filename against the 'don't extract' list.
- * Opens an output file only if in extract mode.
+ * Opens an output file only if in extract mode (the file types not to
+ * extract were left out by process_file()).
  */
 
 static char lastFileName[256];
@@ -887,7 +1168,7 @@ static int lastVersionNumber;
 static FILE *openfile ( struct file_details *file )
 {
 	char ans[80];
-	char *p, *q, s, *ext = NULL; /*, *justFileName; */
+	char *p, *q, s; /*, *justFileName; */
 	int procf;
 	char *ufn = file->ufname;
 	char *fn = file->name;
@@ -947,11 +1228,7 @@ static FILE *openfile ( struct file_details *file )
 	}
 	/* strip off the version number and possibly fix the filename's case */
 	while ( *q && *q != ';' )
-	{
-		if ( *q == '.' )
-			ext = q;
 		q++;
-	}
 	file->do_binary = 0;
 	file->do_rat = 0;
 	if ( !binaryFlag )
@@ -1022,22 +1299,12 @@ static FILE *openfile ( struct file_details *file )
 	{
 		strncat(file->altUPfName, rfm, sizeof(file->altUPfName) - 1);
 	}
-	if ( procf )
+	if ( procf && dirfile )
 	{
-		if ( dirfile )
-		{
-			procf = 0;			/* never explicitly extract directory files */
-			if ( (vflag & VERB_DEBUG_LVL) )
-			{
-				printf( "Skipping explicit extraction of \"%s\" because it's a directory.\n", p );
-			}
-		}
-		else
+		procf = 0;			/* never explicitly extract directory files */
+		if ( VERB(VERB_DEBUG_LVL) )
 		{
-			if ( ext && procf )
-			{
-				procf = typecmp(++ext, eflag);
-			}
+			printf( "Skipping explicit extraction of \"%s\" because it's a directory.\n", p );
 		}
 	}
 	if ( procf && wflag )
@@ -1078,76 +1345,82 @@ static FILE *openfile ( struct file_details *file )
 }
 
 /**
- * Check filetype against list of 'don't extract'.
+ * Compare two file types for qsort() and bsearch().
+ */
+
+static int excl_cmp( const void *a, const void *b )
+{
+	return strcasecmp( *(const char * const *)a, *(const char * const *)b );
+}
+
+/**
+ * Add to the file types not to extract.
  *
- * @param str Pointer to null terminated lowercased filetype.
+ * @param list Pointer to null terminated list of them, separated by
+ * commas ("EXE,.OBJ,lib"). Case doesn't matter.
  *
- * @return 
- *	@arg 0 if file is to be ignored.
- *	@arg 1 if file is not to be ignored.
+ * @return nothing.
  *
  * @note
- * Compares the filename type in pointed to by str
- * with our list of file types to be ignored.
+ * Program will print an error message and exit if malloc fails.
  */
-#ifndef n_elts
-#define n_elts(x) (int)(sizeof(x)/sizeof((x)[0]))
-#endif
 
-int typecmp ( const char *str, int which )
+static void excl_addtypes( const char *list )
 {
-	static const char * const Types0[] = {
-		"exe",			/* executable image */
-		"lib",			/* object library */
-		"obj",			/* object file */
-		NULL
-	};
-	static const char * const Types1[] = {
-		"odl",			/* rsx overlay description file */
-		"olb",			/* rsx object library */
-		"pmd",			/* rsx post mortem dump */
-		"sys",			/* rsx bootable system image */
-		"tlb",			/* ? */
-		"tlo",			/* ? */
-		"tsk",			/* rsx executable image */
-		"upd",			/* ? */
-		NULL			/* null string terminates list */
-	};
-	static const char * const Types2[] = {
-		"dir",			/* directory file */
-		"mai",			/* mail file */
-		NULL
-	};
-	int ii, jj;
-	const char * const *list[4];
-	const char * const *type;
-	
-	list[0] = Types2;
-	if ( !which )
-	{
-		list[1] = Types1;
-		list[2] = Types0;
-		jj = 3;
-	}
-	else if ( which == 1 )
-	{
-		list[1] = Types1;
-		jj = 2;
-	}
-	else 
-	{
-		jj = 1;
-	}
-	list[jj] = NULL;
-	for (jj=0; (type=list[jj]); ++jj)
+	const char *end;
+	size_t len;
+
+	for ( ; *list; list = *end ? end+1 : end )
 	{
-		for (ii=0; *type; ++ii, ++type )
+		if ( *list == '.' )
+			++list;
+		end = strchr( list, ',' );
+		if ( !end )
+			end = list + strlen( list );
+		len = end - list;
+		if ( !len )
+			continue;
+		excl_types = (char **)realloc( excl_types, (excl_ntypes+1)*sizeof(char *) );
+		if ( !excl_types || !(excl_types[excl_ntypes] = (char *)malloc( len+1 )) )
 		{
-			if ( strncasecmp ( str, *type, 3 ) == 0 )
-				return( 0 );   /* found a match, file to be ignored */
+			printf( "Snark: Failed to malloc %lu bytes for file types.\n", (unsigned long)len+1 );
+			exit(1);
 		}
+		memcpy( excl_types[excl_ntypes], list, len );
+		excl_types[excl_ntypes++][len] = 0;
 	}
-	return 1;	   /* no match found keep file */
+}
+
+/**
+ * Check a file's type against those not to extract.
+ *
+ * @param name Pointer to null terminated VMS file name.
+ *
+ * @return non-zero if it's one of them.
+ *
+ * @note
+ * The whole type is compared ("FORTRAN" isn't "FOR").
+ */
+
+static int excl_type( const char *name )
+{
+	char type[40], *key = type;
+	const char *p, *end;
+
+	if ( !excl_ntypes )
+		return 0;
+	if ( (p = strrchr( name, ']' )) )
+		name = p+1;
+	end = strchr( name, ';' );
+	if ( !end )
+		end = name + strlen( name );
+	for ( p = end; p > name && p[-1] != '.'; --p )
+		;
+	if ( p == name || end - p >= (int)sizeof(type) )
+		return 0;			/* no type, or one too long to be in the list */
+	memcpy( type, p, end - p );
+	type[end - p] = 0;
+	return bsearch( &key, excl_types, excl_ntypes, sizeof(char *), excl_cmp ) != NULL;
 }
 
 /**
@@ -1174,7 +1447,7 @@ static void close_file( void )
 					file.name, file.inboundIndex, file.size );
 			++file.file_size_error;
 		}
-		if ( (vflag & VERB_FILE_RDLVL) )
+		if ( VERB(VERB_FILE_RDLVL) )
 		{
 			printf( "File size: %d(0x%X), inboundIndex: %d(0x%X), outbountIndex: %d(0x%X), padding: %d, rec_count: %d\n",
 					 file.size
@@ -1339,20 +1612,87 @@ static const char *vms2unixtime( time_t vtime )
 }
 
 /**
- * Process a file block.
- *
- * @param buffer Pointer to file record.
- * @param rsize Number of bytes in record.
+ * See if a file was asked for.
  *
- * @return nothing.
+ * @param name Pointer to its name.
  *
- * @note
- * File record will be decoded and errors logged as appropriate.
- * If decode or other errors, bits in @e skipping will be set.
- * File will be opened if appropriate.
+ * @return non-zero if it matches one of the patterns (or there aren't any)
+ * and none of the --exclude ones.
  */
 
-void process_file ( unsigned char *buffer, int rsize )
+static int selected( const char *name )
+{
+	return (!patterns || pat_match( patterns, name )) && (!excl_pats || !pat_match( excl_pats, name ));
+}
+
+/**
+ * Show a file in the listing (-t).
+ *
+ * @param fp Pointer to its details.
+ *
+ * @return nothing.
+ */
+
+static void list_file( struct file_details *fp )
+{
+	char rfm[MAX_FORMAT_LEN];
+
+	getRfmRatt(fp,rfm,sizeof(rfm), cDelim);
+	printf ( " %-35s %8d (%s)%s\n", fp->name, fp->size, rfm, fp->size < 0 ? " (IGNORED!!!)" : "" );
+}
+
+/**
+ * Note a file in the catalog (--catalog).
+ *
+ * @param fp Pointer to what process_file() decoded of it.
+ *
+ * @return nothing.
+ */
+
+static void note_file( struct file_details *fp )
+{
+	struct cat_file cf;
+	int clen;
+
+	memset( &cf, 0, sizeof(cf) );
+	clen = strlen( fp->name );
+	if ( clen > CAT_MAXNAME )
+		clen = CAT_MAXNAME;
+	memcpy( cf.name, fp->name, clen );
+	cf.name[ clen ] = 0;
+	cf.size = fp->size;
+	cf.nblk = fp->nblk;
+	cf.lnch = fp->lnch;
+	cf.recfmt = fp->recfmt;
+	cf.recatt = fp->recatt;
+	cf.recsize = fp->recsize;
+	cf.vfcsize = fp->vfcsize;
+	cf.directory = fp->directory;
+	cf.usr = fp->usr;
+	cf.grp = fp->grp;
+	cf.ctime = fp->ctime;
+	cf.mtime = fp->mtime;
+	cf.atime = fp->atime;
+	cf.btime = fp->btime;
+	cf.frec_blk = last_block_number;
+	cat_file( &cf );
+}
+
+/**
+ * Process a file block.
+ *
+ * @param buffer Pointer to file record.
+ * @param rsize Number of bytes in record.
+ *
+ * @return nothing.
+ *
+ * @note
+ * File record will be decoded and errors logged as appropriate.
+ * If decode or other errors, bits in @e skipping will be set.
+ * File will be opened if appropriate.
+ */
+
+void process_file ( unsigned char *buffer, int rsize )
 {
 	unsigned char *data;
 	short dsize, dtype;
@@ -1393,7 +1733,7 @@ void process_file ( unsigned char *buffer, int rsize )
 		case FREC_END:
 #if 0
 			clen = cc+dsize+4;
-			if ( (vflag & VERB_FILE_RDLVL) && clen < rsize-4 )
+			if ( VERB(VERB_FILE_RDLVL) && clen < rsize-4 )
 				printf( "Snark: process_file(): subfield %d, size %d, end of file list with %d bytes remaining. rsize=%d, cc=%d\n",
 						subf, dsize, rsize - clen, rsize, cc );
 			rsize = clen;
@@ -1407,7 +1747,7 @@ void process_file ( unsigned char *buffer, int rsize )
 				clen = sizeof(file.name)-1;
 			memcpy( file.name, data, clen );
 			file.name[ clen ] = 0;
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type FNAME, size %d. \"%s\"\n",
 						subf, dsize, file.name );
 			break;
@@ -1417,7 +1757,7 @@ void process_file ( unsigned char *buffer, int rsize )
 				file.usr = getu16(data);
 				file.grp = getu16(data + 2);
 			}
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type UID, size %d. usr %06o, grp %06o\n",
 						subf, dsize, file.usr, file.grp );
 			break;
@@ -1445,7 +1785,7 @@ void process_file ( unsigned char *buffer, int rsize )
 			if ( file.vfcsize == 0 )
 				file.vfcsize = 2;
 			/* bytes 16-31 unaccounted for */
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 			{
 				printf( "File record field %2d, type FORMAT, size %d. fmt %d, att %d, rsiz %d\n",
 						subf, dsize, file.recfmt, file.recatt, file.recsize );
@@ -1456,34 +1796,34 @@ void process_file ( unsigned char *buffer, int rsize )
 		case FREC_CTIME:
 			if ( dsize >= 8 )
 				file.ctime = vms2unixsecs( data );
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type CTIME, size %d. \"%s\"\n",
 						subf, dsize, vms2unixtime( file.ctime ) );
 			break;
 		case FREC_MTIME:
 			if ( dsize >= 8 )
 				file.mtime = vms2unixsecs( data );
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type MTIME, size %d. \"%s\"\n",
 						subf, dsize, vms2unixtime( file.mtime ) );
 			break;
 		case FREC_ATIME:
 			if ( dsize >= 8 )
 				file.atime = vms2unixsecs( data );
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type ATIME, size %d. \"%s\"\n",
 						subf, dsize, vms2unixtime( file.atime ) );
 			break;
 		case FREC_BTIME:
 			if ( dsize >= 8 )
 				file.btime = vms2unixsecs( data );
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type BTIME, size %d. \"%s\"\n",
 						subf, dsize, vms2unixtime( file.btime ) );
 			break;
 		case FREC_DIRECTORY:
 			file.directory = data[0];
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 				printf( "File record field %2d, type DIRECTORY, size %d. 0x%02X\n",
 						subf, dsize, data[0] );
 			break;
@@ -1524,7 +1864,7 @@ void process_file ( unsigned char *buffer, int rsize )
 			/* In my example, 1 byte.  hex 00.  */
 		case FREC_UNK57:
 			/* In my example, 1 byte.  hex 00.  */
-			if ( (vflag & VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 			{
 				int jj;
 				printf( "File record field %2d (UNK) type 0x%02X, size %d: ",
@@ -1558,24 +1898,19 @@ void process_file ( unsigned char *buffer, int rsize )
 		file.recfmt |= FAB_dol_M_MAIL;
 		file.savRecFmt = file.recfmt;
 	}
-	procf = 0;
-	if ( goptind < gargc )
+	if ( catname )
+		note_file( &file );
+	if ( cat_only && strncmp( file.name, cat_only, CAT_MAXNAME ) )
 	{
-		for ( ii = goptind; ii < gargc; ii++ )
-		{
-			procf |= match ( file.name, gargv[ii] );
-		}
+		memset( &file, 0, sizeof( file ) );	/* not the one being extracted, only some of it is read */
+		skipping |= SKIP_TO_FILE;
+		return;
 	}
-	else
-		procf = 1;
+	procf = selected( file.name );
 	if ( procf )
 	{
 		if ( tflag )
-		{
-			char rfm[MAX_FORMAT_LEN];
-			getRfmRatt(&file,rfm,sizeof(rfm), cDelim);
-			printf ( " %-35s %8d (%s)%s\n", file.name, file.size, rfm, file.size < 0 ? " (IGNORED!!!)" : "" );
-		}
+			list_file( &file );
 		if ( file.size < 0 )
 		{
 			if ( !tflag && xflag )
@@ -1591,7 +1926,7 @@ void process_file ( unsigned char *buffer, int rsize )
 		   )
 		{
 			skipping |= SKIP_TO_FILE;	/* ignore this file since the types are bogus */
-			if ( (vflag&VERB_FILE_RDLVL) )
+			if ( VERB(VERB_FILE_RDLVL) )
 			{
 				printf( "Skipping file due to it being a dir or mail file or recsize is 0.\n" );
 			}
@@ -1600,6 +1935,14 @@ void process_file ( unsigned char *buffer, int rsize )
 
 		if ( xflag )
 		{
+			if ( excl_type( file.name ) )
+			{
+				if ( VERB(VERB_DEBUG_LVL) )
+					printf( "Skipping extraction of \"%s\" because of its file type.\n", file.name );
+				memset( &file, 0, sizeof( file ) );	/* before openfile() makes directories for it */
+				skipping |= SKIP_TO_FILE;
+				return;
+			}
 			/* open file */
 			file.extf = openfile ( &file );
 			if ( file.extf != NULL && vflag )
@@ -1608,6 +1951,50 @@ void process_file ( unsigned char *buffer, int rsize )
 	}
 }
 
+/**
+ * Size the read-ahead window from a summary block record.
+ *
+ * @param buffer Pointer to record.
+ * @param rsize number of bytes in record.
+ *
+ * @return nothing.
+ *
+ * @note
+ * The window grows the next time read_next_block() is called. If it was
+ * fixed with --window and that looks too small a warning is shown.
+ */
+
+static void set_window( unsigned char *buffer, unsigned short rsize )
+{
+	int cc, dsize, dtype, need;
+	struct bsa *bsa;
+
+	buff_cnt = grp_size = 0;
+	for ( cc = 2; cc <= (int)rsize-4; cc += dsize+4 )
+	{
+		bsa = ( struct bsa *)(buffer+cc);
+		dsize = GETU16( bsa->bsa_dol_w_size );
+		dtype = GETU16( bsa->bsa_dol_w_type );
+		if ( dtype == SUMM_END )
+			break;
+		if ( dtype == SUMM_BUFFCOUNT && dsize == 2 )
+			buff_cnt = getu16( (unsigned char *)bsa->bsa_dol_t_text );
+		else if ( dtype == SUMM_GROUPSIZE && dsize == 2 )
+			grp_size = getu16( (unsigned char *)bsa->bsa_dol_t_text );
+	}
+	need = buff_cnt + (grp_size ? grp_size+1 : 0);
+	if ( window_opt )
+	{
+		if ( need > window_opt )
+			printf( "Snark: Warning: /BUFFER_COUNT=%d and /GROUP_SIZE=%d want a window of %d blocks. --window=%d may be too small.\n",
+					buff_cnt, grp_size, need, window_opt );
+		return;
+	}
+	read_window = ss_window( buff_cnt, grp_size );
+	if ( VERB(VERB_LVL|VERB_QUEUE_LVL) )
+		printf( "Reading %d blocks ahead (/BUFFER_COUNT=%d /GROUP_SIZE=%d).\n", read_window, buff_cnt, grp_size );
+}
+
 /**
  *  Process a summary block record.
  *
@@ -1632,14 +2019,16 @@ void process_summary ( unsigned char *buffer, unsigned short rsize )
 		skipping |= SKIP_TO_BLOCK;	/* Skip to next block */
 		return;
 	}
+	if ( catname )
+		cat_summary( buffer, rsize );
+	set_window( buffer, rsize );
 
-	if ( tflag || (vflag & VERB_LVL) )
+	if ( tflag || VERB(VERB_LVL) )
 	{
 		int clen, cc, subf=0;
 
 		printf( "\nHeader processing. rsize=%d\n", rsize );
 		cc = 2;
-		buff_cnt = 0;
 		while ( cc <= (int)rsize-4 )
 		{
 			struct bsa *bsa;
@@ -1777,8 +2166,9 @@ void process_summary ( unsigned char *buffer, unsigned short rsize )
 			case SUMM_BUFFCOUNT:
 				if ( dsize == 2 )
 				{
-					buff_cnt = getu16( text );
-					printf( "%02d: Buffcnt:      %d\n", subf, buff_cnt );
+					int cnt;
+					cnt = getu16( text );
+					printf( "%02d: Buffcnt:      %d\n", subf, cnt );
 				}
 				continue;
 			default:
@@ -1787,10 +2177,6 @@ void process_summary ( unsigned char *buffer, unsigned short rsize )
 			}
 			break;
 		}       
-#if 0
-		if ( buff_cnt > MAX_BUFFCOUNT )
-			printf( "Snark: Warning: /BUFFCOUNT=%d. MAX_BUFFCOUNT=%d.\n", buff_cnt, MAX_BUFFCOUNT );
-#endif
 		printf( "\n" );
 	}
 	return;
@@ -1816,7 +2202,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 	int buffIndex, tlen;
 	
 	buffIndex = 0;
-	if ( (vflag & (VERB_LVL|VERB_FILE_RDLVL|VERB_FILE_WRLVL)) )
+	if ( VERB(VERB_LVL|VERB_FILE_RDLVL|VERB_FILE_WRLVL) )
 	{
 		printf("process_vbn(): Entry rsize=%d(0x%0X). recfmt=%d, recatt=0x%02X, rec_count=%d, do_binary=%d, do_rat=%d, file_state=%d\n",
 			    rsize
@@ -1863,7 +2249,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 				file.reclen = file.size - file.inboundIndex;
 			if ( file.extf )
 			{
-				if ( (vflag & VERB_FILE_WRLVL) )
+				if ( VERB(VERB_FILE_WRLVL) )
 				{
 					printf( "Writing %4d(0x%X) bytes. buffIndex=%d(0x%X), inboundIndex=%d(0x%X), outboundIndex=%d(0x%X), recfmt=%d, recatt=0x%02X\n",
 							 file.reclen
@@ -1966,7 +2352,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 				buffIndex += 2;
 				file.inboundIndex += 2;		/* This has to match all bytes found in file */
 				file.file_state = ((file.recfmt&0x1F) == FAB_dol_C_VFC && file.vfcsize == 2) ? GET_VFC:GET_DATA;
-				if ( (vflag & VERB_FILE_RDLVL) )
+				if ( VERB(VERB_FILE_RDLVL) )
 				{
 					printf ( "New record mark: GET_RCD_COUNT: reclen = %5d(0x%04X), buffIndex = %5d(0x%04X), rsize = %5d(0x%04X), rec_count=%d, nextState=%d\n",
 							  file.reclen
@@ -1984,7 +2370,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 				file.do_vfc = 0;
 				if ( file.reclen == 0xFFFF )
 				{
-					if ( (vflag & VERB_FILE_RDLVL) )
+					if ( VERB(VERB_FILE_RDLVL) )
 					{
 						printf("Reached EOF. inboundIndex=%d(0x%X), file.size=%d(0x%X), buffIndex=%d(0x%X), rsize=%d(0x%X), inboundIndex+(rsize-buffIndex)=%d(0x%X)",
 							    file.inboundIndex
@@ -2070,7 +2456,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 					file.reclen -= 2;
 				}
 				file.inboundIndex += 2;		/* VFC bytes get counted in the running index */
-				if ( (vflag & VERB_FILE_RDLVL) )
+				if ( VERB(VERB_FILE_RDLVL) )
 					printf ( "New record mark: GET_VFC: reclen = %5d, buffIndex = %5d(0x%04X), rsize = %5d(0x%04X), vfc0=0x%02X, vfc1=0x%02X\n",
 							 file.reclen, buffIndex-2, buffIndex-2, rsize, rsize, file.vfc0, file.vfc1 );
 				if ( file.do_vfc )
@@ -2119,7 +2505,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 					}
 					if ( file.extf && preNum && preCode )
 					{
-						if ( (vflag & VERB_FILE_WRLVL)  )
+						if ( VERB(VERB_FILE_WRLVL)  )
 						{
 							printf("Writing %d byte%s of leading VFC. vfc0=0x%02X, vfc1=0x%02X, preCode[0]=0x%02X\n",
 									preNum,
@@ -2166,7 +2552,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 				}
 				if ( file.extf )
 				{
-					if ( (vflag & VERB_FILE_WRLVL) )
+					if ( VERB(VERB_FILE_WRLVL) )
 					{
 						printf( "Writing %4d byte%s. recfmt=%d, recatt=0x%02X, reclen=%d(0x%X)\n",
 								tlen, tlen == 1 ? "":"s", file.recfmt, file.recatt, file.reclen, file.reclen );
@@ -2257,7 +2643,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 							}
 							if ( postNum && postCode )
 							{
-								if ( (vflag & VERB_FILE_WRLVL) )
+								if ( VERB(VERB_FILE_WRLVL) )
 									printf( "Writing %d byte%s of VFC tail. vfc1=0x%02X, postCode[0]=0x%02X\n",
 											postNum, postNum == 1 ? "":"s", file.vfc1, postCode[0] );
 								if ( (int)fwrite(postCode, 1, postNum, file.extf) != postNum ) /* write trailing character(s) */
@@ -2278,7 +2664,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 					}
 					else if ( file.do_rat )
 					{
-						if ( (vflag & VERB_FILE_WRLVL) )
+						if ( VERB(VERB_FILE_WRLVL) )
 							printf( "    Writing 1 byte 0x0A due to rat=0x%02X\n", file.do_rat );
 						fputc( '\n', file.extf );	/* follow with newline if appropriate */
 					}
@@ -2328,7 +2714,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 		printf("Snark: '%s' process_vbn(): Hey, we've got a problem: record format=%d, buffIndex=%d, file.inboundIndex=%d(0x%X), file.size=%d(0x%X)\n",
 			   file.name, file.recfmt, buffIndex, file.inboundIndex, file.inboundIndex, file.size, file.size );
 	}
-	if ( (vflag & VERB_FILE_RDLVL) )
+	if ( VERB(VERB_FILE_RDLVL) )
 	{
 		if ( file.reclen )
 			printf( "process_vbn(): '%s' Record straddled block. reclen=%d, recsize=%d, file_state=%d\n",
@@ -2338,7 +2724,7 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 	}
 	if ( file.inboundIndex >= file.size )
 	{
-		if ( (vflag & VERB_FILE_RDLVL) )
+		if ( VERB(VERB_FILE_RDLVL) )
 		{
 			printf( "process_vbn(): '%s' Reached end of file. file.inboundIndex=%d(0x%X), file.size=%d(0x%X), file_state=%d. Skipping to next file.\n",
 					file.name, file.inboundIndex, file.inboundIndex, file.size, file.size, file.file_state );
@@ -2362,30 +2748,87 @@ void process_vbn ( unsigned char *buffer, unsigned short rsize )
 
 static unsigned long get_block_number( unsigned char *bptr )
 {
-	unsigned long ans = 0, bsize;
+	unsigned long ans;
 	struct bbh *block_header;
-	unsigned short bhsize;
 
 	block_header = ( struct bbh * )bptr;
 
-	bhsize = GETU16( block_header->bbh_dol_w_size );
-	bsize = GETU32( block_header->bbh_dol_l_blocksize );
+	/* check the validity of the header block (the reader thread and --check do the same) */
+	switch ( ss_blkcheck( bptr, blocksize, &ans ) )
+	{
+	case SS_BLK_HDRSIZE:
+		printf ( "Snark: Invalid header block size. Expected %d, found %d\n",
+				 INT_SIZEOF( struct bbh ), GETU16( block_header->bbh_dol_w_size ) );
+		break;
+	case SS_BLK_BLKSIZE:
+		printf ( "Snark: Invalid block size. Expected %d, found %ld\n",
+				 blocksize, GETU32( block_header->bbh_dol_l_blocksize ) );
+		break;
+	}
+	return ans;
+}
 
-	/* check the validity of the header block */
-	if ( bhsize != sizeof ( struct bbh ) )
+/**
+ * Skip the blocks that can only be file data (--quick).
+ *
+ * @param numb Number of block just processed.
+ * @param left Bytes of the current file's data not seen yet.
+ *
+ * @return nothing.
+ *
+ * @note
+ * A block holds at most a block's worth less the block and a record
+ * header of data, so the blocks that follow are all data for as long
+ * as that much keeps adding up to less than @e left. Each one skipped
+ * is taken to have held that much so @e left stays a lower bound.
+ */
+
+static void quick_skip( unsigned long numb, unsigned long left )
+{
+	unsigned long most, thru;
+
+	most = blocksize - sizeof(struct bbh) - sizeof(struct brh);
+	thru = numb + (left - 1)/most;
+	if ( thru <= quick_thru || thru <= numb )
+		return;
+	quick_vbn += (thru - (quick_thru > numb ? quick_thru : numb))*most;
+	quick_thru = thru;
+	if ( catname )
+		cat_data( thru, -1 );	/* the file's data goes at least this far */
+	if ( grp_size && grp_size <= MAX_GROUP_SIZE )
+		thru -= thru % (grp_size+1);	/* read the group the next block is in, it may have to be rebuilt */
+	if ( thru > read_hi )
 	{
-		printf ( "Snark: Invalid header block size. Expected %d, found %d\n", sizeof( struct bbh ), bhsize );
-		return ans;
+		tio_skipn( thru - read_hi );	/* not read yet, don't */
+		read_hi = thru;
 	}
-	if ( bsize != 0 && bsize != (unsigned long)blocksize )
+}
+
+/**
+ * Note blocks tapeio skipped (--quick).
+ *
+ * @param numb Number of first block after them.
+ *
+ * @return nothing.
+ *
+ * @note
+ * quick_skip() only has whole redundancy groups skipped so if @e numb
+ * starts one it can still be used to rebuild a block.
+ */
+
+static void quick_gap( unsigned long numb )
+{
+	unsigned long last;
+
+	last = numb-1 < quick_thru ? numb-1 : quick_thru;
+	quick_skipped += last - last_block_number;
+	last_block_number = last;
+	if ( grp_size && grp_size <= MAX_GROUP_SIZE )
 	{
-		printf ( "Snark: Invalid block size. Expected %d, found %ld\n", blocksize, bsize );
-		return ans;
+		while ( grp_nkept )
+			free_buff( buffers + grp_kept[--grp_nkept] );
+		grp_next = (numb-1) % (grp_size+1) ? 0 : numb;
 	}
-#if 0
-/* TODO: Figure out how to compute the block checksum/crc and validate it here. */
-#endif
-	return GETU32( block_header->bbh_dol_l_number );
 }
 
 /**
@@ -2435,7 +2878,7 @@ void process_block ( unsigned char *blkptr )
 	}
 	last_block_number = numb;
 	applic = GETU16( block_header->bbh_dol_w_applic );
-	if ( (vflag & VERB_DEBUG_LVL) )
+	if ( VERB(VERB_DEBUG_LVL) )
 	{
 		printf ( "new block: ii = %ld, bsize = %ld, opsys=%d, subsys=%d, applic=%d, number=%ld\n",
 				 ii, bsize,
@@ -2446,7 +2889,7 @@ void process_block ( unsigned char *blkptr )
 	}
 	if ( !bsize || applic > 1 )
 	{
-		if ( (vflag & VERB_DEBUG_LVL) )
+		if ( VERB(VERB_DEBUG_LVL) )
 		{
 			if ( !bsize )
 				printf( "Process_block(): Skipped block because bsize == 0\n" );
@@ -2467,7 +2910,7 @@ void process_block ( unsigned char *blkptr )
 
 		rtype = GETU16( record_header->brh_dol_w_rtype );
 		rsize = GETU16( record_header->brh_dol_w_rsize );
-		if ( (vflag & VERB_DEBUG_LVL) )
+		if ( VERB(VERB_DEBUG_LVL) )
 		{
 			printf ( "ii=%ld, rtype=%d, rsize=%d, flags=0x%lX, addr=0x%lX\n",
 					 ii, rtype, rsize,
@@ -2487,41 +2930,46 @@ void process_block ( unsigned char *blkptr )
 		{
 		
 		case brh_dol_k_null:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = null\n" );
 			break;
 
 		case brh_dol_k_summary:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = summary\n" );
 			process_summary( blkptr+ii, rsize );
 			break;
 
 		case brh_dol_k_file:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = file\n" );
+			quick_vbn = 0;
 			process_file ( blkptr+ii, rsize );
 			break;
 
 		case brh_dol_k_vbn:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = vbn\n" );
-			if ( !(skipping&SKIP_TO_FILE) )
+			if ( catname )
+				cat_data( numb, blk_off < 0 ? blk_off : blk_off + (off_t)(ii - sizeof(struct brh)) );
+			if ( quickflag )
+				quick_vbn += rsize;	/* just count it */
+			else if ( !(skipping&SKIP_TO_FILE) )
 				process_vbn ( blkptr+ii, rsize );
 			break;
 
 		case brh_dol_k_physvol:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = physvol\n" );
 			break;
 
 		case brh_dol_k_lbn:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = lbn\n" );
 			break;
 
 		case brh_dol_k_fid:
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "rtype = fid\n" );
 			break;
 
@@ -2539,137 +2987,149 @@ void process_block ( unsigned char *blkptr )
 		}
 		ii += rsize;
 	}
+	if ( quickflag && file.size > 0 && (unsigned long)file.size > quick_vbn )
+		quick_skip( numb, file.size - quick_vbn );
 }
 
 static int tape_marks;		/*!< running bit mask of tape marks read */
+static int tape_format;		/*!< how the input is framed (one of TIO_FMT_xxx) */
 
 /**
- * Get a record from tape or disk.
+ * Get the next record from tape or disk without copying it.
  *
- * @param buff Pointer to buffer into which to read record.
- * @param len Size of buffer.
+ * @param rcd Pointer to place to deposit pointer to record's data.
  *
  * @return
  *	@arg 0 Indicates an TM read.
- *	@arg non-zero-positive Number of bytes read into @e buff.
+ *	@arg non-zero-positive Number of bytes in record.
  *	@arg negative Error code from OS.
  *
  * @note
- * Will not advance beyond two consequitive tape marks.
+ * Will not advance beyond two consequitive tape marks. The data is only
+ * good until the next call unless tio_pinned() says otherwise.
  */
 
-static int read_record( unsigned char *buff, int len )
+static int next_record( unsigned char **rcd )
 {
-	unsigned char freclen[4], iFreclen[4];
-	int sts, tmpLen, reclen, Ireclen;
-#if  1 || WIN32
-	int tmpRecCnt;
-#endif
+	int reclen;
+
+	*rcd = NULL;
 	if ( (tape_marks&3) == 3 )
 	{
-		if ( (vflag & VERB_DEBUG_LVL) )
+		if ( VERB(VERB_DEBUG_LVL) )
 			printf( "read_record: returns 0 cuz read 2 TMs in a row.\n" );
 		return 0;				/* reached EOT, can't advance */
 	}
 	tape_marks <<= 1;
-	if ( !iflag && !Iflag )
-	{
-		sts = read( fd, buff, len );		/* Read from the tape */
-		if ( sts <= 0 )				/* A 0 is a tape mark, a -x is an error */
-		{
-			tape_marks |= 1;
-		}
-		if ( (vflag & VERB_DEBUG_LVL) )
-			printf( "read_record: returns %d.\n", sts );
-		return sts;
-	}
 /*
  * Format of our 'i' disk image of a tape is:
  *     4 byte record length in bytes, little endian, followed by 'n' bytes of data.
  * Format of simh 'I' disk image of a tape is the same except it also has the 4 byte count following the 'n' bytes of data. TM's excluded.
+ * The framing is parsed by tio_record() out of a mapping of, or a large buffer holding, the image.
+ * A tape is just read() a record at a time. Either way it may be done ahead of time by a reader thread.
  */
-	sts = read( fd, freclen, 4 );		/* Read the record length from disk */
-	if ( sts <= 0 )				/* A 0 is EOF. a -x is an error */
-	{
-		tape_marks |= 1;			/* pretend we got a tape mark */
-		if ( (vflag & VERB_DEBUG_LVL) )
-			printf( "read_record: returns %d due to error or EOF.\n", sts );
-		return sts;
-	}
-	reclen = getu32( freclen );			/* convert endianess as appropriate */
-	if ( !reclen )				/* A 0 length record is a fake tape mark */
+	reclen = tio_record( rcd );
+	if ( reclen <= 0 )
 	{
-		tape_marks |= 1;			/* Reached a fake tape mark */
-		if ( (vflag & VERB_DEBUG_LVL) )
-			printf( "read_record: returns 0 cuz found fake TM.\n" );
-		return 0;
+		if ( !reclen || tape_format == TIO_FMT_RAW )
+			tape_marks |= 1;			/* A 0 length record, EOF or error reading tape is a tape mark */
+		if ( VERB(VERB_DEBUG_LVL) )
+			printf( "read_record: returns %d due to TM, error or EOF.\n", reclen );
 	}
+	return reclen;
+}
+
+/**
+ * Copy a record into a buffer.
+ *
+ * @param buff Pointer to buffer (NULL to not bother).
+ * @param len Size of buffer.
+ * @param rcd Pointer to record's data.
+ * @param reclen What next_record() returned for it.
+ *
+ * @return Same as read_record().
+ */
+
+static int copy_record( unsigned char *buff, int len, unsigned char *rcd, int reclen )
+{
+	if ( reclen <= 0 || !buff )
+		return reclen;				/* caller just wants to skip it */
 	if ( reclen > len )
 	{
 		printf( "Snark: WARNING: Record of %d bytes too long for user %d buffer.\n", reclen, len );
-		sts = read( fd, buff, len );		/* give 'em what he wants */
-		lseek( fd, reclen-len, SEEK_CUR );	/* Skip remainder of record */
-		if ( (vflag & VERB_DEBUG_LVL) )
-			printf( "read_record: returns %d.\n", sts );
-		return sts;
-	}
-	if ( reclen < len )
-		len = reclen;				/* trim byte count to actual record length */
-#if 1 || WIN32
-	tmpRecCnt = 0;
-	tmpLen = 0;
-	while ( tmpLen < len )
-	{
-		sts = read(fd, buff+tmpLen, len-tmpLen);
-		if ( sts <= 0 )
-		{
-			tape_marks |= 1;			/* pretend we got a tape mark */
-			if ( (vflag & VERB_DEBUG_LVL) )
-				printf( "read_record: read(%d) returns %d due to error or EOF on attempt %d. tmpLen=%d\n", len-tmpLen, sts, tmpRecCnt, tmpLen );
-			return sts;
-		}
-		if ( (vflag & VERB_DEBUG_LVL) )
-			printf( "read_record: attempt %d, read(%d) returns %d.\n", tmpRecCnt, len-tmpLen, sts );
-		tmpLen += sts;
-		++tmpRecCnt;
+		reclen = len;				/* give 'em what he wants */
 	}
-#else
-	tmpLen = read(fd, buff, len);
-	if ( tmpLen <= 0 )
-	{
-		tape_marks |= 1;			/* pretend we got a tape mark */
-		if ( (vflag & VERB_DEBUG_LVL) )
-			printf( "read_record: read() returns %d due to error or EOF.\n", sts );
-		return tmpLen;
-	}
-	if ( (vflag & VERB_DEBUG_LVL) )
-		printf( "read_record: read() returns %d.\n", tmpLen );
+	memcpy( buff, rcd, reclen );
+	if ( VERB(VERB_DEBUG_U32) || (VERB(VERB_BLOCK_LVL) && !VERB(VERB_DEBUG_LVL)) )
+		printf("read_record: block returned %d(0x%X)\n", reclen, reclen );
+	return reclen;
+}
+
+/**
+ * Get a record from tape or disk.
+ *
+ * @param buff Pointer to buffer into which to read record (NULL to just skip it).
+ * @param len Size of buffer.
+ *
+ * @return
+ *	@arg 0 Indicates an TM read.
+ *	@arg non-zero-positive Number of bytes read into @e buff.
+ *	@arg negative Error code from OS.
+ *
+ * @note
+ * Will not advance beyond two consequitive tape marks.
+ */
+
+static int read_record( unsigned char *buff, int len )
+{
+	unsigned char *rcd;
+	int reclen;
+
+	reclen = next_record( &rcd );
+	return copy_record( buff, len, rcd, reclen );
+}
+
+/**
+ * Get a block from tape or disk.
+ *
+ * @param bptr Pointer to buffer to hold it.
+ *
+ * @return Same as read_record().
+ *
+ * @note
+ * A block in a mapped image is left where it is with @e bptr->data
+ * pointing at it. Anything else is copied into @e bptr->buffer.
+ * A copy is streamed into the cache by the memcpy(), but process_block()
+ * only touches a block in place where the record lengths lead it, each
+ * load waiting on the one before. So it's asked for now, while the
+ * blocks in front of it are being decoded.
+ */
+
+static int read_block( struct buff_ctl *bptr )
+{
+	unsigned char *rcd;
+	int reclen, ii;
+
+	bptr->data = bptr->buffer;
+	reclen = next_record( &rcd );
+	bptr->off = tio_offset();
+	if ( reclen <= 0 || reclen > buffalloc || !tio_pinned() )
+		return copy_record( bptr->buffer, buffalloc, rcd, reclen );
+	bptr->data = rcd;			/* it stays put, no need to copy it */
+#if defined(__GNUC__)
+	for ( ii=0; ii < reclen; ii += 64 )
+		__builtin_prefetch( rcd + ii );
 #endif
-	if ( Iflag )
-	{
-		sts = read( fd, iFreclen, 4 );		/* Read the end of block record length from disk */
-		if ( sts <= 0 )				/* A 0 is EOF. a -x is an error */
-		{
-			if ( (vflag & VERB_DEBUG_LVL) )
-				printf( "read_record: returns %d due to error reading SIMH record length.\n", sts );
-			return sts;
-		}
-		Ireclen = getu32( iFreclen );			/* convert endianess as appropriate */
-		if ( Ireclen != reclen )				/* it better match the starting one */
-		{
-			printf( "Snark: read_record: SIMH format record count mismatch. Expected %d read %d\n",  reclen, Ireclen);
-			return -1;
-		}
-	}
-	sts = reclen;
-	if ( (vflag&VERB_DEBUG_U32) || ((vflag&VERB_BLOCK_LVL ) && !(vflag&VERB_DEBUG_LVL)) )
-		printf("read_record: block returned %d(0x%X)\n", sts, sts );
-	return sts;
+	if ( VERB(VERB_DEBUG_U32) || (VERB(VERB_BLOCK_LVL) && !VERB(VERB_DEBUG_LVL)) )
+		printf("read_record: block returned %d(0x%X) in place\n", reclen, reclen );
+	return reclen;
 }
 
 /**
  * Skip to next tape mark.
  * Continues to call read_record until the next tape mark is reached.
+ * The records are not copied anywhere and as few as possible are
+ * actually read (see tio_skip()).
  *
  * @return nothing.
  *
@@ -2679,7 +3139,8 @@ static void skip_to_tm( void )
 {
 	while ( 1 )
 	{
-		if ( !read_record( (unsigned char *)label, sizeof( label ) ) )
+		tio_skip();
+		if ( !read_record( NULL, 0 ) )
 			break;
 	}
 }
@@ -2694,19 +3155,18 @@ static void skip_to_tm( void )
  *
  * @note
  * Program will print an error message and exit if malloc fails.
+ * The buffers are slots in one slab (see tio_slab()). More buffers of
+ * the same size keep what's in the ones already read. Bigger buffers
+ * move them about, so that's only to be done when they're all free.
  */
 
 static void alloc_buffers( int nbuffs, int buffsize )
 {
 	int ii;
 	struct buff_ctl *bp;
+	unsigned char *slab;
 
 	buffsize += 16;				/* make this a little bigger than he asked for */
-/*
- * TODO: Allow this to be dynamic.
- * For now, we just ignore what he wants and always allocate a fixed number.
- */
-	nbuffs = MAX_BUFFCOUNT;			/* always use a fixed number of buffers */
 	if ( nbuffs+1 > num_buffers )		/* need to malloc (more) buffers */
 	{
 		int jj, newsz;
@@ -2724,30 +3184,52 @@ static void alloc_buffers( int nbuffs, int buffsize )
 		for ( ; ii < num_buffers-1; ++ii , ++bp )
 		{
 			bp->buffer = NULL;			/* start with this empty */
+			bp->data = NULL;
 			bp->next = ii+1;
 			bp->amt = 0;
 		}
 		bp->buffer = NULL;
+		bp->data = NULL;
 		bp->next = freebuffs;
 		bp->amt = 0;
 		freebuffs = jj;
 	}
-	bp = buffers+1;				/* now go through and make sure everybody has a buffptr */
+	buffsize = (buffsize + BUFF_SLOT_ALIGN-1) & ~(BUFF_SLOT_ALIGN-1);
+	if ( buffalloc < buffsize )
+		buffalloc = buffsize;			/* bump this up if appropriate */
+	slab = tio_slab( (size_t)(num_buffers-1)*buffalloc );
+	if ( !slab )
+	{
+		printf( "Snark: Failed to malloc %lu bytes for block buffers.\n",
+				(unsigned long)(num_buffers-1)*buffalloc );
+		exit(1);
+	}
+	bp = buffers+1;				/* now go through and give everybody their slot */
 	for ( ii=1; ii < num_buffers; ++ii, ++bp )
 	{
-		if ( buffalloc < buffsize || !bp->buffer )
+		if ( bp->data == bp->buffer )
+			bp->data = slab + (size_t)(ii-1)*buffalloc;	/* a copy moves with its buffer */
+		bp->buffer = slab + (size_t)(ii-1)*buffalloc;
+	}
+	if ( busy_mask+1 < 2*(unsigned long)num_buffers )	/* room for gaps in the block numbers too */
+	{
+		unsigned long slots, bn;
+		int *ring;
+
+		for ( slots = 2; slots < 2*(unsigned long)num_buffers; slots <<= 1 )
+			;
+		ring = (int *)calloc( slots, sizeof(int) );
+		if ( !ring )
 		{
-			bp->buffer = (unsigned char *)realloc( bp->buffer, buffsize );
-			if ( !bp->buffer )
-			{
-				printf( "Snark: Failed to malloc %d bytes for block buffer # %d\n", 
-						buffsize, ii );
-				exit(1);
-			}
+			printf( "Snark: Failed to malloc %lu bytes for busy queue.\n", slots*sizeof(int) );
+			exit(1);
 		}
+		for ( bn=busy_lo; busy_ring && bn <= busy_lo + busy_mask; ++bn )
+			ring[bn & (slots-1)] = busy_ring[bn & busy_mask];	/* blocks already read keep their place */
+		free( busy_ring );
+		busy_ring = ring;
+		busy_mask = slots - 1;
 	}
-	if ( buffalloc < buffsize )
-		buffalloc = buffsize;			/* bump this up if appropriate */
 }
 
 /**
@@ -2771,6 +3253,7 @@ int rdhead ( void )
 	nfound = 1;
 	mstop = 3;				/* autostop when we get to 2 tm's */
 	last_block_number = 0;		/* start all blocks at 0 */
+	read_window = window_opt ? window_opt : MAX_BUFFCOUNT;	/* until the summary record says otherwise */
 	freeall();				/* free all the buffers */
 
 	/* read the tape label - 4 records of 80 bytes */
@@ -2778,6 +3261,12 @@ int rdhead ( void )
 	{
 		marks <<= 1;
 		len = read_record( (unsigned char *)label, sizeof(label) );
+		if ( stm && len > 0 )
+		{
+			skip_to_tm();			/* rest of what's being skipped, its tape mark is counted below */
+			marks <<= 1;
+			len = 0;
+		}
 		if ( !len )
 		{
 			marks |= 1;
@@ -2803,6 +3292,7 @@ int rdhead ( void )
 		}
 		if ( strncmp ( label, "VOL1", 4 ) == 0 )
 		{
+			cat_label( label );
 			memcpy( name, label+4, 14 );
 			name[14] = 0;
 			if ( vflag || tflag )
@@ -2811,11 +3301,12 @@ int rdhead ( void )
 		}
 		if ( strncmp ( label, "HDR1", 4 ) == 0 )
 		{
+			cat_label( label );
 			memcpy( name, label+4, 14 );
 			name[14] = 0;
 			sscanf ( label + 31, "%4d", &setnr );
 			++numHdrs;
-			if ( (vflag&VERB_LVL) || tflag )
+			if ( VERB(VERB_LVL) || tflag )
 				printf( "HDR1: %3d: '%s'\n", numHdrs, name );
 			continue;
 		}
@@ -2823,13 +3314,13 @@ int rdhead ( void )
 		if ( strncmp ( label, "HDR2", 4 ) == 0 )
 		{
 			sscanf ( label + 5, "%5d", &blocksize );
-			if ( (vflag & VERB_DEBUG_LVL) )
+			if ( VERB(VERB_DEBUG_LVL) )
 				printf ( "blocksize = %d\n", blocksize );
 			if ( nflag )
 			{
 				if ( strncmp( name, selsetname, 14 ) )
 				{
-					if ( (vflag&VERB_LVL) || tflag )
+					if ( VERB(VERB_LVL) || tflag )
 					{
 						printf( "Skipping '%s' due to -n option ('%s').\n", name, selsetname );
 					}
@@ -2842,7 +3333,7 @@ int rdhead ( void )
 			{
 				if ( setnr < selset )
 				{
-					if ( (vflag&VERB_LVL) || tflag )
+					if ( VERB(VERB_LVL) || tflag )
 					{
 						printf( "SS number %d less than -s flag of %d. Skipping.\n", setnr, selset );
 					}
@@ -2851,7 +3342,7 @@ int rdhead ( void )
 				}
 				if ( setnr > selset )
 				{
-					if ( (vflag&VERB_LVL) || tflag )
+					if ( VERB(VERB_LVL) || tflag )
 					{
 						printf( "SS number %d more than -s flag of %d. Done.\n", setnr, selset );
 					}
@@ -2864,7 +3355,7 @@ int rdhead ( void )
 			{
 				if ( numHdrs < skipSet )
 				{
-					if ( (vflag&VERB_LVL) || tflag )
+					if ( VERB(VERB_LVL) || tflag )
 					{
 						printf( "Number of HDRs of %d is less than -S flag of %d. Skipping.\n", numHdrs, skipSet );
 					}
@@ -2873,7 +3364,7 @@ int rdhead ( void )
 				}
 				if ( numHdrs > skipSet )
 				{
-					if ( (vflag&VERB_LVL) || tflag )
+					if ( VERB(VERB_LVL) || tflag )
 					{
 						printf( "Number of HDRs %d is more than -S flag of %d. Done.\n", numHdrs, skipSet );
 					}
@@ -2881,6 +3372,7 @@ int rdhead ( void )
 					break;
 				}
 			}
+			cat_label( label );
 			nfound = 0;
 			mstop = 1;
 			continue;
@@ -2888,11 +3380,11 @@ int rdhead ( void )
 	}
 	if ( rptd > 1 )
 		printf( "Snark: rdhead(): Skipped %d bad records looking for a HDR2.\n", rptd );
-	if ( !tflag && (vflag & VERB_LVL) && !nfound )
+	if ( !tflag && VERB(VERB_LVL) && !nfound )
 		printf ( "Saveset name: %s   number: %d\n", name, setnr );
 	if ( !nfound && blocksize && blocksize+16 > buffalloc )
 	{
-		alloc_buffers( MAX_BUFFCOUNT, blocksize );
+		alloc_buffers( read_window, blocksize );
 		freeall();
 	}
 	return( nfound );
@@ -2908,6 +3400,7 @@ int rdhead ( void )
 
 static void end_of_saveset( char *ssname )
 {
+	cat_endset( saveSet_errors );
 	if ( vflag || tflag || saveSet_errors )
 	{
 		char name[80];
@@ -2952,11 +3445,32 @@ void rdtail ( void )
 		}
 		if ( strncmp ( label, "EOF1", 4 ) == 0 )
 		{
+			cat_label( label );
 			end_of_saveset( label );
 		}
 	}
 }
 
+/**
+ * Check a block's CRC.
+ *
+ * @param bptr Pointer to item holding block.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Sets @e bptr->crcbad if it failed. It then counts as missing when it
+ * comes to rebuilding it from its redundancy group.
+ */
+
+static void check_crc( struct buff_ctl *bptr )
+{
+	bptr->crcbad = crcflag && (bptr->blknum > quick_thru || grp_size)
+					&& bc_block( bptr->data, blocksize, SS_BBH_CRC ) == BC_BAD;
+	if ( bptr->crcbad && VERB(VERB_FILE_RDLVL) )
+		printf( "Block %ld failed its CRC check.\n", bptr->blknum ? bptr->blknum : 1 );
+}
+
 #define NXT_BLK_OK	(0)	/*!< block is ok to decode */
 #define NXT_BLK_EOT	(1)	/*!< we're at EOT */
 #define NXT_BLK_TM	(2)	/*!< we're at a TM */
@@ -2981,9 +3495,9 @@ static int read_next_block( )
 {
 	unsigned long numb0;
 	struct buff_ctl *bptr;
-	int ra, hittm=0;
+	int ii;
 
-	if ( !busybuffs )		/* if first time through, need to rdhead() then fill n buffers */
+	if ( !busy_active )		/* if first time through, need to rdhead() then fill n buffers */
 	{
 		if ( rdhead (  ) )	/* read header */
 			return NXT_BLK_EOT;	/* reached eot */
@@ -2996,7 +3510,7 @@ static int read_next_block( )
 		}
 		while ( 1 )
 		{
-			bptr->amt = read_record( bptr->buffer, buffalloc );	/* fill first buffer */
+			bptr->amt = read_block( bptr );	/* fill first buffer */
 			if ( !bptr->amt )
 			{
 				free_buff( bptr );				/* put this back */
@@ -3004,9 +3518,12 @@ static int read_next_block( )
 			}
 			if ( bptr->amt == blocksize )           /* block is ok so far */
 			{
-				numb0 = get_block_number( bptr->buffer );	/* get the block number of leading block */
+				numb0 = tio_blknum();				/* reader thread may have checked it already */
+				if ( !numb0 )
+					numb0 = get_block_number( bptr->data );	/* get the block number of leading block */
 				if ( !numb0 )
 					continue;					/* not a valid block, skip it */
+				check_crc( bptr );
 				if ( numb0 != 1 )				/* it had better be a 1 */
 				{
 					free_buff( bptr );				/* put this back */
@@ -3017,59 +3534,84 @@ static int read_next_block( )
 			printf ( "Snark: record size incorrect. read amt = %d, expected %d\n", bptr->amt, blocksize );
 		}
 		bptr->blknum = 1;					/* always starts with block 1 */
-		add_busybuff( bptr, 0 );				/* put this on the busy queue */
+		read_hi = 1;
+		busy_active = 1;
+		busy_lo = 1;
+		add_busybuff( bptr );				/* put this on the busy queue */
+	}
+	if ( !num_busys && busy_pend )	/* ring has emptied, move the window up to the held blocks */
+	{
+		bptr = buffers + busy_pend;
+		ii = bptr->next;
+		busy_pend = busy_sure = 0;
+		busy_lo = read_hi = bptr->blknum;
+		add_busybuff( bptr );
+		if ( ii )
+			add_busybuff( buffers + ii );
 	}
-	bptr = buffers+busybuffs;		/* point to top item on queue */
-	if ( !bptr->amt )			/* if top buffer is a TM */
+	ii = grp_size && grp_size <= MAX_GROUP_SIZE ? grp_size+1 : 0;	/* room for a group kept and a block rebuilt */
+	if ( read_window+ii+2 > num_buffers )	/* summary record asked for a bigger window */
+		alloc_buffers( read_window+ii+1, blocksize );	/* and one more for a block held past it */
+	if ( busy_tm )				/* nothing left to read */
 	{
-		free_buff( popbusy_buff() );	/* toss the top item */
+		if ( num_busys )
+		{
+			grp_rebuild();
+			return NXT_BLK_OK;	/* just consume whatever is currently on the queue */
+		}
+		busy_active = busy_tm = 0;
 		return NXT_BLK_TM;		/* return eof */
 	}
-	while ( bptr->next )		/* find last item on busy queue */
-		bptr = buffers + bptr->next;
-	if ( !bptr->amt )			/* if last item is a tm, nothing left to read */
-		return NXT_BLK_OK;		/* just consume whatever is currently on the queue */
-	while ( !hittm && num_busys < MAX_BUFFCOUNT )	/* keep busy queue as full as possible */
+	while ( !busy_sure && num_busys < read_window )	/* keep busy queue as full as possible */
 	{
-		for ( ra=num_busys; !hittm && ra < MAX_BUFFCOUNT; ++ra )	/* may need to readahead n buffers */
+		bptr = getfree_buff();		/* get a free buffer */
+		if ( !bptr )
+		{
+			printf( "Snark: Fatal internal error. Ran out of free buffs.\n" );
+			skipping |= SKIP_TO_SAVESET;
+			return NXT_BLK_ERR;
+		}
+		while ( 1 )
 		{
-			bptr = getfree_buff();		/* get a free buffer */
-			if ( !bptr )
+			bptr->amt = read_block( bptr );	/* fill it up */
+			if ( !bptr->amt )		/* reached TM on readahead */
+				break;
+			if ( bptr->amt == blocksize )
 			{
-				printf( "Snark: Fatal internal error. Ran out of free buffs.\n" );
-				skipping |= SKIP_TO_SAVESET;
-				return NXT_BLK_ERR;
+				bptr->blknum = tio_blknum();	/* reader thread may have checked it already */
+				if ( !bptr->blknum )
+					bptr->blknum = get_block_number( bptr->data );	/* get the block number */
+				if ( !bptr->blknum )	/* not a valid block */
+					continue;		/* get another one */
+				check_crc( bptr );
+				break;			/* block is ok so far */
 			}
-			while ( !hittm )
+			printf ( "Snark: record size on readahead is incorrect. read amt = %d, expected %d\n",
+					 bptr->amt, blocksize );
+		}
+		if ( !bptr->amt )
+		{
+			free_buff( bptr );		/* can't read anymore */
+			if ( busy_pend )
+				drop_pend();
+			busy_tm = 1;
+			if ( !num_busys )
 			{
-				bptr->amt = read_record( bptr->buffer, buffalloc );	/* fill it up */
-				if ( !bptr->amt )		/* reached TM on readahead */
-				{
-					hittm = 1;			/* can't read anymore */
-					break;
-				}
-				if ( bptr->amt == blocksize )
-				{
-					bptr->blknum = get_block_number( bptr->buffer );	/* get the block number */
-					if ( !bptr->blknum )	/* not a valid block */
-						continue;		/* get another one */
-					break;			/* block is ok so far */
-				}
-				printf ( "Snark: record size on readahead is incorrect. read amt = %d, expected %d\n",
-						 bptr->amt, blocksize );
+				busy_active = busy_tm = 0;
+				return NXT_BLK_TM;
 			}
-			if ( !hittm )
-				add_busybuff( bptr, 0 );	/* append the buffer to busy queue */
+			break;
+		}
+		if ( busy_pend )		/* does this one bear out the block held past the window? */
+		{
+			if ( bptr->blknum == buffers[busy_pend].blknum+1 )
+				busy_sure = 1;
 			else
-				free_buff( bptr );		/* toss this for now */
+				drop_pend();
 		}
-		remove_dups();				/* account for missing & duplicates in busy queue */
-	}
-	if ( hittm )			/* if we've hit a TM */
-	{
-		bptr = getfree_buff();
-		add_busybuff( bptr, 0 );	/* stick a TM at end of busy queue */
+		add_busybuff( bptr );		/* put it in its slot */
 	}
+	grp_rebuild();				/* next one may be missing */
 	return NXT_BLK_OK;			/* we've got a good record */
 }
 
@@ -3092,26 +3634,62 @@ typedef enum
 	,OPT_VER_DELIMIT	/* -delimiter */
 	,OPT_VFC
 	,OPT_BINARY			/* write binary and preserve record formats */
+	,OPT_INBUF			/* --inbuf */
+	,OPT_NOMAP			/* --nomap */
+	,OPT_READAHEAD		/* --readahead */
+	,OPT_STATS			/* --stats */
+	,OPT_URING			/* --uring */
+	,OPT_DIRECT			/* --direct */
+	,OPT_TAPEBUF		/* --tapebuf */
+	,OPT_WINDOW			/* --window */
+	,OPT_HUGEPAGES		/* --hugepages */
+	,OPT_CRC			/* --crc */
+	,OPT_NOCRC			/* --nocrc */
+	,OPT_CHECK			/* --check */
+	,OPT_QUICK			/* --quick */
+	,OPT_CATALOG		/* --catalog */
+	,OPT_PATTERNS_FROM	/* --patterns-from */
+	,OPT_EXCLUDE		/* --exclude */
+	,OPT_EXCLUDE_FROM	/* --exclude-from */
+	,OPT_EXCLUDE_TYPE	/* --exclude-type */
 } Options_t;
 
 static struct option long_options[] = 
 {
-	 {"delimiter", optional_argument, NULL, OPT_VER_DELIMIT }
+	 {"catalog", required_argument, NULL, OPT_CATALOG }
+	,{"check", optional_argument, NULL, OPT_CHECK }
+	,{"crc", no_argument, NULL, OPT_CRC }
+	,{"delimiter", optional_argument, NULL, OPT_VER_DELIMIT }
+	,{"direct", no_argument, NULL, OPT_DIRECT }
 	,{"dvd",no_argument,NULL,'i'}
+	,{"exclude", required_argument, NULL, OPT_EXCLUDE }
+	,{"exclude-from", required_argument, NULL, OPT_EXCLUDE_FROM }
+	,{"exclude-type", required_argument, NULL, OPT_EXCLUDE_TYPE }
 	,{"extract",optional_argument,NULL,OPT_EXTRACT}
 	,{"file", required_argument, NULL, 'f' }
 	,{"hierarchy", no_argument, NULL, 'd' }
+	,{"hugepages", no_argument, NULL, OPT_HUGEPAGES }
+	,{"inbuf", required_argument, NULL, OPT_INBUF }
 	,{"hdr1",required_argument,NULL,'s'}
 	,{"help", no_argument, NULL, 'h' }
 	,{"list",no_argument,NULL,'t'}
 	,{"lowercase", no_argument, NULL, 'l'}
+	,{"nocrc", no_argument, NULL, OPT_NOCRC }
+	,{"nomap", no_argument, NULL, OPT_NOMAP }
 	,{"noversions", no_argument, NULL, 'R'}
+	,{"patterns-from", required_argument, NULL, OPT_PATTERNS_FROM }
 	,{"prompt",no_argument,NULL,'w'}
+	,{"quick", no_argument, NULL, OPT_QUICK }
+	,{"readahead", required_argument, NULL, OPT_READAHEAD }
 	,{"binary",no_argument,NULL,OPT_BINARY }
 	,{"setname", required_argument, NULL, 'n'}
 	,{"simh",no_argument,NULL,'I'}
+	,{"stats", no_argument, NULL, OPT_STATS }
+	,{"tapebuf", required_argument, NULL, OPT_TAPEBUF }
+	,{"uring", required_argument, NULL, OPT_URING }
 	,{"verbose",required_argument,NULL,'v'}
 	,{"vfc", required_argument, NULL, 'F' }
+	,{"window", required_argument, NULL, OPT_WINDOW }
 	,{NULL,0,NULL,0}
 };
 
@@ -3128,24 +3706,48 @@ static struct option long_options[] =
 
 void usage ( const char *progname, int full )
 {
-	printf ("%s version 3.12, May 2024\n", progname );
+	printf ("%s version 3.13, October 2026\n", progname );
 	printf ( "Usage:  %s -{tx}[cdeiIhw?][-n <name>][-s <num>][-v <num>] -f <file>\n",
 			 progname );
 	if ( full )
 	{
 		printf ( "Where {} indicates one option is required, [] indicates optional and <> indicates parameter:\n"
 				 " -c               Convert VMS filename version delimiter ';' to ':'\n"
+				 " --catalog=file   Note the savesets and files of the image in 'file' as it's read (-t or -x). A -t of the\n"
+				 "                      same image (same size, modification time and samples of its contents) is then done\n"
+				 "                      from 'file' without reading the image, and a -x with patterns reads just the\n"
+				 "                      blocks of the files they select. Needs the one -f image, and not -n or -s.\n"
+				 " --check[=n]      Check the tape or image without extracting anything: labels, block numbers (missing,\n"
+				 "                      duplicated or out of order), block headers, CRCs (with --crc) and record headers.\n"
+				 "                      Shows what's wrong with each saveset and exits with 1 if anything is. The blocks are\n"
+				 "                      checked by 'n' threads (0 <= n <= 64, default 0 which means one per CPU). -n and -s\n"
+				 "                      are ignored.\n"
+				 " --crc            Check the CRC of each block (a block that fails is rebuilt from its redundancy group\n"
+				 "                      if it can be, else it's used anyway and its file flagged). Off by default until it\n"
+				 "                      has been tried against savesets written by VMS. --nocrc turns it off again.\n"
 				 " --delimiter[=x]  Convert VMS filename version delimiter from ';' to whatever 'x' is (x must be printable, defaults 'x' to ':')\n"
 				 " -d, --hierarchy  Maintain VMS directory structure during extraction.\n"
-				 " -x               Extract files from saveset. See -e, -E or --extract below. (Same as --extract=0).\n"
-				 " -e               Extract all files regardless of filetype (except .dir and .mai).\n"
-				 " -E               Extract all files regardless of filetype (including .dir and .mai).\n"
+				 " --direct         Read -i or -I images with O_DIRECT to keep them out of the page cache. If that's not\n"
+				 "                      possible, tell the kernel to drop each part of the image from it once read.\n"
+				 " -x               Extract files from saveset (same as --extract=0, so .EXE, .LIB, .OBJ etc. are left out).\n"
+				 " -e               With -x, same as --extract=1: .EXE, .LIB and .OBJ files are extracted too.\n"
+				 " -E               With -x, same as --extract=2: all files except .DIR and .MAI are extracted.\n"
 				 " --extract[=n]    Extract all files according to value of n:\n"
 				 "                     0  = All except .DIR,.EXE,.LIB,.MAI,.OBJ,.ODL,.OLB,.PMD,.SYS,.TLB,.TLO,.TSK,.UPD (default)\n"
 				 "                     1  = All except .DIR,.MAI,.ODL,.OLB,.PMD,.SYS,.TLB,.TLO,.TSK,.UPD\n"
 				 "                     2+ = All except .DIR,.MAI\n"
+				 "                     The whole type has to match (before 3.13 a .SYSTEM file was taken for a .SYS one,\n"
+				 "                     .EXE2 for .EXE and so on). Files left out are skipped before any directory is made.\n"
+				 "                     Before 3.13 -x without -d often extracted them anyway; now it never does.\n"
+				 " --exclude=pattern Don't list or extract the files matching 'pattern'. Give it more than once for more.\n"
+				 " --exclude-from=file Don't list or extract the files matching the patterns in 'file' (one to a line).\n"
+				 " --exclude-type=list Don't extract files of these types as well as those above (a comma separated list,\n"
+				 "                      e.g. BAK,JOU,LIS). Case doesn't matter and the whole type has to match.\n"
 				 " -f name          See --file below.\n"
 				 " --file=name      Name of image or device. Alternate to -f. Required parameter (no default)\n"
+				 "                      An image can be read from a pipe, either a FIFO or stdin given as '-'.\n"
+				 "                      Give it more than once, or as a quoted wildcard, to read several volumes of a\n"
+				 "                      multi-volume saveset one after the other.\n"
 				 " -F n             See --vfc below.\n"
 				 " --binary         Output records in binary while preserving record formats and attributes by including them in the filename.\n"
 				 "                      The output files will be named x.x[;version][;format;size;att]\n"
@@ -3161,16 +3763,33 @@ void usage ( const char *progname, int full )
 				 "                      2 - Insert the two VFC bytes at the head of each record unchanged.\n"
 				  );
 		printf(  " -h, --help       This message.\n"
+				 " --hugepages      Ask for transparent huge pages for the block buffers (helps with large blocksizes).\n"
 				 " -i, --dvd        Input is of type DVD disk image of tape (aka Atari format).\n"
 				 " -I, --simh       Input is of type SIMH format disk image of tape.\n"
+				 "                      Neither is needed. The format of an image (-i, -I or a disk saveset) is worked\n"
+				 "                      out from its first few records and shown with -t. These just force a device\n"
+				 "                      to be read as an image.\n"
+				 " --inbuf=n        Read -i or -I images that cannot be memory mapped 'n' MB at a time (1 <= n <= 16, default 4).\n"
 				 " -l, --lowercase  Lowercase all directory and filenames.\n"
 				 " -R, --noversions Strip off file version number and output only latest version.\n"
+				 " --readahead=n    Read up to 'n' records ahead of the decoding in a separate thread (0 <= n <= 1024, default 32).\n"
+				 "                      0 means don't use a separate thread.\n"
 				 " -n name          See --setname below.\n"
+				 " --nomap          Don't memory map -i or -I images. Read them with --inbuf sized reads instead.\n"
+				 " --patterns-from=file Select the files matching the patterns in 'file' (one to a line) as well as any\n"
+				 "                      given after the options. Thousands of them cost little more than one. Note\n"
+				 "                      '[' starts a list of characters, \"[[]\" is a '['. Write a directory \"[[]DIR]...\" for\n"
+				 "                      it to be matched as a prefix, the fast way.\n"
 				 " --setname=name   Select the name of the saveset in the tape image as found in a HDR1 record.\n"
 				 " -s n             See --hdr1 below.\n"
+				 " --stats          Show input statistics (and how fast block CRCs were checked) at end of tape.\n"
 				 " --hdr1=n         'n' is a decimal number indicating which file delimited by HDR1 records to unpack. (Starts at 1).\n"
 				 "                      I.e. --hdr1number=3 means skip to the third HDR1 then unpack just that file.\n"
 				 " -t, --list       List file contents to stdout.\n"
+				 " --tapebuf=n      Read up to 'n' MB ahead of the decoding from a tape drive so it keeps streaming\n"
+				 "                      (0 <= n <= 512, default 64). 0 means don't use a separate thread.\n"
+				 " --uring=n        Read -i or -I images that are regular files with io_uring keeping 'n' reads of --inbuf MB\n"
+				 "                      in flight (0 <= n <= 64, default 0 which means don't use io_uring).\n"
 				 " -v n             See --verbose below.\n"
 				 " --verbose=n      'n' is a bitmask of items to enable verbose level:\n"
 				 "                      0x01 - small announcements of progress.\n"
@@ -3179,7 +3798,14 @@ void usage ( const char *progname, int full )
 				 "                      0x08 - used to debug buffer queues.\n"
 				 "                      0x10 - lots of other debugging info.\n"
 				 "                      0x20 - block reads if -i or -I mode.\n"
+				 "                      All but 0x01 need a build with HAVE_TRACE=1 (or vmsbackup_trace).\n"
 				 " -w, --prompt     Prompt before writing each output file.\n"
+				 " --quick          With -t, list the files from their file records alone. Their data isn't decoded\n"
+				 "                      (so errors in it aren't found) and the blocks that can only hold file data are\n"
+				 "                      skipped. On an image that can be seeked they aren't even read.\n"
+				 " --window=n       Read 'n' blocks ahead to put duplicate and out of order blocks right (2 <= n <= 8192).\n"
+				 "                      The default is worked out from the /BUFFER_COUNT and /GROUP_SIZE the saveset\n"
+				 "                      was written with (at least 10).\n"
 				 );
 		printf( "\nNOTE: If files are found with VAR or VFC formats but no record attribute set, the filename will\n"
 				"be output as x.x[;version];format;size;NONE; where ';' is the delimiter set in --delimiter (; by\n"
@@ -3194,6 +3820,415 @@ void usage ( const char *progname, int full )
 	}
 }
 
+/**
+ * Add to the list of volumes to read.
+ *
+ * @param name Pointer to null terminated name of tape or image. It may
+ * be a wildcard pattern, in which case the names it matches are added in
+ * sorted order.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Program will print an error message and exit if malloc fails.
+ */
+
+static void add_tapefile( char *name )
+{
+#if HAVE_GLOB
+	glob_t gl;			/* not globfree()'d, the names are used until exit */
+	struct stat st;
+	size_t ii;
+
+	if ( strpbrk( name, "*?[" ) && stat( name, &st ) < 0 && glob( name, 0, NULL, &gl ) == 0 )
+	{
+		for ( ii = 0; ii < gl.gl_pathc; ++ii )
+			add_tapefile( gl.gl_pathv[ii] );
+		return;
+	}
+#endif
+	tapefiles = (char **)realloc( tapefiles, (num_tapefiles + 1)*sizeof(char *) );
+	if ( !tapefiles )
+	{
+		printf( "Snark: Failed to malloc room for %d file names.\n", num_tapefiles + 1 );
+		exit(1);
+	}
+	tapefiles[num_tapefiles++] = name;
+}
+
+/**
+ * Open a tape or image.
+ *
+ * @param name Pointer to null terminated name ("-" means stdin).
+ * @param format Pointer to place to deposit the framing it's thought to
+ * have (one of TIO_FMT_xxx).
+ *
+ * @return file descriptor.
+ *
+ * @note
+ * Program will print an error message and exit if it can't be opened.
+ * A tape is rewound.
+ */
+
+static int open_volume( const char *name, int *format )
+{
+	struct stat fileStat;
+	int vfd;
+
+	if ( !strcmp( name, "-" ) )
+	{
+		vfd = STDIN_FILENO;
+#if MSYS2 || MINGW
+		setmode( vfd, O_BINARY );
+#endif
+		if ( fstat( vfd, &fileStat ) < 0 )
+		{
+			perror("Failed to stat stdin");
+			exit ( 1 );
+		}
+	}
+	else
+	{
+		vfd = stat( name, &fileStat);
+		if ( vfd < 0 )
+		{
+			perror("Failed to stat file");
+			exit ( 1 );
+		}
+		vfd = open(name, OPEN_FLAGS);
+		if ( vfd < 0 )
+		{
+			perror ( name );
+			exit ( 1 );
+		}
+	}
+	/* a tape has real records, anything else is an image whose framing is checked */
+	if ( S_ISCHR(fileStat.st_mode) && !iflag && !Iflag )
+		*format = TIO_FMT_RAW;
+	else
+		*format = iflag ? TIO_FMT_DVD : (Iflag ? TIO_FMT_SIMH : TIO_FMT_AUTO);
+
+#if HAVE_MTIO
+	if ( *format == TIO_FMT_RAW )
+	{
+		/* rewind the tape */
+		int ii;
+		struct mtop op;
+		op.mt_op = MTSETBLK;
+		op.mt_count = 0;
+		ii = ioctl( vfd, MTIOCTOP, &op );
+		if ( ii < 0 )
+		{
+			perror( "Unable to set to variable blocksize." );
+			exit ( 1 );
+		}
+		op.mt_op = MTREW;
+		op.mt_count = 1;
+		ii = ioctl ( vfd, MTIOCTOP, &op );
+		if ( ii < 0 )
+		{
+			perror ( "Unable to rewind tape." );
+			exit ( 1 );
+		}
+	}
+#endif
+	return vfd;
+}
+
+/**
+ * Get ready to read the current volume from the start.
+ *
+ * @param vfd File descriptor from open_volume().
+ * @param format Framing it's thought to have.
+ *
+ * @return nothing.
+ *
+ * @note
+ * Looks for a compressed image and sets up to decompress it.
+ */
+
+static void start_volume( int vfd, int format )
+{
+	if ( format != TIO_FMT_RAW )
+	{
+		/* look for a compressed image */
+		unsigned char head[DC_MAGIC_LEN];
+		int hlen, sts, comp;
+
+		for ( hlen = 0; hlen < DC_MAGIC_LEN; hlen += sts )
+		{
+			sts = read( vfd, head + hlen, DC_MAGIC_LEN - hlen );
+			if ( sts <= 0 )
+				break;
+		}
+		comp = dc_magic( head, hlen );
+		if ( !dc_supported( comp ) )
+		{
+			printf( "Snark: %s is %s compressed but support for that wasn't built in.\n", tapefile, dc_name( comp ) );
+			exit ( 1 );
+		}
+		cat_packed = comp != DC_NONE;
+		if ( comp != DC_NONE || lseek( vfd, 0, SEEK_SET ) != 0 )
+			dc_open( vfd, comp, head, hlen );	/* decompress it, or give back what was read from a pipe */
+	}
+}
+
+static int ahead_fd = -1;	/*!< next volume if it was opened ahead of time */
+static int ahead_format;	/*!< and the framing it's thought to have */
+
+/**
+ * Done with the current volume, open the next one.
+ *
+ * @param format Pointer to place to deposit the framing it's thought to have.
+ *
+ * @return file descriptor or -1 if there are no more.
+ *
+ * @note
+ * Called by tio_record() at the end of each volume, once everything
+ * before it has been handed out.
+ */
+
+static int next_volume( int *format )
+{
+	dc_close();
+	close( fd );
+	fd = -1;
+	if ( cur_tapefile + 1 >= num_tapefiles )
+		return -1;
+	tapefile = tapefiles[++cur_tapefile];
+	if ( ahead_fd >= 0 )
+	{
+		fd = ahead_fd;
+		*format = ahead_format;
+		ahead_fd = -1;
+	}
+	else
+		fd = open_volume( tapefile, format );
+	start_volume( fd, *format );
+	return fd;
+}
+
+/**
+ * Open the next volume ahead of time.
+ *
+ * @return file descriptor or -1 if there isn't one.
+ *
+ * @note
+ * Called by tio_record() as the end of the current volume gets near.
+ */
+
+static int ahead_volume( void )
+{
+	if ( ahead_fd < 0 && cur_tapefile + 1 < num_tapefiles )
+		ahead_fd = open_volume( tapefiles[cur_tapefile + 1], &ahead_format );
+	return ahead_fd;
+}
+
+/**
+ * List an image from its catalog (-t --catalog).
+ *
+ * @return exit status.
+ *
+ * @note
+ * The listing is the same as reading the image would give, less any
+ * messages about what was wrong with it (the count of errors in each
+ * saveset is kept though).
+ */
+
+static int list_catalog( void )
+{
+	struct cat_set cs;
+	struct cat_file cf;
+	unsigned long jj, nfiles = 0;
+	char name[16];
+	int ii, clen;
+
+	printf( "Format: %s\n", tio_name( cat_format() ) );
+	for ( ii = 0; ii < cat_nsets(); ++ii )
+	{
+		cat_getset( ii, &cs );
+		if ( cs.vol1[0] )
+		{
+			memcpy( name, cs.vol1+4, 14 );
+			name[14] = 0;
+			printf ( "Volume: %s\n", name );
+		}
+		memcpy( name, cs.hdr1+4, 14 );
+		name[14] = 0;
+		printf( "HDR1: %3d: '%s'\n", ii+1, name );
+		if ( cs.summary )
+			process_summary( (unsigned char *)cs.summary, cs.summlen );
+		for ( jj = 0; jj < cs.nfiles; ++jj )
+		{
+			cat_getfile( cs.first + jj, &cf );
+			if ( !selected( cf.name ) )
+				continue;
+			memset( &file, 0, sizeof(file) );
+			clen = strlen( cf.name );
+			if ( clen > INT_SIZEOF(file.name)-1 )
+				clen = sizeof(file.name)-1;
+			memcpy( file.name, cf.name, clen );
+			file.name[ clen ] = 0;
+			file.size = cf.size;
+			file.recfmt = file.savRecFmt = cf.recfmt;
+			file.recatt = cf.recatt;
+			file.recsize = cf.recsize;
+			file.vfcsize = cf.vfcsize;
+			list_file( &file );
+			++nfiles;
+		}
+		if ( cs.ended )
+		{
+			saveSet_errors = cs.errors;
+			end_of_saveset( cs.eof1[0] ? cs.eof1 : NULL );
+			total_errors += saveSet_errors;
+		}
+	}
+	printf ( "End of tape\n" );
+	if ( statflag )
+	{
+		printf( "Catalog: listed %lu files of %d savesets from '%s' without reading the image.\n",
+				nfiles, cat_nsets(), catname );
+		if ( patterns )
+			pat_stats( patterns, "Patterns" );
+		if ( excl_pats )
+			pat_stats( excl_pats, "Excludes" );
+	}
+	cat_close();
+	if ( total_errors )
+		printf( "Snark: A total of %d error%s detected.\n",
+				total_errors, total_errors > 1 ? "s" : "" );
+	return 0;
+}
+
+/**
+ * Extract the selected files using the catalog's index (-x --catalog).
+ *
+ * @return exit status, -1 if the index isn't up to it.
+ *
+ * @note
+ * Just the blocks from each file's file record to its last VBN record
+ * are read. If one of them isn't in the index (it was missing from the
+ * image or rebuilt from its redundancy group, say) or the image is
+ * compressed it's left to reading all of the image, which writes a
+ * new catalog too.
+ */
+
+static int extract_catalog( void )
+{
+	struct cat_set cs;
+	struct cat_file cf;
+	unsigned long jj, blk, last, prev, nblks = 0;
+	unsigned char *buf;
+	int ii, fd, bsize, maxbs = 0, ok;
+	off_t off;
+
+	ok = !cat_compressed() && cat_format() != TIO_FMT_RAW;
+	for ( ii = 0; ok && ii < cat_nsets(); ++ii )
+	{
+		cat_getset( ii, &cs );
+		bsize = 0;
+		sscanf( cs.hdr2 + 5, "%5d", &bsize );
+		for ( jj = 0; ok && jj < cs.nfiles; ++jj )
+		{
+			cat_getfile( cs.first + jj, &cf );
+			if ( !selected( cf.name ) || excl_type( cf.name ) )
+				continue;
+			ok = bsize > (int)sizeof(struct bbh);
+			if ( bsize > maxbs )
+				maxbs = bsize;
+			last = cf.last_blk > cf.frec_blk ? cf.last_blk : cf.frec_blk;
+			for ( blk = cf.frec_blk; ok && blk <= last; ++blk )
+				ok = cat_blkoff( ii, blk ) >= 0;
+		}
+	}
+	fd = ok ? open( tapefiles[0], OPEN_FLAGS ) : -1;
+	if ( fd < 0 )
+	{
+		printf( "Snark: '%s' can't be used to go straight to the files. Reading all of '%s'.\n",
+				catname, tapefiles[0] );
+		cat_close();
+		return -1;
+	}
+	buf = (unsigned char *)malloc( maxbs ? maxbs : 1 );
+	if ( !buf )
+	{
+		printf( "Snark: Failed to malloc %d bytes for a block buffer.\n", maxbs );
+		exit( 1 );
+	}
+	for ( ii = 0; ii < cat_nsets(); ++ii )
+	{
+		cat_getset( ii, &cs );
+		sscanf( cs.hdr2 + 5, "%5d", &blocksize );
+		saveSet_errors = 0;
+		prev = 0;
+		for ( jj = 0; jj < cs.nfiles; ++jj )
+		{
+			cat_getfile( cs.first + jj, &cf );
+			if ( !selected( cf.name ) || excl_type( cf.name ) )
+				continue;
+			cat_only = cf.name;
+			skipping = SKIP_TO_FILE;	/* up to its file record */
+			last = cf.last_blk > cf.frec_blk ? cf.last_blk : cf.frec_blk;
+			for ( blk = cf.frec_blk; blk <= last; ++blk )
+			{
+				if ( blk == prev )
+				{
+					last_block_number = blk - 1;
+					process_block( buf );	/* the last file ended in it, it's still here */
+					continue;
+				}
+				prev = 0;
+				off = cat_blkoff( ii, blk );
+				if ( lseek( fd, off, SEEK_SET ) != off || read( fd, buf, blocksize ) != blocksize )
+				{
+					printf( "Snark: Failed to read block %lu of '%s'.\n", blk, tapefiles[0] );
+					++file.file_blk_error;
+					++saveSet_errors;
+					break;
+				}
+				++nblks;
+				if ( get_block_number( buf ) != blk )
+				{
+					printf( "Snark: block %lu isn't where '%s' has it.\n", blk, catname );
+					++file.file_blk_error;
+					++saveSet_errors;
+					break;
+				}
+				if ( crcflag && bc_block( buf, blocksize, SS_BBH_CRC ) == BC_BAD )
+				{
+					printf( "Snark: block %lu failed its CRC check.\n", blk );
+					++file.file_blk_error;
+					++saveSet_errors;
+				}
+				last_block_number = blk - 1;
+				blk_off = off;
+				prev = blk;
+				process_block( buf );
+			}
+			close_file();
+			cat_only = NULL;
+		}
+		if ( cs.ended || saveSet_errors )
+			end_of_saveset( cs.eof1[0] ? cs.eof1 : NULL );
+		total_errors += saveSet_errors;
+	}
+	if ( statflag )
+	{
+		printf( "Catalog: read %lu blocks of '%s' to extract the files.\n", nblks, tapefiles[0] );
+		pat_stats( patterns, "Patterns" );
+		if ( excl_pats )
+			pat_stats( excl_pats, "Excludes" );
+	}
+	free( buf );
+	close( fd );
+	cat_close();
+	if ( total_errors )
+		printf( "Snark: A total of %d error%s detected.\n",
+				total_errors, total_errors > 1 ? "s" : "" );
+	return 0;
+}
+
 /**
  * Program entry.
  *
@@ -3207,6 +4242,11 @@ void usage ( const char *progname, int full )
 
 int main ( int argc, char *argv[] )
 {
+	static const char * const def_types[] = {
+		"EXE,LIB,OBJ",			/* VMS images, object files and libraries (--extract=0) */
+		"ODL,OLB,PMD,SYS,TLB,TLO,TSK,UPD",	/* RSX ones (--extract=1) */
+		"DIR,MAI"			/* directories and mail files (always) */
+	};
 	const char *progname;
 	int c, eoffl;
 	extern int optind;
@@ -3214,7 +4254,6 @@ int main ( int argc, char *argv[] )
 	char *endp;
 	struct tm tadj;
 	int option_index = 0;
-	struct stat fileStat;
 	
 	memset( &tadj, 0, sizeof(tadj) );
 	tadj.tm_sec = 0;
@@ -3280,7 +4319,7 @@ int main ( int argc, char *argv[] )
 			break;
 		case OPT_FILE:			/* -f */
 		case 'f':
-			tapefile = optarg;
+			add_tapefile( optarg );
 			break;
 		case 'F':
 			endp = NULL;
@@ -3309,6 +4348,107 @@ int main ( int argc, char *argv[] )
 		case OPT_BINARY:
 			++binaryFlag;
 			break;
+		case OPT_INBUF:
+			endp = NULL;
+			tio_bufsize = strtol(optarg,&endp,0);
+			if ( !endp || *endp || tio_bufsize < 1 || tio_bufsize > 16 )
+			{
+				printf("Snark: Bad --inbuf parameter: '%s'. Must be a number 1 <= n <= 16\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_NOMAP:
+			++tio_nomap;
+			break;
+		case OPT_HUGEPAGES:
+			++tio_hugepages;
+			break;
+		case OPT_CRC:
+			crcflag = 1;
+			break;
+		case OPT_NOCRC:
+			crcflag = 0;
+			break;
+		case OPT_QUICK:
+			++quickflag;
+			break;
+		case OPT_CATALOG:
+			catname = optarg;
+			break;
+		case OPT_PATTERNS_FROM:
+			if ( !patterns )
+				patterns = pat_new();
+			if ( pat_addfile( patterns, optarg ) )
+				return 1;
+			break;
+		case OPT_EXCLUDE:
+			if ( !excl_pats )
+				excl_pats = pat_new();
+			pat_add( excl_pats, optarg );
+			break;
+		case OPT_EXCLUDE_FROM:
+			if ( !excl_pats )
+				excl_pats = pat_new();
+			if ( pat_addfile( excl_pats, optarg ) )
+				return 1;
+			break;
+		case OPT_EXCLUDE_TYPE:
+			excl_addtypes( optarg );
+			break;
+		case OPT_CHECK:
+			++checkflag;
+			if ( !optarg )
+				break;
+			endp = NULL;
+			checkthreads = strtol(optarg,&endp,0);
+			if ( !endp || *endp || checkthreads < 0 || checkthreads > 64 )
+			{
+				printf("Snark: Bad --check parameter: '%s'. Must be a number 0 <= n <= 64\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_READAHEAD:
+			endp = NULL;
+			tio_readahead = strtol(optarg,&endp,0);
+			if ( !endp || *endp || tio_readahead < 0 || tio_readahead > 1024 )
+			{
+				printf("Snark: Bad --readahead parameter: '%s'. Must be a number 0 <= n <= 1024\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_STATS:
+			++statflag;
+			break;
+		case OPT_DIRECT:
+			++tio_direct;
+			break;
+		case OPT_TAPEBUF:
+			endp = NULL;
+			tio_tapebuf = strtol(optarg,&endp,0);
+			if ( !endp || *endp || tio_tapebuf < 0 || tio_tapebuf > 512 )
+			{
+				printf("Snark: Bad --tapebuf parameter: '%s'. Must be a number 0 <= n <= 512\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_WINDOW:
+			endp = NULL;
+			window_opt = strtol(optarg,&endp,0);
+			if ( !endp || *endp || window_opt < 2 || window_opt > MAX_WINDOW_OPT )
+			{
+				printf("Snark: Bad --window parameter: '%s'. Must be a number 2 <= n <= %d\n", optarg, MAX_WINDOW_OPT);
+				return 1;
+			}
+			break;
+		case OPT_URING:
+			endp = NULL;
+			tio_uring = strtol(optarg,&endp,0);
+			if ( !endp || *endp || tio_uring < 0 || tio_uring > 64 )
+			{
+				printf("Snark: Bad --uring parameter: '%s'. Must be a number 0 <= n <= 64\n", optarg);
+				return 1;
+			}
+			break;
 		case OPT_LOWERCASE:		/* -l */
 		case 'l':
 			++lcflag;
@@ -3347,6 +4487,10 @@ int main ( int argc, char *argv[] )
 				printf("Snark: Bad -v parameter: '%s'. Must be a number\n", optarg);
 				return 1;
 			}
+#if !HAVE_TRACE
+			if ( (vflag & VERB_TRACE) )
+				printf("Snark: -v 0x%X: only 0x01 is in this build, the rest need it built with HAVE_TRACE=1.\n", vflag);
+#endif
 			break;
 		case OPT_PROMPT:			/* -w */
 		case 'w':
@@ -3357,17 +4501,22 @@ int main ( int argc, char *argv[] )
 			break;
 		}
 	}
-	if ( !tapefile )
+	if ( !num_tapefiles )
 	{
 		printf("The -f (or --file) option is required.\n");
 		return 1;
 	}
-	if ( !tflag && !xflag )
+	if ( !tflag && !xflag && !checkflag )
 	{
-		printf( "You must provide either -x or -t.\n" );
+		printf( "You must provide either -x, -t or --check.\n" );
 		usage ( progname, 1 );
 		exit ( 1 );
 	}
+	if ( quickflag && (xflag || !tflag) )
+	{
+		printf( "Snark: --quick only applies to -t without -x. Ignored.\n" );
+		quickflag = 0;
+	}
 	if ( skipSet && nflag )
 	{
 		printf( "-s and -n are mutually exclusive.\n" );
@@ -3375,45 +4524,64 @@ int main ( int argc, char *argv[] )
 		exit(1);
 	}
 	goptind = optind;
-
-	/* open the tape file */
-	fd = stat( tapefile, &fileStat);
-	if ( fd < 0 )
+	if ( goptind < gargc && !patterns )
+		patterns = pat_new();
+	for ( c = goptind; c < gargc; ++c )
+		pat_add( patterns, gargv[c] );
+	for ( c = eflag < 2 ? eflag : 2; c < 3; ++c )
+		excl_addtypes( def_types[c] );		/* what --extract leaves out */
+	qsort( excl_types, excl_ntypes, sizeof(char *), excl_cmp );
+	if ( catname )
 	{
-		perror("Failed to stat file");
-		return 1;
-	}
-	fd = open(tapefile, OPEN_FLAGS);
-	if ( fd < 0 )
-	{
-		perror ( tapefile );
-		exit ( 1 );
-	}
+		struct stat st;
 
-#if HAVE_MTIO
-	if ( !S_ISREG(fileStat.st_mode) && !iflag && !Iflag )
-	{
-		/* rewind the tape */
-		int ii;
-		struct mtop op;
-		op.mt_op = MTSETBLK;
-		op.mt_count = 0;
-		ii = ioctl( fd, MTIOCTOP, &op );
-		if ( ii < 0 )
+		if ( checkflag || nflag || skipSet || num_tapefiles != 1 || !strcmp( tapefiles[0], "-" )
+			 || stat( tapefiles[0], &st ) < 0 || !S_ISREG(st.st_mode) )
 		{
-			perror( "Unable to set to variable blocksize." );
-			exit ( 1 );
+			printf( "Snark: --catalog needs the one -f image, a regular file, and not --check, -n or -s. Ignored.\n" );
+			catname = NULL;
 		}
-		op.mt_op = MTREW;
-		op.mt_count = 1;
-		ii = ioctl ( fd, MTIOCTOP, &op );
-		if ( ii < 0 )
+		else if ( tflag && !xflag && cat_load( catname, tapefiles[0] ) )
+			return list_catalog();
+		else if ( xflag && !tflag && patterns && cat_load( catname, tapefiles[0] ) )
 		{
-			perror ( "Unable to rewind tape." );
-			exit ( 1 );
+			c = extract_catalog();
+			if ( c >= 0 )
+				return c;
 		}
 	}
-#endif
+
+	/* open the tape file ("-" means stdin) */
+	cur_tapefile = 0;
+	tapefile = tapefiles[0];
+	fd = open_volume( tapefile, &tape_format );
+	start_volume( fd, tape_format );
+	if ( num_tapefiles > 1 )
+		tio_volumes( next_volume, ahead_volume );
+
+	c = tio_open( fd, tape_format );
+	if ( tape_format != TIO_FMT_AUTO && c != tape_format )
+		printf( "Snark: %s is a %s, not a %s. Reading it as one.\n", tapefile, tio_name( c ), tio_name( tape_format ) );
+	tape_format = c;
+	if ( vflag || tflag || checkflag )
+		printf( "Format: %s\n", tio_name( tape_format ) );
+	if ( catname )
+		cat_begin( tapefile, tape_format, cat_packed );
+
+	if ( checkflag )
+	{
+		c = ck_run( tape_format, checkthreads, crcflag, window_opt );
+		if ( statflag )
+		{
+			tio_stats();
+			dc_stats();
+		}
+		tio_close();
+		dc_close();
+		if ( fd >= 0 )
+			close ( fd );
+		return c ? 1 : 0;
+	}
 
 	eoffl = 0;
 	/* read the backup tape blocks until end of tape */
@@ -3447,6 +4615,24 @@ int main ( int argc, char *argv[] )
 		case NXT_BLK_OK:
 			{
 				bptr = popbusy_buff();
+				if ( catname )
+					cat_block( bptr->blknum, bptr->off );
+				if ( last_block_number < quick_thru && bptr->blknum > last_block_number+1 )
+					quick_gap( bptr->blknum );	/* tapeio skipped some */
+				if ( bptr->blknum <= quick_thru )
+				{
+					last_block_number = bptr->blknum;	/* just file data */
+					++quick_skipped;
+					grp_done( bptr );	/* still part of its group */
+					eoffl = 0;
+					continue;
+				}
+				if ( bptr->crcbad )
+				{
+					printf( "Snark: block %ld failed its CRC check.\n", bptr->blknum );
+					++file.file_blk_error;
+					++saveSet_errors;
+				}
 				if ( bptr->blknum != last_block_number+1 )
 				{
 					printf( "Snark: block %ld out of sequence. Expected %ld\n",
@@ -3462,17 +4648,40 @@ int main ( int argc, char *argv[] )
 		}
 		if ( bptr )
 		{
-			process_block ( bptr->buffer );
-			free_buff( bptr );
+			blk_off = bptr->off;
+			process_block ( bptr->data );
+			grp_done( bptr );
 		}
 	}
 	close_file();
+	if ( catname )
+		cat_written = !cat_write( catname );
 
 	if ( vflag || tflag )
 		printf ( "End of tape\n" );
 
+	if ( statflag )
+	{
+		if ( grp_rebuilt )
+			printf( "Redundancy: rebuilt %d missing blocks from their XOR blocks.\n", grp_rebuilt );
+		if ( quickflag )
+			printf( "Quick listing: skipped %lu blocks of nothing but file data.\n", quick_skipped );
+		if ( cat_written )
+			printf( "Catalog: wrote '%s'.\n", catname );
+		if ( patterns )
+			pat_stats( patterns, "Patterns" );
+		if ( excl_pats )
+			pat_stats( excl_pats, "Excludes" );
+		tio_stats();
+		dc_stats();
+		bc_stats();
+	}
+
 	/* close the tape */
-	close ( fd );
+	tio_close();
+	dc_close();
+	if ( fd >= 0 )
+		close ( fd );
 	if ( total_errors )
 		printf( "Snark: A total of %d error%s detected.\n",
 				total_errors, total_errors > 1 ? "s" : "" );